@@ -51,6 +51,17 @@
   #endif
 #endif
 
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- simd
+
+// translation units using these should include the matching intrinsics
+// header (emmintrin.h or arm_neon.h) themselves
+#if USE_SIMD && (defined(__SSE2__) || defined(_M_X64) || \
+                 (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+  #define SIMD_SSE2 1
+#elif USE_SIMD && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+  #define SIMD_NEON 1
+#endif
+
 // ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- audio.c
 void audio_init(uint32_t sample_rate);
 void audio_close(void);
@@ -122,6 +133,11 @@ uint32_t mem_loadrom(uint32_t addr32, const char *filename, uint8_t failure_fata
 uint32_t mem_loadbios(const char *filename);
 void mem_dump(const char *path);
 void mem_write(uint32_t addr, const uint8_t *src, size_t size);
+void mem_read(uint8_t *dst, uint32_t addr, size_t size);
+// bulk handlers for rep stos/movs, return false if the caller must fall back
+// to single element accesses
+bool mem_fill(uint32_t addr, uint16_t value, uint32_t count, uint32_t size);
+bool mem_move(uint32_t dst, uint32_t src, uint32_t count, uint32_t size);
 void mem_state_save(FILE *fd);
 void mem_state_load(FILE *fd);
 
@@ -172,8 +188,33 @@ bool disk_is_inserted(int num);
 bool disk_insert(uint8_t drivenum, const char *filename);
 bool disk_insert_mem(uint8_t drivenum, const char *filename);
 void disk_eject(uint8_t drivenum);
+// write buffered changes of all drives through to their images
+void disk_flush(void);
+// overlay disk commands, see disk_cow.c
+bool disk_discard(uint8_t drivenum);
+bool disk_commit(uint8_t drivenum);
+bool disk_snapshot(uint8_t drivenum, const char *path);
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- disk_cache.c
+struct disk_cache_stats_t {
+  // blocks found in and missing from the caches
+  uint64_t hits, misses;
+  // blocks fetched ahead of sequential reads
+  uint64_t read_ahead;
+  // changed blocks written to the images
+  uint64_t write_backs;
+};
+
+// cache size for drives inserted from now on
+extern uint32_t disk_cache_kb;
+void disk_cache_stats(struct disk_cache_stats_t *out);
 void disk_int_handler(int intnum);
 void disk_bootstrap(int intnum);
+// start and stop the disk io thread
+bool disk_async_init(void);
+void disk_async_close(void);
+// deliver a completed disk request to the guest
+void disk_async_tick(void);
 
 extern uint8_t bootdrive, hdcount, fdcount;
 
@@ -196,6 +237,20 @@ void log_close(void);
 void log_mute(bool enable);
 void log_printf(int channel, const char *fmt, ...);
 
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- hash.c
+uint64_t hash64(const void *data, const size_t size, const uint64_t seed);
+// fold a value into a running hash
+uint64_t hash64_combine(const uint64_t h, const uint64_t v);
+uint64_t hash64_mix(uint64_t h);
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- lz.c
+// returns the compressed size, or 0 if it would not fit in `cap` bytes
+uint32_t lz_compress(const uint8_t *src, const uint32_t size, uint8_t *dst,
+                     const uint32_t cap);
+// false unless the input decodes to exactly `out_size` bytes
+bool lz_decompress(const uint8_t *src, const uint32_t size, uint8_t *dst,
+                   const uint32_t out_size);
+
 // ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ports.c
 typedef void (*port_write_b_t)(uint16_t portnum, uint8_t value);
 typedef uint8_t (*port_read_b_t)(uint16_t portnum);
@@ -226,6 +281,24 @@ bool rom_insert();
 // memory access for video cards
 uint8_t neo_mem_read_A0000(uint32_t addr);
 void neo_mem_write_A0000(uint32_t addr, uint8_t value);
+uint16_t neo_mem_readw_A0000(uint32_t addr);
+void neo_mem_writew_A0000(uint32_t addr, uint16_t value);
+
+// byte view of vga memory while chain-4 writes need no processing, else NULL.
+// writes through it must also mark their page in neo_vga_dirty, one bit per
+// 16k bytes.
+extern uint8_t *neo_chain4_ram;
+extern uint32_t neo_vga_dirty;
+
+// bulk access, the range must lie within A0000-AFFFF
+void neo_mem_write_block(uint32_t addr, const uint8_t *src, size_t size);
+void neo_mem_read_block(uint8_t *dst, uint32_t addr, size_t size);
+// `count` elements of `size` (1 or 2) bytes as rep stos would write
+void neo_mem_fill(uint32_t addr, uint16_t value, uint32_t count,
+                  uint32_t size);
+// `count` elements of `size` (1 or 2) bytes as rep movs would copy
+void neo_mem_move(uint32_t dst, uint32_t src, uint32_t count,
+                  uint32_t size);
 
 bool neo_init(void);
 bool neo_int10_handler(void);
@@ -240,6 +313,10 @@ void neo_state_load(FILE *fd);
 void vga_timing_init(void);
 void vga_timing_advance(const uint64_t cycles);
 uint8_t vga_timing_get_3da(void);
+// vblanks per emulated second
+double vga_timing_refresh(void);
+// vblanks since power on
+uint32_t vga_timing_frames(void);
 bool vga_timing_should_flip(void);
 void vga_timing_did_flip(void);
 
@@ -251,4 +328,50 @@ void cmos_init(void);
 bool cmos_nmi_enabled(void);
 
 // ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- dos.c
+// exit code when a program given with -exe can't be loaded
+#define DOS_EXIT_LOAD_FAILED 126
+// exit code of a batch run that stopped without the guest exiting
+#define DOS_EXIT_HALTED 125
+
 bool on_dos_int(void);
+void dos_init(void);
+// stream guest console output to stdout and exit on int 21h 4Ch
+void dos_batch(void);
+bool dos_is_batch(void);
+// called at bootstrap, console output is captured from here on
+void dos_boot(void);
+void dos_int10(void);
+// buffered console output, '\r\n' is written as '\n'
+void dos_console_out(const uint8_t c);
+void dos_console_flush(void);
+// stop the emulator, which exits with `code`
+void dos_exit(const int code);
+// true once the guest has exited, with its return code
+bool dos_exited(int *code);
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- dos_host.c
+// serve int 21h file calls on drive `letter` from host directory `path`
+bool dos_host_mount(const char letter, const char *path);
+// true if an int 21h call was handled here
+bool dos_host_int(void);
+// drive letter of the host drive, 0 if there is none
+char dos_host_letter(void);
+// serve paths with no drive from the host drive
+void dos_host_default(const bool on);
+// a program run with no DOS has its PSP at `seg`
+void dos_host_set_psp(const uint16_t seg);
+// the running program is ending, its host files are closed
+void dos_host_terminate(void);
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- dos_exec.c
+// load a COM or MZ program at bootstrap in place of a boot disk
+void dos_exec_set(const char *path);
+void dos_exec_args(const char *args);
+// add a NAME=VALUE environment variable
+bool dos_exec_env(const char *var);
+// load the program, false if there is none to run. one that fails to load
+// ends the emulator with DOS_EXIT_LOAD_FAILED
+bool dos_exec_boot(void);
+// serve int 20h, 21h and 29h for a program with no DOS, false if none is
+// running
+bool dos_exec_int(const uint8_t num);
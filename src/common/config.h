@@ -85,6 +85,21 @@
 // emulate disk delay
 #define USE_DISK_DELAY    1
 
+// open raw disk images through a memory mapping
+#define USE_DISK_MMAP     1
+
+// run disk requests on an io thread while the guest waits
+#define USE_DISK_ASYNC    1
+
+// default size in KB of the block cache of each drive, 0 disables it
+#define DISK_CACHE_KB     4096
+
 #define USE_CPU_REDUX     1
 
+// use SSE2/NEON code paths where the compiler supports them
+#define USE_SIMD          1
+
+// rasterise and present frames on a separate thread
+#define USE_RENDER_THREAD 1
+
 #define VERBOSE           0
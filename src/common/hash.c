@@ -0,0 +1,81 @@
+/*
+  Fake86: A portable, open-source 8086 PC emulator.
+  Copyright (C)2010-2013 Mike Chambers
+               2019      Aidan Dodds
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+  USA.
+*/
+
+// fast non cryptographic 64 bit hashing
+//
+// input is consumed eight bytes at a time with a multiply and rotate per
+// word and two independent lanes so the multiplies overlap. the result goes
+// through the splitmix64 finaliser so every input bit affects every output
+// bit.
+
+#include "common.h"
+
+
+#define K0 0x9e3779b97f4a7c15ull
+#define K1 0xc2b2ae3d27d4eb4full
+
+static inline uint64_t _rotl(const uint64_t v, const uint32_t n) {
+  return (v << n) | (v >> (64 - n));
+}
+
+static inline uint64_t _round(const uint64_t h, const uint64_t w) {
+  return _rotl(h ^ (w * K1), 31) * K0;
+}
+
+static inline uint64_t _load(const uint8_t *p) {
+  uint64_t w;
+  memcpy(&w, p, sizeof(w));
+  return w;
+}
+
+uint64_t hash64_mix(uint64_t h) {
+  h ^= h >> 30;
+  h *= 0xbf58476d1ce4e5b9ull;
+  h ^= h >> 27;
+  h *= 0x94d049bb133111ebull;
+  h ^= h >> 31;
+  return h;
+}
+
+uint64_t hash64(const void *data, const size_t size, const uint64_t seed) {
+  const uint8_t *p = (const uint8_t*)data;
+  uint64_t a = seed ^ K0;
+  uint64_t b = seed + K1;
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    a = _round(a, _load(p + i));
+    b = _round(b, _load(p + i + 8));
+  }
+  for (; i + 8 <= size; i += 8) {
+    a = _round(a, _load(p + i));
+  }
+  // trailing bytes
+  uint64_t tail = 0;
+  for (uint32_t s = 0; i < size; ++i, s += 8) {
+    tail |= (uint64_t)p[i] << s;
+  }
+  b = _round(b, tail);
+  return hash64_mix(a ^ _rotl(b, 17) ^ (uint64_t)size);
+}
+
+uint64_t hash64_combine(const uint64_t h, const uint64_t v) {
+  return hash64_mix(_round(h, v));
+}
@@ -0,0 +1,188 @@
+/*
+  Fake86: A portable, open-source 8086 PC emulator.
+  Copyright (C)2010-2013 Mike Chambers
+               2019      Aidan Dodds
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+  USA.
+*/
+
+// small byte oriented lz77 codec
+//
+// the output is a list of sequences, each a token byte followed by its
+// literals and a match:
+//   token    literal count in the high nibble, match length - 4 in the low
+//   ...      literal count - 15 in bytes of 255 and a remainder, if 15
+//   literals
+//   offset   16 bit little endian distance back to the match
+//   ...      match length - 19 as above, if the nibble is 15
+// the last sequence has literals only. matches are found through a hash of
+// the next four bytes, decoding is copies only so it runs near memcpy speed.
+
+#include "common.h"
+
+
+#define HASH_BITS 12
+#define MATCH_MIN 4
+#define OFFSET_MAX 0xffff
+
+static inline uint32_t _load(const uint8_t *p) {
+  uint32_t w;
+  memcpy(&w, p, sizeof(w));
+  return w;
+}
+
+static inline uint32_t _hash(const uint32_t v) {
+  return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// write a length continuation, false if it does not fit
+static bool _put_len(uint8_t **op, const uint8_t *end, uint32_t len) {
+  for (; len >= 255; len -= 255) {
+    if (*op >= end) {
+      return false;
+    }
+    *(*op)++ = 255;
+  }
+  if (*op >= end) {
+    return false;
+  }
+  *(*op)++ = (uint8_t)len;
+  return true;
+}
+
+static bool _put_seq(uint8_t **op, const uint8_t *end, const uint8_t *lit,
+                     const uint32_t lit_len, const uint32_t offset,
+                     const uint32_t match_len) {
+  if (*op >= end) {
+    return false;
+  }
+  const uint32_t ml = match_len ? (match_len - MATCH_MIN) : 0;
+  uint8_t *token = (*op)++;
+  *token = (uint8_t)((SDL_min(lit_len, 15) << 4) | SDL_min(ml, 15));
+  if (lit_len >= 15 && !_put_len(op, end, lit_len - 15)) {
+    return false;
+  }
+  if (lit_len > (uint32_t)(end - *op)) {
+    return false;
+  }
+  memcpy(*op, lit, lit_len);
+  *op += lit_len;
+  if (!match_len) {
+    return true;
+  }
+  if (end - *op < 2) {
+    return false;
+  }
+  *(*op)++ = (uint8_t)offset;
+  *(*op)++ = (uint8_t)(offset >> 8);
+  return (ml < 15) || _put_len(op, end, ml - 15);
+}
+
+uint32_t lz_compress(const uint8_t *src, const uint32_t size, uint8_t *dst,
+                     const uint32_t cap) {
+  uint32_t table[1 << HASH_BITS];
+  memset(table, 0, sizeof(table));
+  uint8_t *op = dst;
+  const uint8_t *end = dst + cap;
+  uint32_t anchor = 0, ip = 0;
+  while (ip + MATCH_MIN <= size) {
+    const uint32_t word = _load(src + ip);
+    const uint32_t h = _hash(word);
+    const uint32_t ref = table[h];
+    table[h] = ip;
+    if (ref >= ip || ip - ref > OFFSET_MAX || _load(src + ref) != word) {
+      ++ip;
+      continue;
+    }
+    uint32_t len = MATCH_MIN;
+    while (ip + len < size && src[ref + len] == src[ip + len]) {
+      ++len;
+    }
+    if (!_put_seq(&op, end, src + anchor, ip - anchor, ip - ref, len)) {
+      return 0;
+    }
+    ip += len;
+    anchor = ip;
+  }
+  if (!_put_seq(&op, end, src + anchor, size - anchor, 0, 0)) {
+    return 0;
+  }
+  return (uint32_t)(op - dst);
+}
+
+// read a length continuation, false if the input ends first
+static bool _get_len(const uint8_t *src, const uint32_t size, uint32_t *ip,
+                     uint32_t *len) {
+  uint8_t b;
+  do {
+    if (*ip >= size) {
+      return false;
+    }
+    b = src[(*ip)++];
+    *len += b;
+  } while (b == 255);
+  return true;
+}
+
+bool lz_decompress(const uint8_t *src, const uint32_t size, uint8_t *dst,
+                   const uint32_t out_size) {
+  uint32_t ip = 0, op = 0;
+  for (;;) {
+    // the stream ends on a literal only sequence, not mid way or on a match
+    if (ip >= size) {
+      return false;
+    }
+    const uint8_t token = src[ip++];
+    uint32_t lit = token >> 4;
+    if (lit == 15 && !_get_len(src, size, &ip, &lit)) {
+      return false;
+    }
+    if (lit > size - ip || lit > out_size - op) {
+      return false;
+    }
+    memcpy(dst + op, src + ip, lit);
+    ip += lit;
+    op += lit;
+    if (ip == size) {
+      break;
+    }
+    if (size - ip < 2) {
+      return false;
+    }
+    const uint32_t offset = src[ip] | (src[ip + 1] << 8);
+    ip += 2;
+    uint32_t len = token & 15;
+    if (len == 15 && !_get_len(src, size, &ip, &len)) {
+      return false;
+    }
+    len += MATCH_MIN;
+    if (offset == 0 || offset > op || len > out_size - op) {
+      return false;
+    }
+    const uint8_t *from = dst + op - offset;
+    if (offset >= len) {
+      memcpy(dst + op, from, len);
+    }
+    else {
+      // overlapping, repeats the last `offset` bytes
+      for (uint32_t i = 0; i < len; ++i) {
+        dst[op + i] = from[i];
+      }
+    }
+    op += len;
+  }
+  return op == out_size;
+}
@@ -50,6 +50,8 @@ bool cpu_step = false;
 
 static uint64_t _cycles;
 static uint32_t _delay_cycles;
+// waiting on a disk request
+static bool _io_wait;
 
 uint64_t cpu_slice_ticks(void) {
   return _cycles;
@@ -113,6 +115,10 @@ static inline uint8_t _read_code_u8(void) {
   return out;
 }
 
+void cpu_io_wait(bool wait) {
+  _io_wait = wait;
+}
+
 void cpu_delay(uint32_t cycles) {
 #if USE_DISK_DELAY
   _delay_cycles += cycles;
@@ -650,6 +656,7 @@ void cpu_reset() {
   cpu_regs.ip = 0x0000;
   in_hlt_state = false;
   _delay_cycles = 0;
+  _io_wait = false;
 }
 
 static uint16_t readrm16(uint8_t rmval) {
@@ -1317,6 +1324,65 @@ static void _on_illegal_instruction(void) {
 #endif
 }
 
+// number of rep string iterations which can be done as one run
+static uint32_t _rep_run(const uint32_t size, const int32_t target,
+                         const bool uses_si) {
+  // keep it simple and only go forwards
+  if (cpu_flags.df) {
+    return 0;
+  }
+  uint32_t count = cpu_regs.cx;
+  // dont let the offsets wrap within the segment
+  count = SDL_min(count, (0x10000 - cpu_regs.di) / size);
+  if (uses_si) {
+    count = SDL_min(count, (0x10000 - cpu_regs.si) / size);
+  }
+  // one cycle per iteration so stay within this time slice
+  const int64_t left = (int64_t)target - (int64_t)_cycles;
+  count = (uint32_t)SDL_min((int64_t)count, SDL_max(left, 1));
+  return count;
+}
+
+// rep stosb/stosw as a single fill
+static bool _rep_stos(const uint32_t size, const int32_t target) {
+  if (!_cpu_io.mem_fill) {
+    return false;
+  }
+  const uint32_t count = _rep_run(size, target, false);
+  if (count == 0) {
+    return false;
+  }
+  const uint32_t addr = segbase(cpu_regs.es) + cpu_regs.di;
+  if (!_cpu_io.mem_fill(addr, cpu_regs.ax, count, size)) {
+    return false;
+  }
+  cpu_regs.di += count * size;
+  cpu_regs.cx -= count;
+  _cycles += count;
+  return true;
+}
+
+// rep movsb/movsw as a single move
+static bool _rep_movs(const uint32_t size, const int32_t target) {
+  if (!_cpu_io.mem_move) {
+    return false;
+  }
+  const uint32_t count = _rep_run(size, target, true);
+  if (count == 0) {
+    return false;
+  }
+  const uint32_t dst = segbase(cpu_regs.es) + cpu_regs.di;
+  const uint32_t src = segbase(useseg) + cpu_regs.si;
+  if (!_cpu_io.mem_move(dst, src, count, size)) {
+    return false;
+  }
+  cpu_regs.si += count * size;
+  cpu_regs.di += count * size;
+  cpu_regs.cx -= count;
+  _cycles += count;
+  return true;
+}
+
 // cycles is target cycles
 // return executed cycles
 int32_t cpu_exec86(int32_t target) {
@@ -1336,6 +1402,12 @@ int32_t cpu_exec86(int32_t target) {
       break;
     }
 
+    // no instructions or interrupts until the disk request completes
+    if (_io_wait) {
+      _cycles = target;
+      break;
+    }
+
 #if 0
     const uint32_t eip = (cpu_regs.cs << 4) + cpu_regs.ip;
     if (false && eip == 0x96b1 && !cpu_halt) {
@@ -2717,6 +2789,12 @@ int32_t cpu_exec86(int32_t target) {
         break;
       }
 
+      // hand the whole run to the memory system if possible
+      if (reptype && _rep_movs(1, target)) {
+        cpu_regs.ip = firstip;
+        break;
+      }
+
       putmem8(cpu_regs.es, cpu_regs.di,
               getmem8(useseg, cpu_regs.si));
       if (cpu_flags.df) {
@@ -2744,6 +2822,12 @@ int32_t cpu_exec86(int32_t target) {
         break;
       }
 
+      // hand the whole run to the memory system if possible
+      if (reptype && _rep_movs(2, target)) {
+        cpu_regs.ip = firstip;
+        break;
+      }
+
       putmem16(cpu_regs.es, cpu_regs.di,
                getmem16(useseg, cpu_regs.si));
       if (cpu_flags.df) {
@@ -2853,6 +2937,12 @@ int32_t cpu_exec86(int32_t target) {
         break;
       }
 
+      // hand the whole run to the memory system if possible
+      if (reptype && _rep_stos(1, target)) {
+        cpu_regs.ip = firstip;
+        break;
+      }
+
       putmem8(cpu_regs.es, cpu_regs.di, cpu_regs.al);
       if (cpu_flags.df) {
         cpu_regs.di = cpu_regs.di - 1;
@@ -2877,6 +2967,12 @@ int32_t cpu_exec86(int32_t target) {
         break;
       }
 
+      // hand the whole run to the memory system if possible
+      if (reptype && _rep_stos(2, target)) {
+        cpu_regs.ip = firstip;
+        break;
+      }
+
       putmem16(cpu_regs.es, cpu_regs.di, cpu_regs.ax);
       if (cpu_flags.df) {
         cpu_regs.di = cpu_regs.di - 2;
@@ -57,6 +57,9 @@ uint64_t cpu_slice_ticks(void);
 
 bool cpu_in_hlt_state(void);
 
+// stall the cpu until a disk request completes, cycles still pass
+void cpu_io_wait(bool wait);
+
 typedef void (*cpu_intcall_t)(const uint16_t int_num);
 void cpu_set_intcall_handler(cpu_intcall_t handler);
 
@@ -77,6 +80,7 @@ void cpu_delay(uint32_t cycles);
 // state save/load
 void cpu_state_save(FILE *fd);
 void cpu_state_load(FILE *fd);
+void cpu_dump_state(FILE *fd);
 
 extern bool cpu_halt;
 extern bool cpu_step;
@@ -95,6 +99,12 @@ struct cpu_io_t {
   void     (*port_write_8 )(uint16_t port, uint8_t  value);
   void     (*port_write_16)(uint16_t port, uint16_t value);
   void     (*int_call     )(uint16_t num);
+  // optional bulk handlers for rep stos/movs, may be NULL
+  // return false to have the cpu fall back to single element accesses
+  bool     (*mem_fill     )(uint32_t addr, uint16_t value,
+                            uint32_t count, uint32_t size);
+  bool     (*mem_move     )(uint32_t dst, uint32_t src,
+                            uint32_t count, uint32_t size);
 };
 
 void cpu_set_io(const struct cpu_io_t *io);
@@ -55,7 +55,7 @@ bool _eject(uint8_t num) {
   return true;
 }
 
-bool _seek(const uint8_t num, const uint32_t offset) {
+bool _seek(const uint8_t num, const uint64_t offset) {
   struct disk_info_t *disk = _get_disk(num);
   if (!disk) {
     return false;
@@ -80,7 +80,7 @@ bool _write(const uint8_t num, const uint8_t *src, const uint32_t count) {
   return disk->write(disk->self, src, count);
 }
 
-bool _tell(const uint8_t num, uint32_t *out) {
+bool _tell(const uint8_t num, uint64_t *out) {
   struct disk_info_t *disk = _get_disk(num);
   if (!disk) {
     return false;
@@ -88,12 +88,60 @@ bool _tell(const uint8_t num, uint32_t *out) {
   return disk->tell(disk->self, out);
 }
 
+bool _disk_open_image(const uint8_t num, const char *path, const bool shared,
+                      struct disk_info_t *out) {
+  const char *ext = strrchr(path, '.');
+  if (ext == NULL) {
+    return false;
+  }
+  if (strcmp(ext, ".img") == 0) {
+    // map the image where we can, else fall back to stdio
+    if (_disk_mmap_open(num, path, shared, out)) {
+      return true;
+    }
+    return _disk_img_open(num, path, shared, out);
+  }
+  if (strcmp(ext, ".vhd") == 0) {
+    return _disk_vhd_open(num, path, shared, out);
+  }
+  if (strcmp(ext, ".pack") == 0) {
+    return _disk_pack_open(num, path, out);
+  }
+  // TODO: raw drives
+  return false;
+}
+
 bool _open(const uint8_t num, const char *path) {
 
+  disk_async_wait();
   _eject(num);
 
+  // read only image, guest writes fail
+  bool shared = true;
+  if (strncmp(path, "ro:", 3) == 0) {
+    shared = false;
+    path += 3;
+  }
+
+  // host directory shown as a FAT volume
+  const bool is_dir = (strncmp(path, "dir:", 4) == 0);
+
+  // overlay on a base image, "overlay.cow=base.img" creates it if needed
+  char overlay[1024];
+  const char *base = is_dir ? NULL : strchr(path, '=');
+  if (base) {
+    const size_t len = base - path;
+    if (len >= sizeof(overlay)) {
+      return false;
+    }
+    memcpy(overlay, path, len);
+    overlay[len] = '\0';
+    path = overlay;
+    ++base;
+  }
+
   const char *ext = strrchr(path, '.');
-  if (ext == NULL) {
+  if (ext == NULL && !is_dir) {
     return false;
   }
 
@@ -110,25 +158,75 @@ bool _open(const uint8_t num, const char *path) {
 
   bool success = true;
 
-  if (strcmp(ext, ".img") == 0) {
-    success = _disk_img_open(num, path, disk);
+  if (is_dir) {
+    success = _disk_dir_open(num, path + 4, shared, disk);
   }
-  if (strcmp(ext, ".vhd") == 0) {
-    success = _disk_vhd_open(num, path, disk);
+  else if (strcmp(ext, ".cow") == 0) {
+    // an overlay exists to take writes, its base is already read only
+    if (!shared) {
+      log_printf(LOG_CHAN_DISK, "ro: can't be used with an overlay");
+      return false;
+    }
+    success = _disk_cow_open(num, path, base, disk);
+  }
+  else {
+    success = _disk_open_image(num, path, shared, disk);
   }
-  // TODO: raw drives
 
   if (!success) {
     _eject(num);
     return false;
   }
 
+  if (!_disk_cache_wrap(disk)) {
+    log_printf(LOG_CHAN_DISK, "unable to allocate cache for disk %02xh", num);
+  }
+
   fdcount += (num < 128);
   hdcount += (num > 127);
 
   return true;
 }
 
+void disk_flush(void) {
+  disk_async_wait();
+  for (int i = 0; i < NUM_DISKS; ++i) {
+    struct disk_info_t *d = _disk + i;
+    if (d->eject && d->flush) {
+      if (!d->flush(d->self)) {
+        log_printf(LOG_CHAN_DISK, "unable to flush disk %02xh", d->drive_num);
+      }
+    }
+  }
+}
+
+// write back cached blocks so the overlay behind the cache is current
+static struct disk_info_t *_overlay(const uint8_t num) {
+  disk_async_wait();
+  struct disk_info_t *d = _get_disk(num);
+  if (d && d->flush) {
+    d->flush(d->self);
+  }
+  return d;
+}
+
+bool disk_discard(uint8_t drivenum) {
+  struct disk_info_t *d = _overlay(drivenum);
+  const bool ok = _disk_cow_discard(_disk_cache_inner(d));
+  _disk_cache_invalidate(d);
+  return ok;
+}
+
+bool disk_commit(uint8_t drivenum) {
+  struct disk_info_t *d = _overlay(drivenum);
+  return _disk_cow_commit(_disk_cache_inner(d));
+}
+
+bool disk_snapshot(uint8_t drivenum, const char *path) {
+  struct disk_info_t *d = _overlay(drivenum);
+  return _disk_cow_snapshot(_disk_cache_inner(d), path);
+}
+
 bool disk_is_inserted(int num) {
   return _get_disk(num) != NULL;
 }
@@ -175,7 +273,12 @@ bool _geom_hard_disk(struct disk_info_t *d) {
   d->sector_size = 512;
   d->sects = 63;
   d->heads = 16;
-  d->cyls = d->size_bytes / (d->sects * d->heads * 512);
+  // past 1024 cylinders translate as a bios would so chs reaches further,
+  // the rest of the disk is only reached through the int 13h extensions
+  if (d->size_bytes / (d->sects * d->heads * 512) > 1024) {
+    d->heads = 255;
+  }
+  d->cyls = (uint32_t)(d->size_bytes / (d->sects * d->heads * 512));
   return true;
 }
 
@@ -184,6 +287,7 @@ bool disk_insert(uint8_t drivenum, const char *filename) {
 }
 
 void disk_eject(uint8_t drivenum) {
+  disk_async_wait();
 
   if (disk_is_inserted(drivenum)) {
     hdcount -= (drivenum >= 128);
@@ -195,7 +299,7 @@ void disk_eject(uint8_t drivenum) {
   }
 }
 
-static uint32_t _lba(const struct disk_info_t *d,
+static uint64_t _lba(const struct disk_info_t *d,
                      uint32_t c,
                      uint32_t s,
                      uint32_t h) {
@@ -204,103 +308,246 @@ static uint32_t _lba(const struct disk_info_t *d,
   const uint32_t spt = d->sects;
   const uint32_t offs = (c * hpc + h) * spt + (s - 1);
   // LBA to linear address
-  return offs * d->sector_size;
+  return (uint64_t)offs * d->sector_size;
 }
 
-static void _disk_read(uint8_t drivenum,
-                       uint32_t memdest,
-                       uint16_t cyl,
-                       uint16_t sect,
-                       uint16_t head,
-                       uint16_t sectcount) {
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- transfers
 
-  struct disk_info_t *d = _get_disk(drivenum);
-  assert(d);
-  uint8_t sectorbuffer[512];
+// largest transfer a single int 13h call can make
+#define XFER_MAX (255 * 512)
+
+// a guest memory range split into disk buffers
+//
+// plain memory is transferred in place, the vga window and rom are staged in
+// a bounce buffer and go through mem_write/mem_read.
+struct xfer_t {
+  struct disk_iov_t iov[DISK_IOV_MAX];
+  // guest address of each buffer if it is staged, else ~0u
+  uint32_t bounce[DISK_IOV_MAX];
+  uint32_t count;
+};
+
+static uint8_t _bounce[XFER_MAX];
 
-  cpu_regs.al = 0;
+// end of the memory region containing `addr`
+static uint32_t _region_end(const uint32_t addr, bool *direct) {
+  if (addr < 0xA0000) {
+    *direct = true;
+    return 0xA0000;
+  }
+  if (addr < 0xB0000) {
+    *direct = false;
+    return 0xB0000;
+  }
+  if (addr < 0xC0000) {
+    *direct = true;
+    return 0xC0000;
+  }
+  *direct = false;
+  return 0x100000;
+}
+
+static void _xfer_build(struct xfer_t *x, uint32_t addr, uint32_t size) {
+  assert(size <= XFER_MAX);
+  x->count = 0;
+  uint32_t staged = 0;
+  while (size) {
+    // addresses wrap at 1MB as on an 8086
+    addr &= 0xFFFFF;
+    bool direct = false;
+    const uint32_t part = SDL_min(size, _region_end(addr, &direct) - addr);
+    assert(x->count < DISK_IOV_MAX);
+    struct disk_iov_t *iov = x->iov + x->count;
+    if (direct) {
+      iov->base = RAM + addr;
+      x->bounce[x->count] = ~0u;
+    }
+    else {
+      iov->base = _bounce + staged;
+      x->bounce[x->count] = addr;
+      staged += part;
+    }
+    iov->size = part;
+    ++x->count;
+    addr += part;
+    size -= part;
+  }
+}
 
-  if (!sect) {
-    goto error;
+static bool _disk_readv(struct disk_info_t *d, const uint64_t offset,
+                        const struct xfer_t *x) {
+  if (d->readv) {
+    return d->readv(d->self, offset, x->iov, x->count);
   }
-  const uint32_t fileoffset = _lba(d, cyl, sect, head);
-  if (!_seek(drivenum, fileoffset)) {
-    goto error;
+  if (!d->seek(d->self, offset)) {
+    return false;
   }
-  // read sectors one by one
-  for (uint32_t j = 0; j < sectcount; ++j) {
-    // read sector to temp buffer
-    if (!_read(drivenum, sectorbuffer, 512)) {
-      cpu_regs.al = j;
-      goto error;
+  for (uint32_t i = 0; i < x->count; ++i) {
+    if (!d->read(d->self, x->iov[i].base, x->iov[i].size)) {
+      return false;
     }
-    // copy sect to memory
-    mem_write(memdest + j * 512, sectorbuffer, 512);
   }
-  cpu_flags.cf = 0;
-  cpu_regs.ah = 0;  // success
-  cpu_regs.al = sectcount & 0xff;
-  return;
-error:
-  // error
-  cpu_flags.cf = 1;
-  cpu_regs.ah = 1;  // bad command passed to driver
-  return;
+  return true;
 }
 
-static void _disk_write(uint8_t drivenum,
-                        uint16_t dstseg,
-                        uint16_t dstoff,
-                        uint16_t cyl,
-                        uint16_t sect,
-                        uint16_t head,
-                        uint16_t sectcount) {
+static bool _disk_writev(struct disk_info_t *d, const uint64_t offset,
+                         const struct xfer_t *x) {
+  if (d->writev) {
+    return d->writev(d->self, offset, x->iov, x->count);
+  }
+  if (!d->seek(d->self, offset)) {
+    return false;
+  }
+  for (uint32_t i = 0; i < x->count; ++i) {
+    if (!d->write(d->self, x->iov[i].base, x->iov[i].size)) {
+      return false;
+    }
+  }
+  return true;
+}
 
-  struct disk_info_t *d = _get_disk(drivenum);
-  assert(d);
-  uint8_t sectorbuffer[512];
+// true if the sectors lie within the disk
+static bool _in_range(const struct disk_info_t *d, const uint64_t offset,
+                      const uint32_t size) {
+  return offset <= d->size_bytes && size <= d->size_bytes - offset;
+}
 
-  uint32_t memdest, cursect, sectoffset;
-  if (!sect) {
-    goto error;
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- requests
+
+// an int 13h read or write, the guest has at most one in flight
+struct disk_req_t {
+  struct disk_info_t *disk;
+  uint64_t offset;
+  struct xfer_t x;
+  uint8_t drive_num;
+  uint8_t sectcount;
+  bool write;
+  // guest address of the disk address packet of an extended call, else 0
+  uint32_t packet;
+};
+
+static struct disk_req_t _req;
+// the cpu is waiting for _req to complete
+static bool _pending;
+
+// runs on the io thread if there is one
+static bool _req_work(void *user) {
+  struct disk_req_t *r = (struct disk_req_t*)user;
+  if (r->write) {
+    return _disk_writev(r->disk, r->offset, &r->x);
+  }
+  return _disk_readv(r->disk, r->offset, &r->x);
+}
+
+// set the result registers and bios status of a read or write call
+static void _finish(const bool write, const bool ok, const uint8_t count) {
+  cpu_flags.cf = ok ? 0 : 1;
+  cpu_regs.ah = ok ? 0 : 1;  // 1 = bad command passed to driver
+  if (write) {
+    cpu_regs.al = ok ? count : 1;
+    RAM[0x441] |= cpu_flags.cf;
   }
-#if 0
-  uint32_t lba = ((uint32_t)cyl * (uint32_t)d->heads + (uint32_t)head) *
-                  (uint32_t)d->sects + (uint32_t)sect - 1;
-  uint32_t fileoffset = lba * 512;
-#else
-  uint32_t fileoffset = _lba(d, cyl, sect, head);
-#endif
-#if 0
-  uint32_t fileend = fileoffset + sectcount * 512;
-  if (fileend > d->size_bytes) {
-    goto error;
+  else {
+    cpu_regs.al = ok ? count : 0;
+    RAM[0x441] &= ~0x01;
+    RAM[0x441] |= cpu_flags.cf;
   }
-#endif
-  _seek(drivenum, fileoffset);
-  memdest = ((uint32_t)dstseg << 4) + (uint32_t)dstoff;
-  for (cursect = 0; cursect < sectcount; cursect++) {
-    for (sectoffset = 0; sectoffset < 512; sectoffset++) {
-      sectorbuffer[sectoffset] = read86(memdest++);
+}
+
+// keep the status of a completed call for the get status function
+static void _int_status(const uint8_t drive_num) {
+  struct disk_info_t *disk = _get_disk(drive_num);
+  if (disk) {
+    disk->last_ah = cpu_regs.ah;
+    disk->last_cf = cpu_flags.cf;
+  }
+  const bool is_hdd = (drive_num >= 0x80);
+  if (is_hdd) {
+    // bios data area write
+    // set status of last hard disk operation
+    write86(0x474, cpu_regs.ah);
+  }
+}
+
+// runs on the emulation thread
+static void _req_done(bool ok, void *user) {
+  struct disk_req_t *r = (struct disk_req_t*)user;
+  if (ok && !r->write) {
+    const struct xfer_t *x = &r->x;
+    for (uint32_t i = 0; i < x->count; ++i) {
+      if (x->bounce[i] != ~0u) {
+        mem_write(x->bounce[i], x->iov[i].base, x->iov[i].size);
+      }
     }
-    if (!_write(drivenum, sectorbuffer, 512)) {
-      goto error;
+  }
+  _finish(r->write, ok, r->sectcount);
+  if (!ok && r->packet) {
+    // no blocks transferred
+    writew86(r->packet + 2, 0);
+  }
+  if (_pending) {
+    // the int 13h call returns now
+    _pending = false;
+    _int_status(r->drive_num);
+    cpu_io_wait(false);
+  }
+}
+
+static void _req_submit(void) {
+  _pending = disk_async_submit(_req_work, _req_done, &_req);
+  if (_pending) {
+    // the guest waits in emulated time until _req_done
+    cpu_io_wait(true);
+  }
+}
+
+// queue a read of `count` sectors at `offset` into guest memory, `packet`
+// is the disk address packet of an extended read or 0
+static void _disk_read(struct disk_info_t *d, uint32_t memdest,
+                       uint64_t offset, uint32_t count, uint32_t packet) {
+  const uint32_t size = count * 512;
+  if (!_in_range(d, offset, size)) {
+    _finish(false, false, 0);
+    return;
+  }
+  // all sectors in one request straight into guest memory
+  _req.disk = d;
+  _req.offset = offset;
+  _req.drive_num = d->drive_num;
+  _req.sectcount = (uint8_t)count;
+  _req.write = false;
+  _req.packet = packet;
+  _xfer_build(&_req.x, memdest, size);
+  _req_submit();
+}
+
+// queue a write of `count` sectors at `offset` from guest memory
+static void _disk_write(struct disk_info_t *d, uint32_t memsrc,
+                        uint64_t offset, uint32_t count, uint32_t packet) {
+  const uint32_t size = count * 512;
+  if (!_in_range(d, offset, size)) {
+    _finish(true, false, 0);
+    return;
+  }
+  _req.disk = d;
+  _req.offset = offset;
+  _req.drive_num = d->drive_num;
+  _req.sectcount = (uint8_t)count;
+  _req.write = true;
+  _req.packet = packet;
+  struct xfer_t *x = &_req.x;
+  _xfer_build(x, memsrc, size);
+  for (uint32_t i = 0; i < x->count; ++i) {
+    if (x->bounce[i] != ~0u) {
+      mem_read(x->iov[i].base, x->bounce[i], x->iov[i].size);
     }
   }
-  cpu_regs.al = (uint8_t)sectcount;
-  cpu_flags.cf = 0;
-  cpu_regs.ah = 0;
-  return;
-error:
-  // error
-  cpu_regs.al = 1;  // bad command passed to driver
-  cpu_flags.cf = 1;
-  RAM[0x441] |= 0x01;
-  return;
+  _req_submit();
 }
 
 static void _disk_reset(void) {
-  // useless function in an emulator. say success and return.
+  // a good point to make sure guest writes have reached the images
+  disk_flush();
   cpu_regs.ah = 0;
   cpu_flags.cf = 0;
 }
@@ -320,8 +567,9 @@ static void _disk_return_status(void) {
 static void _disk_read_sect(void) {
 
   const uint8_t drive_num = cpu_regs.dl;
+  struct disk_info_t *disk = _get_disk(drive_num);
 
-  if (disk_is_inserted(drive_num)) {
+  if (disk) {
 
     const uint32_t dst = CPU_ADDR(cpu_regs.es, cpu_regs.bx);
 
@@ -331,31 +579,36 @@ static void _disk_read_sect(void) {
 
     const uint32_t count = cpu_regs.al;
 
-    _disk_read(cpu_regs.dl, dst, cyln, sect, head, count);
+    if (!sect) {
+      _finish(false, false, 0);
+      return;
+    }
+    _disk_read(disk, dst, _lba(disk, cyln, sect, head), count, 0);
 
   } else {
     cpu_flags.cf = 1;
     cpu_regs.ah = 1;
+    RAM[0x441] |= 0x01;
   }
-
-  RAM[0x441] &= ~0x01;
-  RAM[0x441] |= cpu_flags.cf;
 }
 
 static void _disk_write_sect(void) {
 
   const uint8_t drive_num = cpu_regs.dl;
+  struct disk_info_t *disk = _get_disk(drive_num);
 
-  if (disk_is_inserted(drive_num)) {
-    _disk_write(cpu_regs.dl,
-                cpu_regs.es,
-                cpu_regs.bx,
-                cpu_regs.ch + (cpu_regs.cl / 64) * 256,
-                cpu_regs.cl & 63,
-                cpu_regs.dh,
-                cpu_regs.al);
-    cpu_flags.cf = 0;
-    cpu_regs.ah = 0;
+  if (disk) {
+    const uint32_t src = ((uint32_t)cpu_regs.es << 4) + cpu_regs.bx;
+
+    const uint32_t cyln = cpu_regs.ch + (cpu_regs.cl / 64) * 256;
+    const uint32_t sect = cpu_regs.cl & 63;
+    const uint32_t head = cpu_regs.dh;
+
+    if (!sect) {
+      _finish(true, false, 0);
+      return;
+    }
+    _disk_write(disk, src, _lba(disk, cyln, sect, head), cpu_regs.al, 0);
   } else {
     cpu_flags.cf = 1;
     cpu_regs.ah = 1;
@@ -373,9 +626,11 @@ static void _disk_get_params(void) {
   struct disk_info_t *disk = _get_disk(drive_num);
 
   if (disk) {
-    cpu_regs.ch = disk->cyls - 1;
+    // chs reaches 1024 cylinders, the extensions reach the rest
+    const uint32_t max_cyl = SDL_min(disk->cyls, 1024) - 1;
+    cpu_regs.ch = max_cyl & 0xff;
     cpu_regs.cl = disk->sects & 63;
-    cpu_regs.cl = cpu_regs.cl + (disk->cyls / 256) * 64;
+    cpu_regs.cl = cpu_regs.cl + (max_cyl / 256) * 64;
     cpu_regs.dh = disk->heads - 1;
     if (cpu_regs.dl < 0x80) {
       cpu_regs.bl = 4;
@@ -409,12 +664,132 @@ static void _disk_dasd_type(void) {
     cpu_regs.ah = 1;
   }
   else {
+    // number of 512 byte sectors in CX:DX
+    const uint64_t sects = disk->size_bytes / 512;
+    const uint32_t count = (uint32_t)SDL_min(sects, 0xffffffffull);
     cpu_regs.ah = 3;
-    cpu_regs.dx = disk->sects & 0xffff;
-    cpu_regs.cx = disk->sects >> 16;
+    cpu_regs.dx = count & 0xffff;
+    cpu_regs.cx = count >> 16;
   }
 }
 
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- extensions
+
+// the enhanced disk drive (EDD 1.1) functions address sectors by a 64 bit
+// LBA held in a disk address packet at DS:SI:
+//   +0  byte   packet size, 10h
+//   +1  byte   reserved
+//   +2  word   sectors to transfer, set to the number transferred
+//   +4  dword  buffer segment:offset
+//   +8  qword  starting sector
+// only the fixed disk access subset (42h-44h, 47h, 48h) is provided.
+
+// largest transfer in one extended call
+#define EDD_XFER_MAX 127
+
+// extended calls report errors as invalid function or parameter
+static void _edd_fail(void) {
+  cpu_flags.cf = 1;
+  cpu_regs.ah = 1;
+}
+
+static struct disk_info_t *_edd_disk(void) {
+  // extensions are for fixed disks only
+  if (cpu_regs.dl < 0x80) {
+    return NULL;
+  }
+  return _get_disk(cpu_regs.dl);
+}
+
+static uint64_t _read_qword(const uint32_t addr) {
+  uint64_t out = 0;
+  for (uint32_t i = 0; i < 8; ++i) {
+    out |= (uint64_t)read86(addr + i) << (i * 8);
+  }
+  return out;
+}
+
+static void _write_dword(const uint32_t addr, const uint32_t value) {
+  writew86(addr + 0, value & 0xffff);
+  writew86(addr + 2, value >> 16);
+}
+
+// installation check
+static void _edd_check(void) {
+  if (cpu_regs.bx != 0x55AA || !_edd_disk()) {
+    _edd_fail();
+    return;
+  }
+  cpu_flags.cf = 0;
+  cpu_regs.ah = 0x21;    // EDD 1.1
+  cpu_regs.bx = 0xAA55;
+  cpu_regs.cx = 0x0001;  // fixed disk access subset
+}
+
+// extended read, write and verify
+static void _edd_xfer(const uint8_t func) {
+  struct disk_info_t *disk = _edd_disk();
+  const uint32_t packet = CPU_ADDR(cpu_regs.ds, cpu_regs.si);
+  if (!disk || read86(packet) < 0x10) {
+    _edd_fail();
+    return;
+  }
+  const uint32_t count = readw86(packet + 2);
+  const uint32_t buffer = CPU_ADDR(readw86(packet + 6), readw86(packet + 4));
+  const uint64_t lba = _read_qword(packet + 8);
+  const uint64_t last = disk->size_bytes / 512;
+  if (count > EDD_XFER_MAX || lba > last || count > last - lba) {
+    writew86(packet + 2, 0);
+    _edd_fail();
+    return;
+  }
+  switch (func) {
+  case 0x42:
+    _disk_read(disk, buffer, lba * 512, count, packet);
+    break;
+  case 0x43:
+    _disk_write(disk, buffer, lba * 512, count, packet);
+    break;
+  default:
+    // verify, the sectors are known to be there
+    cpu_flags.cf = 0;
+    cpu_regs.ah = 0;
+  }
+}
+
+// extended seek
+static void _edd_seek(void) {
+  struct disk_info_t *disk = _edd_disk();
+  const uint32_t packet = CPU_ADDR(cpu_regs.ds, cpu_regs.si);
+  if (!disk || _read_qword(packet + 8) >= disk->size_bytes / 512) {
+    _edd_fail();
+    return;
+  }
+  cpu_flags.cf = 0;
+  cpu_regs.ah = 0;
+}
+
+// get drive parameters into the result buffer at DS:SI
+static void _edd_get_params(void) {
+  struct disk_info_t *disk = _edd_disk();
+  const uint32_t buf = CPU_ADDR(cpu_regs.ds, cpu_regs.si);
+  if (!disk || readw86(buf) < 0x1A) {
+    _edd_fail();
+    return;
+  }
+  const uint64_t sects = disk->size_bytes / 512;
+  writew86(buf + 0x00, 0x1A);
+  writew86(buf + 0x02, 0x0002);  // chs information is valid
+  _write_dword(buf + 0x04, disk->cyls);
+  _write_dword(buf + 0x08, disk->heads);
+  _write_dword(buf + 0x0C, disk->sects);
+  _write_dword(buf + 0x10, (uint32_t)sects);
+  _write_dword(buf + 0x14, (uint32_t)(sects >> 32));
+  writew86(buf + 0x18, 512);
+  cpu_flags.cf = 0;
+  cpu_regs.ah = 0;
+}
+
 // BIOS disk services
 void disk_int_handler(int intnum) {
 
@@ -422,7 +797,6 @@ void disk_int_handler(int intnum) {
   RAM[0x441] = 0;
 
   const uint8_t drive_num = cpu_regs.dl;
-  struct disk_info_t *disk = _get_disk(drive_num);
 
   switch (cpu_regs.ah) {
   case 0: // reset disk system
@@ -447,21 +821,32 @@ void disk_int_handler(int intnum) {
   case 0x15: // read dasd type
     _disk_dasd_type();
     break;
+  case 0x41: // extensions installation check
+    _edd_check();
+    break;
+  case 0x42: // extended read
+  case 0x43: // extended write
+  case 0x44: // extended verify
+    _edd_xfer(cpu_regs.ah);
+    break;
+  case 0x45: // lock and unlock drive
+  case 0x46: // eject media
+    // removable drive control is not provided
+    _edd_fail();
+    break;
+  case 0x47: // extended seek
+    _edd_seek();
+    break;
+  case 0x48: // extended get drive parameters
+    _edd_get_params();
+    break;
   default:
     cpu_flags.cf = 1;
   }
 
-  // store for get status call
-  if (disk) {
-    disk->last_ah = cpu_regs.ah;
-    disk->last_cf = cpu_flags.cf;
-  }
-
-  const bool is_hdd = (drive_num >= 0x80);
-  if (is_hdd) {
-    // bios data area write
-    // set status of last hard disk operation
-    write86(0x474, cpu_regs.ah);
+  // the status is stored once a request in flight completes
+  if (!_pending) {
+    _int_status(drive_num);
   }
 }
 
@@ -510,6 +895,11 @@ static bool _do_load_com(void) {
 
 void disk_bootstrap(int intnum) {
 
+  // run a DOS program without booting DOS, or stop if it won't load
+  if (dos_exec_boot()) {
+    return;
+  }
+
   // boot a COM file if we should
   if (_com_path) {
     if (_do_load_com()) {
@@ -535,7 +925,7 @@ void disk_bootstrap(int intnum) {
       // read first sector of boot drive into 07C0:0000 and execute it
       log_printf(LOG_CHAN_DISK, "booting from disk %d", bootdrive);
       cpu_regs.dl = bootdrive;
-      _disk_read(cpu_regs.dl, 0x07C00, 0, 1, 0, 1);
+      _disk_read(_get_disk(bootdrive), 0x07C00, 0, 1, 0);
       cpu_regs.cs = 0x0000;
       cpu_regs.ip = 0x7C00;
     }
@@ -25,13 +25,30 @@
 #include "../common/common.h"
 
 
+// one buffer of a vectored transfer
+struct disk_iov_t {
+  uint8_t *base;
+  uint32_t size;
+};
+
+// most buffers a transfer is split into
+#define DISK_IOV_MAX 8
+
 struct disk_info_t {
   // delegates
   bool (*eject)(void *self);
-  bool (*seek)(void *self, const uint32_t offset);
+  bool (*seek)(void *self, const uint64_t offset);
   bool (*read)(void *self, uint8_t *dst, const uint32_t count);
   bool (*write)(void *self, const uint8_t *src, const uint32_t count);
-  bool (*tell)(void *self, uint32_t *out);
+  bool (*tell)(void *self, uint64_t *out);
+  // transfer consecutive bytes from `offset` through a list of buffers in
+  // one request, optional, seek and read/write are used when NULL
+  bool (*readv)(void *self, const uint64_t offset,
+                const struct disk_iov_t *iov, const uint32_t count);
+  bool (*writev)(void *self, const uint64_t offset,
+                 const struct disk_iov_t *iov, const uint32_t count);
+  // write any buffered changes through to the image, optional
+  bool (*flush)(void *self);
 
   // drive instance
   void *self;
@@ -46,10 +63,16 @@ struct disk_info_t {
   uint32_t heads;
 
   // raw size in bytes
-  uint32_t size_bytes;
+  uint64_t size_bytes;
 
   // disk status
   uint8_t last_ah, last_cf;
+
+  // backend is as fast as memory or keeps its own cache, no block cache is
+  // put in front of it
+  bool in_memory;
+  // every write fails, so the block cache must not accept any
+  bool read_only;
 };
 
 
@@ -57,12 +80,97 @@ void disk_int_handler(int intnum);
 
 void disk_load_com(const char *path);
 
+// a stdio image, opened read only without `shared`
 bool _disk_img_open(
-  const uint8_t num, const char *path, struct disk_info_t *out);
+  const uint8_t num, const char *path, const bool shared,
+  struct disk_info_t *out);
+
+// stdio positioning past 2GB, see disk_file.c
+bool _disk_fseek(FILE *fd, const uint64_t offset);
+bool _disk_fsize(FILE *fd, uint64_t *out);
 
+// map a raw image, `shared` writes back to it, otherwise it is read only and
+// guest writes fail. on failure `out` is left cleared.
+bool _disk_mmap_open(
+  const uint8_t num, const char *path, const bool shared,
+  struct disk_info_t *out);
+
+// a VHD opened without `shared` is read only and guest writes fail
 bool _disk_vhd_open(
+  const uint8_t num, const char *path, const bool shared,
+  struct disk_info_t *out);
+
+// present a host directory as a FAT volume, guest writes go to the host
+// with `shared` and fail without it
+bool _disk_dir_open(
+  const uint8_t num, const char *path, const bool shared,
+  struct disk_info_t *out);
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- packed images
+
+// compressed read only images, blocks are compressed on their own and found
+// through an index which follows the header
+#define PACK_MAGIC "fake86pk"
+#define PACK_VERSION 2
+#define PACK_BLOCK (32 * 1024)
+
+struct pack_header_t {
+  char magic[8];
+  uint32_t version;
+  uint32_t block_size;
+  uint32_t blocks;
+  uint32_t reserved;
+  // raw image size in bytes
+  uint64_t size;
+};
+
+struct pack_index_t {
+  uint64_t offset;
+  // 0 for a zero filled block, block_size if stored uncompressed
+  uint32_t length;
+  uint32_t reserved;
+};
+
+bool _disk_pack_open(
   const uint8_t num, const char *path, struct disk_info_t *out);
 
+// convert between raw and packed images, see pack.c
+bool pack_image(const char *raw_path, const char *pack_path);
+bool unpack_image(const char *pack_path, const char *raw_path);
+
+// open `path` as an overlay on `base`, creating it when it does not exist,
+// a NULL `base` uses the one recorded in the overlay
+bool _disk_cow_open(
+  const uint8_t num, const char *path, const char *base,
+  struct disk_info_t *out);
+// drop all blocks held in an overlay
+bool _disk_cow_discard(struct disk_info_t *d);
+// write the blocks of an overlay into its base image then discard them
+bool _disk_cow_commit(struct disk_info_t *d);
+// copy an overlay to `path` as a new overlay on the same base
+bool _disk_cow_snapshot(struct disk_info_t *d, const char *path);
+
+// put a block cache in front of an opened drive, see disk_cache.c
+bool _disk_cache_wrap(struct disk_info_t *d);
+// the drive behind a cache, or `d` if it has none
+struct disk_info_t *_disk_cache_inner(struct disk_info_t *d);
+// drop all cached blocks without writing them back
+void _disk_cache_invalidate(struct disk_info_t *d);
+// lock the cache stats against the io thread while it runs
+bool _disk_cache_lock_init(void);
+void _disk_cache_lock_close(void);
+
+// run `work` on the io thread then `done` from disk_async_tick, returns
+// false if both already ran as there is no io thread, see disk_async.c
+bool disk_async_submit(bool (*work)(void *user),
+                       void (*done)(bool ok, void *user), void *user);
+// complete any request in flight
+void disk_async_wait(void);
+
+// open an image by its extension, without `shared` it is never written to
+bool _disk_open_image(const uint8_t num, const char *path, const bool shared,
+                      struct disk_info_t *out);
+
 
 bool _geom_hard_disk(struct disk_info_t *d);
 bool _geom_floppy_disk(struct disk_info_t *d);
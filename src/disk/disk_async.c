@@ -0,0 +1,163 @@
+/*
+  Fake86: A portable, open-source 8086 PC emulator.
+  Copyright (C)2010-2013 Mike Chambers
+               2019      Aidan Dodds
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+  USA.
+*/
+
+// disk requests run off the emulation thread
+//
+// a request is handed to an io thread while the cpu waits in emulated time,
+// so a slow host disk does not hold up rendering and audio. the guest only
+// ever has one request outstanding. its completion is delivered on the
+// emulation thread from disk_async_tick, which is called with the other
+// hardware ticks.
+//
+// when the io thread is not running, requests complete inside the submit
+// call, as in headless runs where emulated time must not depend on the host.
+
+#include "disk.h"
+
+
+enum {
+  ASYNC_IDLE,
+  ASYNC_QUEUED,
+  ASYNC_DONE,
+};
+
+struct async_req_t {
+  bool (*work)(void *user);
+  void (*done)(bool ok, void *user);
+  void *user;
+  bool ok;
+};
+
+static struct async_req_t _req;
+// guarded by _mux
+static int _state;
+static bool _quit;
+
+static SDL_Thread *_thread;
+static SDL_mutex *_mux;
+static SDL_cond *_cond;
+
+static int _io_thread(void *arg) {
+  (void)arg;
+  SDL_mutexP(_mux);
+  for (;;) {
+    while (_state != ASYNC_QUEUED && !_quit) {
+      SDL_CondWait(_cond, _mux);
+    }
+    if (_quit) {
+      break;
+    }
+    SDL_mutexV(_mux);
+    const bool ok = _req.work(_req.user);
+    SDL_mutexP(_mux);
+    _req.ok = ok;
+    _state = ASYNC_DONE;
+    SDL_CondSignal(_cond);
+  }
+  SDL_mutexV(_mux);
+  return 0;
+}
+
+bool disk_async_init(void) {
+#if USE_DISK_ASYNC
+  _mux = SDL_CreateMutex();
+  _cond = SDL_CreateCond();
+  if (!_mux || !_cond || !_disk_cache_lock_init()) {
+    return false;
+  }
+  _state = ASYNC_IDLE;
+  _quit = false;
+  _thread = SDL_CreateThread(_io_thread, NULL);
+  if (!_thread) {
+    log_printf(LOG_CHAN_DISK, "unable to start disk thread");
+    return false;
+  }
+#endif
+  return true;
+}
+
+void disk_async_close(void) {
+  if (!_thread) {
+    return;
+  }
+  disk_async_wait();
+  SDL_mutexP(_mux);
+  _quit = true;
+  SDL_CondSignal(_cond);
+  SDL_mutexV(_mux);
+  SDL_WaitThread(_thread, NULL);
+  _thread = NULL;
+  SDL_DestroyCond(_cond);
+  SDL_DestroyMutex(_mux);
+  _disk_cache_lock_close();
+}
+
+bool disk_async_submit(bool (*work)(void *user),
+                       void (*done)(bool ok, void *user), void *user) {
+  assert(work && done);
+  if (!_thread) {
+    done(work(user), user);
+    return false;
+  }
+  disk_async_wait();
+  _req.work = work;
+  _req.done = done;
+  _req.user = user;
+  SDL_mutexP(_mux);
+  _state = ASYNC_QUEUED;
+  SDL_CondSignal(_cond);
+  SDL_mutexV(_mux);
+  return true;
+}
+
+// hand a finished request back to its owner
+static void _deliver(void) {
+  _state = ASYNC_IDLE;
+  SDL_mutexV(_mux);
+  _req.done(_req.ok, _req.user);
+}
+
+void disk_async_tick(void) {
+  if (!_thread) {
+    return;
+  }
+  SDL_mutexP(_mux);
+  if (_state == ASYNC_DONE) {
+    _deliver();
+    return;
+  }
+  SDL_mutexV(_mux);
+}
+
+void disk_async_wait(void) {
+  if (!_thread) {
+    return;
+  }
+  SDL_mutexP(_mux);
+  while (_state == ASYNC_QUEUED) {
+    SDL_CondWait(_cond, _mux);
+  }
+  if (_state == ASYNC_DONE) {
+    _deliver();
+    return;
+  }
+  SDL_mutexV(_mux);
+}
@@ -0,0 +1,544 @@
+/*
+  Fake86: A portable, open-source 8086 PC emulator.
+  Copyright (C)2010-2013 Mike Chambers
+               2019      Aidan Dodds
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+  USA.
+*/
+
+// per drive block cache
+//
+// the cache wraps the delegates of an opened drive and keeps recently used
+// blocks in memory, least recently used blocks are evicted first. a read
+// which carries on from where the last one ended also fetches the next
+// track in the same backend request. writes stay in the cache until the
+// block is evicted or the drive is flushed, on int 13h reset, eject and exit.
+
+#include "disk.h"
+
+
+#define CACHE_BLOCK 4096
+// a cache always holds at least two of the largest transfers
+#define CACHE_LINES_MIN 64
+// most blocks fetched by one backend request
+#define CACHE_FILL_MAX 32
+
+#define NONE 0xffffffffu
+
+uint32_t disk_cache_kb = DISK_CACHE_KB;
+
+static struct disk_cache_stats_t _stats;
+// guards _stats while the io thread may be updating them
+static SDL_mutex *_stats_mux;
+
+struct cache_line_t {
+  // block held or NONE if free
+  uint32_t block;
+  // lru list, most recently used at the head
+  uint32_t prev, next;
+  // hash chain
+  uint32_t chain;
+  bool dirty;
+};
+
+struct disk_cache_t {
+  struct disk_info_t inner;
+  struct cache_line_t *line;
+  uint8_t *data;
+  uint32_t lines;
+  uint32_t *hash;
+  uint32_t hash_mask;
+  uint32_t head, tail;
+  uint64_t seek_pos;
+  // end of the last read, a read from here is sequential
+  uint64_t next_seq;
+  uint32_t track_bytes;
+};
+
+static uint8_t *_line_data(struct disk_cache_t *c, const uint32_t i) {
+  return c->data + (size_t)i * CACHE_BLOCK;
+}
+
+static uint32_t _block_len(const struct disk_cache_t *c, const uint32_t blk) {
+  const uint64_t left = c->inner.size_bytes - (uint64_t)blk * CACHE_BLOCK;
+  return (uint32_t)SDL_min(CACHE_BLOCK, left);
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- lru and hash
+
+static void _unlink(struct disk_cache_t *c, const uint32_t i) {
+  struct cache_line_t *l = c->line + i;
+  if (l->prev != NONE) {
+    c->line[l->prev].next = l->next;
+  }
+  else {
+    c->head = l->next;
+  }
+  if (l->next != NONE) {
+    c->line[l->next].prev = l->prev;
+  }
+  else {
+    c->tail = l->prev;
+  }
+}
+
+static void _touch(struct disk_cache_t *c, const uint32_t i) {
+  if (c->head == i) {
+    return;
+  }
+  _unlink(c, i);
+  struct cache_line_t *l = c->line + i;
+  l->prev = NONE;
+  l->next = c->head;
+  c->line[c->head].prev = i;
+  c->head = i;
+}
+
+static uint32_t *_bucket(struct disk_cache_t *c, const uint32_t blk) {
+  return c->hash + ((blk * 0x9E3779B1u) >> 8 & c->hash_mask);
+}
+
+static uint32_t _find(struct disk_cache_t *c, const uint32_t blk) {
+  for (uint32_t i = *_bucket(c, blk); i != NONE; i = c->line[i].chain) {
+    if (c->line[i].block == blk) {
+      return i;
+    }
+  }
+  return NONE;
+}
+
+static void _hash_remove(struct disk_cache_t *c, const uint32_t i) {
+  uint32_t *p = _bucket(c, c->line[i].block);
+  while (*p != i) {
+    p = &c->line[*p].chain;
+  }
+  *p = c->line[i].chain;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- backend
+
+static bool _inner_io(struct disk_cache_t *c, const uint64_t offset,
+                      struct disk_iov_t *iov, const uint32_t count,
+                      const bool write) {
+  struct disk_info_t *d = &c->inner;
+  if (write && d->writev) {
+    return d->writev(d->self, offset, iov, count);
+  }
+  if (!write && d->readv) {
+    return d->readv(d->self, offset, iov, count);
+  }
+  if (!d->seek(d->self, offset)) {
+    return false;
+  }
+  for (uint32_t i = 0; i < count; ++i) {
+    const bool ok = write ?
+      d->write(d->self, iov[i].base, iov[i].size) :
+      d->read(d->self, iov[i].base, iov[i].size);
+    if (!ok) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void _count(uint64_t *counter, const uint64_t n) {
+  if (_stats_mux) {
+    SDL_mutexP(_stats_mux);
+  }
+  *counter += n;
+  if (_stats_mux) {
+    SDL_mutexV(_stats_mux);
+  }
+}
+
+static bool _write_back(struct disk_cache_t *c, const uint32_t i) {
+  struct cache_line_t *l = c->line + i;
+  if (!l->dirty) {
+    return true;
+  }
+  struct disk_iov_t iov = {_line_data(c, i), _block_len(c, l->block)};
+  if (!_inner_io(c, (uint64_t)l->block * CACHE_BLOCK, &iov, 1, true)) {
+    return false;
+  }
+  l->dirty = false;
+  _count(&_stats.write_backs, 1);
+  return true;
+}
+
+// take the least recently used line for `blk`, NONE if it held changes
+// which could not be written back
+static uint32_t _claim(struct disk_cache_t *c, const uint32_t blk) {
+  const uint32_t i = c->tail;
+  struct cache_line_t *l = c->line + i;
+  if (!_write_back(c, i)) {
+    return NONE;
+  }
+  if (l->block != NONE) {
+    _hash_remove(c, i);
+  }
+  l->block = blk;
+  uint32_t *b = _bucket(c, blk);
+  l->chain = *b;
+  *b = i;
+  _touch(c, i);
+  return i;
+}
+
+// free a line and make it the next one claimed
+static void _release(struct disk_cache_t *c, const uint32_t i) {
+  _hash_remove(c, i);
+  struct cache_line_t *l = c->line + i;
+  l->block = NONE;
+  l->dirty = false;
+  if (c->tail != i) {
+    _unlink(c, i);
+    l->next = NONE;
+    l->prev = c->tail;
+    c->line[c->tail].next = i;
+    c->tail = i;
+  }
+}
+
+// read `count` uncached blocks from `blk` in one backend request
+static bool _fill(struct disk_cache_t *c, const uint32_t blk,
+                  const uint32_t count) {
+  struct disk_iov_t iov[CACHE_FILL_MAX];
+  uint32_t index[CACHE_FILL_MAX];
+  assert(count <= CACHE_FILL_MAX);
+  for (uint32_t i = 0; i < count; ++i) {
+    index[i] = _claim(c, blk + i);
+    if (index[i] == NONE) {
+      for (uint32_t j = 0; j < i; ++j) {
+        _release(c, index[j]);
+      }
+      return false;
+    }
+    iov[i].base = _line_data(c, index[i]);
+    iov[i].size = _block_len(c, blk + i);
+  }
+  if (!_inner_io(c, (uint64_t)blk * CACHE_BLOCK, iov, count, false)) {
+    for (uint32_t i = 0; i < count; ++i) {
+      _release(c, index[i]);
+    }
+    return false;
+  }
+  return true;
+}
+
+// fetch the uncached blocks in [first, last]
+static bool _fetch(struct disk_cache_t *c, uint32_t first, const uint32_t last,
+                   uint64_t *counter) {
+  // keep the cached ones from being evicted to make room for the rest
+  for (uint32_t blk = first; blk <= last; ++blk) {
+    const uint32_t i = _find(c, blk);
+    if (i != NONE) {
+      _touch(c, i);
+    }
+  }
+  while (first <= last) {
+    if (_find(c, first) != NONE) {
+      ++first;
+      continue;
+    }
+    uint32_t run = 1;
+    while (first + run <= last && run < CACHE_FILL_MAX &&
+           _find(c, first + run) == NONE) {
+      ++run;
+    }
+    if (!_fill(c, first, run)) {
+      return false;
+    }
+    *counter += run;
+    first += run;
+  }
+  return true;
+}
+
+static bool _cache_read(struct disk_cache_t *c, uint64_t offset, uint8_t *dst,
+                        uint32_t size) {
+  const uint64_t size_bytes = c->inner.size_bytes;
+  if (offset > size_bytes || size > size_bytes - offset) {
+    return false;
+  }
+  if (!size) {
+    return true;
+  }
+  const bool sequential = (offset == c->next_seq);
+  const uint64_t end = offset + size;
+  const uint32_t first = (uint32_t)(offset / CACHE_BLOCK);
+  const uint32_t last = (uint32_t)((end - 1) / CACHE_BLOCK);
+  // blocks missing from the request come in together
+  uint64_t missed = 0;
+  if (!_fetch(c, first, last, &missed)) {
+    return false;
+  }
+  _count(&_stats.misses, missed);
+  _count(&_stats.hits, (last - first + 1) - missed);
+  while (size) {
+    const uint32_t blk = (uint32_t)(offset / CACHE_BLOCK);
+    const uint32_t within = offset % CACHE_BLOCK;
+    const uint32_t part = SDL_min(size, CACHE_BLOCK - within);
+    const uint32_t i = _find(c, blk);
+    assert(i != NONE);
+    memcpy(dst, _line_data(c, i) + within, part);
+    _touch(c, i);
+    offset += part;
+    dst += part;
+    size -= part;
+  }
+  c->next_seq = end;
+  if (sequential && end < size_bytes) {
+    // the next track is probably wanted next, a failure here is harmless
+    const uint64_t ahead = SDL_min(c->track_bytes, size_bytes - end);
+    uint64_t fetched = 0;
+    _fetch(c, (uint32_t)(end / CACHE_BLOCK),
+           (uint32_t)((end + ahead - 1) / CACHE_BLOCK), &fetched);
+    _count(&_stats.read_ahead, fetched);
+  }
+  return true;
+}
+
+static bool _cache_write(struct disk_cache_t *c, uint64_t offset,
+                         const uint8_t *src, uint32_t size) {
+  const uint64_t size_bytes = c->inner.size_bytes;
+  if (c->inner.read_only ||
+      offset > size_bytes || size > size_bytes - offset) {
+    return false;
+  }
+  while (size) {
+    const uint32_t blk = (uint32_t)(offset / CACHE_BLOCK);
+    const uint32_t within = offset % CACHE_BLOCK;
+    const uint32_t part = SDL_min(size, CACHE_BLOCK - within);
+    uint32_t i = _find(c, blk);
+    if (i == NONE) {
+      // whole blocks need not be read first
+      if (part == _block_len(c, blk)) {
+        i = _claim(c, blk);
+      }
+      else if (_fill(c, blk, 1)) {
+        _count(&_stats.misses, 1);
+        i = _find(c, blk);
+      }
+      if (i == NONE) {
+        return false;
+      }
+    }
+    else {
+      _count(&_stats.hits, 1);
+    }
+    memcpy(_line_data(c, i) + within, src, part);
+    c->line[i].dirty = true;
+    _touch(c, i);
+    offset += part;
+    src += part;
+    size -= part;
+  }
+  return true;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- delegates
+
+static bool _disk_cache_flush(void *self) {
+  assert(self);
+  struct disk_cache_t *c = (struct disk_cache_t*)self;
+  bool ok = true;
+  for (uint32_t i = 0; i < c->lines; ++i) {
+    ok &= _write_back(c, i);
+  }
+  if (c->inner.flush) {
+    ok &= c->inner.flush(c->inner.self);
+  }
+  return ok;
+}
+
+static void _cache_free(struct disk_cache_t *c) {
+  free(c->line);
+  free(c->data);
+  free(c->hash);
+  free(c);
+}
+
+static bool _disk_cache_eject(void *self) {
+  assert(self);
+  struct disk_cache_t *c = (struct disk_cache_t*)self;
+  if (!_disk_cache_flush(c)) {
+    log_printf(LOG_CHAN_DISK, "unable to write back cached blocks");
+  }
+  c->inner.eject(c->inner.self);
+  _cache_free(c);
+  return true;
+}
+
+static bool _disk_cache_seek(void *self, const uint64_t offset) {
+  assert(self);
+  struct disk_cache_t *c = (struct disk_cache_t*)self;
+  if (offset > c->inner.size_bytes) {
+    return false;
+  }
+  c->seek_pos = offset;
+  return true;
+}
+
+static bool _disk_cache_read(void *self, uint8_t *dst, const uint32_t count) {
+  assert(self);
+  struct disk_cache_t *c = (struct disk_cache_t*)self;
+  if (!_cache_read(c, c->seek_pos, dst, count)) {
+    return false;
+  }
+  c->seek_pos += count;
+  return true;
+}
+
+static bool _disk_cache_write(
+  void *self, const uint8_t *src, const uint32_t count) {
+  assert(self);
+  struct disk_cache_t *c = (struct disk_cache_t*)self;
+  if (!_cache_write(c, c->seek_pos, src, count)) {
+    return false;
+  }
+  c->seek_pos += count;
+  return true;
+}
+
+static bool _disk_cache_tell(void *self, uint64_t *out) {
+  assert(self && out);
+  struct disk_cache_t *c = (struct disk_cache_t*)self;
+  *out = c->seek_pos;
+  return true;
+}
+
+static bool _disk_cache_readv(
+  void *self, const uint64_t offset,
+  const struct disk_iov_t *iov, const uint32_t count) {
+  assert(self);
+  struct disk_cache_t *c = (struct disk_cache_t*)self;
+  c->seek_pos = offset;
+  for (uint32_t i = 0; i < count; ++i) {
+    if (!_disk_cache_read(c, iov[i].base, iov[i].size)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool _disk_cache_writev(
+  void *self, const uint64_t offset,
+  const struct disk_iov_t *iov, const uint32_t count) {
+  assert(self);
+  struct disk_cache_t *c = (struct disk_cache_t*)self;
+  c->seek_pos = offset;
+  for (uint32_t i = 0; i < count; ++i) {
+    if (!_disk_cache_write(c, iov[i].base, iov[i].size)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- interface
+
+bool _disk_cache_wrap(struct disk_info_t *d) {
+  assert(d && d->eject);
+  if (!disk_cache_kb || d->in_memory) {
+    return true;
+  }
+  struct disk_cache_t *c =
+    (struct disk_cache_t*)calloc(1, sizeof(struct disk_cache_t));
+  if (!c) {
+    return false;
+  }
+  // no point holding more blocks than the disk has
+  const uint64_t blocks = (d->size_bytes + CACHE_BLOCK - 1) / CACHE_BLOCK;
+  c->lines = SDL_max(disk_cache_kb / (CACHE_BLOCK / 1024), CACHE_LINES_MIN);
+  c->lines = (uint32_t)SDL_min(c->lines, SDL_max(blocks, CACHE_LINES_MIN));
+  uint32_t buckets = 1;
+  while (buckets < c->lines) {
+    buckets *= 2;
+  }
+  c->hash_mask = buckets - 1;
+  c->line = (struct cache_line_t*)malloc(c->lines * sizeof(*c->line));
+  c->data = (uint8_t*)malloc((size_t)c->lines * CACHE_BLOCK);
+  c->hash = (uint32_t*)malloc(buckets * sizeof(uint32_t));
+  if (!c->line || !c->data || !c->hash) {
+    _cache_free(c);
+    return false;
+  }
+  memset(c->hash, 0xff, buckets * sizeof(uint32_t));
+  for (uint32_t i = 0; i < c->lines; ++i) {
+    struct cache_line_t *l = c->line + i;
+    l->block = NONE;
+    l->chain = NONE;
+    l->dirty = false;
+    l->prev = i ? (i - 1) : NONE;
+    l->next = (i + 1 < c->lines) ? (i + 1) : NONE;
+  }
+  c->head = 0;
+  c->tail = c->lines - 1;
+  c->next_seq = ~0ull;
+  c->track_bytes = d->sects * d->sector_size;
+
+  c->inner = *d;
+  d->self   = c;
+  d->eject  = _disk_cache_eject;
+  d->seek   = _disk_cache_seek;
+  d->read   = _disk_cache_read;
+  d->write  = _disk_cache_write;
+  d->tell   = _disk_cache_tell;
+  d->readv  = _disk_cache_readv;
+  d->writev = _disk_cache_writev;
+  d->flush  = _disk_cache_flush;
+  return true;
+}
+
+struct disk_info_t *_disk_cache_inner(struct disk_info_t *d) {
+  if (d && d->eject == _disk_cache_eject) {
+    return &((struct disk_cache_t*)d->self)->inner;
+  }
+  return d;
+}
+
+void _disk_cache_invalidate(struct disk_info_t *d) {
+  if (!d || d->eject != _disk_cache_eject) {
+    return;
+  }
+  struct disk_cache_t *c = (struct disk_cache_t*)d->self;
+  for (uint32_t i = 0; i < c->lines; ++i) {
+    if (c->line[i].block != NONE) {
+      _release(c, i);
+    }
+  }
+  c->next_seq = ~0ull;
+}
+
+bool _disk_cache_lock_init(void) {
+  _stats_mux = SDL_CreateMutex();
+  return _stats_mux != NULL;
+}
+
+void _disk_cache_lock_close(void) {
+  SDL_DestroyMutex(_stats_mux);
+  _stats_mux = NULL;
+}
+
+void disk_cache_stats(struct disk_cache_stats_t *out) {
+  if (_stats_mux) {
+    SDL_mutexP(_stats_mux);
+  }
+  *out = _stats;
+  if (_stats_mux) {
+    SDL_mutexV(_stats_mux);
+  }
+}
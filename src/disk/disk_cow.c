@@ -0,0 +1,537 @@
+/*
+  Fake86: A portable, open-source 8086 PC emulator.
+  Copyright (C)2010-2013 Mike Chambers
+               2019      Aidan Dodds
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+  USA.
+*/
+
+// copy-on-write overlay disks
+//
+// an overlay sits on top of a base image which is only ever read. guest
+// writes copy the block they touch into the overlay file and reads of that
+// block are served from there from then on, so many instances can share one
+// base image and each overlay only grows with the blocks its guest changed.
+//
+// file layout:
+//   header    512 bytes
+//   map       one uint32_t per block, delta slot + 1 or 0 if in the base
+//   delta     block sized slots from the first block boundary after the map
+//
+// data blocks are written before their map entry, a slot written without
+// its map entry reaching the file is reused after a crash.
+
+#include <stdio.h>
+
+#include "disk.h"
+
+
+#define COW_MAGIC "fake86ov"
+#define COW_VERSION 1
+#define COW_BLOCK 4096
+
+struct cow_header_t {
+  char magic[8];
+  uint32_t version;
+  uint32_t block_size;
+  uint32_t blocks;
+  // size of the base image in bytes
+  uint32_t size;
+  // base image path as given when the overlay was created, or as last
+  // given in its place
+  char base[488];
+};
+
+struct disk_cow_t {
+  FILE *fd;
+  char *path;
+  struct cow_header_t head;
+  uint32_t *map;
+  // slots in use in the delta
+  uint32_t used;
+  uint32_t data_start;
+  uint64_t seek_pos;
+  struct disk_info_t base;
+  uint8_t block[COW_BLOCK];
+};
+
+static uint32_t _block_len(const struct disk_cow_t *c, const uint32_t blk) {
+  const uint32_t offset = blk * COW_BLOCK;
+  return SDL_min(COW_BLOCK, c->head.size - offset);
+}
+
+static bool _base_io(struct disk_info_t *d, const uint64_t offset,
+                     uint8_t *buf, const uint32_t size, const bool write) {
+  struct disk_iov_t iov = {buf, size};
+  if (write && d->writev) {
+    return d->writev(d->self, offset, &iov, 1);
+  }
+  if (!write && d->readv) {
+    return d->readv(d->self, offset, &iov, 1);
+  }
+  if (!d->seek(d->self, offset)) {
+    return false;
+  }
+  return write ? d->write(d->self, buf, size) : d->read(d->self, buf, size);
+}
+
+static bool _delta_io(struct disk_cow_t *c, const uint32_t slot,
+                      const uint32_t within, uint8_t *buf,
+                      const uint32_t size, const bool write) {
+  const uint64_t pos = c->data_start + (uint64_t)slot * COW_BLOCK + within;
+  if (!_disk_fseek(c->fd, pos)) {
+    return false;
+  }
+  if (write) {
+    return fwrite(buf, 1, size, c->fd) == size;
+  }
+  return fread(buf, 1, size, c->fd) == size;
+}
+
+static bool _header_store(struct disk_cow_t *c) {
+  if (fseek(c->fd, 0, SEEK_SET)) {
+    return false;
+  }
+  return fwrite(&c->head, sizeof(c->head), 1, c->fd) == 1 &&
+         fflush(c->fd) == 0;
+}
+
+static bool _map_store(struct disk_cow_t *c, const uint32_t blk) {
+  const long pos = (long)sizeof(struct cow_header_t) + (long)blk * 4;
+  if (fseek(c->fd, pos, SEEK_SET)) {
+    return false;
+  }
+  return fwrite(c->map + blk, 4, 1, c->fd) == 1;
+}
+
+static bool _cow_read(struct disk_cow_t *c, uint64_t offset, uint8_t *dst,
+                      uint32_t size) {
+  if (offset > c->head.size || size > c->head.size - offset) {
+    return false;
+  }
+  while (size) {
+    const uint32_t blk = (uint32_t)(offset / COW_BLOCK);
+    const uint32_t within = offset % COW_BLOCK;
+    const uint32_t slot = c->map[blk];
+    // extend over following blocks stored the same way
+    uint32_t part = COW_BLOCK - within;
+    for (uint32_t next = blk + 1; part < size; ++next) {
+      const uint32_t want = slot ? (slot + next - blk) : 0;
+      if (c->map[next] != want) {
+        break;
+      }
+      part += COW_BLOCK;
+    }
+    part = SDL_min(part, size);
+    const bool ok = slot ?
+      _delta_io(c, slot - 1, within, dst, part, false) :
+      _base_io(&c->base, offset, dst, part, false);
+    if (!ok) {
+      return false;
+    }
+    offset += part;
+    dst += part;
+    size -= part;
+  }
+  return true;
+}
+
+static bool _cow_write(struct disk_cow_t *c, uint64_t offset,
+                       const uint8_t *src, uint32_t size) {
+  if (offset > c->head.size || size > c->head.size - offset) {
+    return false;
+  }
+  while (size) {
+    const uint32_t blk = (uint32_t)(offset / COW_BLOCK);
+    const uint32_t within = offset % COW_BLOCK;
+    const uint32_t part = SDL_min(size, COW_BLOCK - within);
+    const bool fresh = (c->map[blk] == 0);
+    if (fresh) {
+      const uint32_t len = _block_len(c, blk);
+      // copy up the rest of a partly written block
+      if (part != len) {
+        if (!_base_io(&c->base, (uint64_t)blk * COW_BLOCK, c->block, len,
+                      false) ||
+            !_delta_io(c, c->used, 0, c->block, len, true)) {
+          return false;
+        }
+      }
+      c->map[blk] = ++c->used;
+    }
+    if (!_delta_io(c, c->map[blk] - 1, within, (uint8_t*)src, part, true)) {
+      return false;
+    }
+    if (fresh && !_map_store(c, blk)) {
+      return false;
+    }
+    offset += part;
+    src += part;
+    size -= part;
+  }
+  return true;
+}
+
+// (re)create the overlay file holding no blocks
+static bool _cow_reset(struct disk_cow_t *c) {
+  if (c->fd) {
+    fclose(c->fd);
+  }
+  c->fd = fopen(c->path, "w+b");
+  if (!c->fd) {
+    return false;
+  }
+  memset(c->map, 0, c->head.blocks * 4);
+  c->used = 0;
+  if (fwrite(&c->head, sizeof(c->head), 1, c->fd) != 1 ||
+      fwrite(c->map, 4, c->head.blocks, c->fd) != c->head.blocks) {
+    return false;
+  }
+  return fflush(c->fd) == 0;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- delegates
+
+static bool _disk_cow_flush(void *self) {
+  assert(self);
+  struct disk_cow_t *c = (struct disk_cow_t*)self;
+  return fflush(c->fd) == 0;
+}
+
+static void _cow_free(struct disk_cow_t *c) {
+  if (c->fd) {
+    fclose(c->fd);
+  }
+  if (c->base.eject) {
+    c->base.eject(c->base.self);
+  }
+  free(c->map);
+  free(c->path);
+  free(c);
+}
+
+static bool _disk_cow_eject(void *self) {
+  assert(self);
+  _cow_free((struct disk_cow_t*)self);
+  return true;
+}
+
+static bool _disk_cow_seek(void *self, const uint64_t offset) {
+  assert(self);
+  struct disk_cow_t *c = (struct disk_cow_t*)self;
+  if (offset > c->head.size) {
+    return false;
+  }
+  c->seek_pos = offset;
+  return true;
+}
+
+static bool _disk_cow_read(void *self, uint8_t *dst, const uint32_t count) {
+  assert(self);
+  struct disk_cow_t *c = (struct disk_cow_t*)self;
+  if (!_cow_read(c, c->seek_pos, dst, count)) {
+    return false;
+  }
+  c->seek_pos += count;
+  return true;
+}
+
+static bool _disk_cow_write(
+  void *self, const uint8_t *src, const uint32_t count) {
+  assert(self);
+  struct disk_cow_t *c = (struct disk_cow_t*)self;
+  if (!_cow_write(c, c->seek_pos, src, count)) {
+    return false;
+  }
+  c->seek_pos += count;
+  return true;
+}
+
+static bool _disk_cow_tell(void *self, uint64_t *out) {
+  assert(self && out);
+  struct disk_cow_t *c = (struct disk_cow_t*)self;
+  *out = c->seek_pos;
+  return true;
+}
+
+static bool _disk_cow_readv(
+  void *self, const uint64_t offset,
+  const struct disk_iov_t *iov, const uint32_t count) {
+  assert(self);
+  struct disk_cow_t *c = (struct disk_cow_t*)self;
+  c->seek_pos = offset;
+  for (uint32_t i = 0; i < count; ++i) {
+    if (!_disk_cow_read(c, iov[i].base, iov[i].size)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool _disk_cow_writev(
+  void *self, const uint64_t offset,
+  const struct disk_iov_t *iov, const uint32_t count) {
+  assert(self);
+  struct disk_cow_t *c = (struct disk_cow_t*)self;
+  c->seek_pos = offset;
+  for (uint32_t i = 0; i < count; ++i) {
+    if (!_disk_cow_write(c, iov[i].base, iov[i].size)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- open
+
+// read the header and map of an existing overlay
+static bool _cow_load(struct disk_cow_t *c) {
+  struct cow_header_t *h = &c->head;
+  if (fread(h, sizeof(*h), 1, c->fd) != 1 ||
+      memcmp(h->magic, COW_MAGIC, 8) ||
+      h->version != COW_VERSION ||
+      h->block_size != COW_BLOCK ||
+      h->blocks != (h->size + COW_BLOCK - 1) / COW_BLOCK) {
+    log_printf(LOG_CHAN_DISK, "'%s' is not a valid overlay", c->path);
+    return false;
+  }
+  h->base[sizeof(h->base) - 1] = '\0';
+  c->map = (uint32_t*)malloc(h->blocks * 4 + 4);
+  if (!c->map || fread(c->map, 4, h->blocks, c->fd) != h->blocks) {
+    log_printf(LOG_CHAN_DISK, "unable to read overlay map");
+    return false;
+  }
+  // the delta is only appended to so the highest slot marks its end
+  c->used = 0;
+  for (uint32_t i = 0; i < h->blocks; ++i) {
+    c->used = SDL_max(c->used, c->map[i]);
+  }
+  return true;
+}
+
+static bool _cow_open_base(struct disk_cow_t *c, const uint8_t num,
+                           const char *base) {
+  if (!_disk_open_image(num, base, false, &c->base)) {
+    log_printf(LOG_CHAN_DISK, "unable to open base image '%s'", base);
+    return false;
+  }
+  return true;
+}
+
+bool _disk_cow_open(
+  const uint8_t num, const char *path, const char *base,
+  struct disk_info_t *out) {
+  assert(path && out);
+  // the map starts straight after one sector of header
+  assert(sizeof(struct cow_header_t) == 512);
+
+  struct disk_cow_t *c =
+    (struct disk_cow_t*)calloc(1, sizeof(struct disk_cow_t));
+  if (!c) {
+    return false;
+  }
+  c->path = (char*)malloc(strlen(path) + 1);
+  if (!c->path) {
+    free(c);
+    return false;
+  }
+  strcpy(c->path, path);
+
+  c->fd = fopen(path, "r+b");
+  if (c->fd) {
+    if (!_cow_load(c)) {
+      goto error;
+    }
+    // a base given on the command line overrides the recorded one
+    if (!_cow_open_base(c, num, base ? base : c->head.base)) {
+      goto error;
+    }
+    if (c->base.size_bytes != c->head.size) {
+      log_printf(LOG_CHAN_DISK, "base image does not match overlay '%s'",
+                 path);
+      goto error;
+    }
+    // record the new base so a commit goes to the image the guest saw
+    if (base && strcmp(base, c->head.base)) {
+      if (strlen(base) >= sizeof(c->head.base)) {
+        log_printf(LOG_CHAN_DISK, "base image path too long");
+        goto error;
+      }
+      strcpy(c->head.base, base);
+      if (!_header_store(c)) {
+        log_printf(LOG_CHAN_DISK, "unable to update overlay '%s'", path);
+        goto error;
+      }
+    }
+  }
+  else {
+    if (!base) {
+      log_printf(LOG_CHAN_DISK,
+                 "overlay '%s' not found, create one with overlay.cow=base",
+                 path);
+      goto error;
+    }
+    if (strlen(base) >= sizeof(c->head.base)) {
+      log_printf(LOG_CHAN_DISK, "base image path too long");
+      goto error;
+    }
+    if (!_cow_open_base(c, num, base)) {
+      goto error;
+    }
+    // the header and map hold 32 bit sizes
+    if (c->base.size_bytes > 0xffffffffull) {
+      log_printf(LOG_CHAN_DISK, "overlays on images over 4GB are not supported");
+      goto error;
+    }
+    struct cow_header_t *h = &c->head;
+    memcpy(h->magic, COW_MAGIC, 8);
+    h->version = COW_VERSION;
+    h->block_size = COW_BLOCK;
+    h->size = (uint32_t)c->base.size_bytes;
+    h->blocks = (h->size + COW_BLOCK - 1) / COW_BLOCK;
+    strcpy(h->base, base);
+    c->map = (uint32_t*)malloc(h->blocks * 4 + 4);
+    if (!c->map || !_cow_reset(c)) {
+      log_printf(LOG_CHAN_DISK, "unable to create overlay '%s'", path);
+      goto error;
+    }
+  }
+  c->data_start = sizeof(struct cow_header_t) + c->head.blocks * 4;
+  c->data_start = (c->data_start + COW_BLOCK - 1) & ~(COW_BLOCK - 1);
+
+  // populate disk structure
+  out->self   = c;
+  out->eject  = _disk_cow_eject;
+  out->seek   = _disk_cow_seek;
+  out->read   = _disk_cow_read;
+  out->write  = _disk_cow_write;
+  out->tell   = _disk_cow_tell;
+  out->readv  = _disk_cow_readv;
+  out->writev = _disk_cow_writev;
+  out->flush  = _disk_cow_flush;
+
+  // the overlay looks exactly like its base
+  out->drive_num   = num;
+  out->size_bytes  = c->base.size_bytes;
+  out->sector_size = c->base.sector_size;
+  out->cyls        = c->base.cyls;
+  out->sects       = c->base.sects;
+  out->heads       = c->base.heads;
+  return true;
+
+error:
+  _cow_free(c);
+  return false;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- commands
+
+static struct disk_cow_t *_as_cow(struct disk_info_t *d) {
+  if (!d || d->eject != _disk_cow_eject) {
+    log_printf(LOG_CHAN_DISK, "disk is not an overlay");
+    return NULL;
+  }
+  return (struct disk_cow_t*)d->self;
+}
+
+bool _disk_cow_discard(struct disk_info_t *d) {
+  struct disk_cow_t *c = _as_cow(d);
+  if (!c) {
+    return false;
+  }
+  if (!_cow_reset(c)) {
+    log_printf(LOG_CHAN_DISK, "unable to reset overlay '%s'", c->path);
+    return false;
+  }
+  return true;
+}
+
+bool _disk_cow_commit(struct disk_info_t *d) {
+  struct disk_cow_t *c = _as_cow(d);
+  if (!c) {
+    return false;
+  }
+  const char *base = c->head.base;
+  struct disk_info_t dst;
+  memset(&dst, 0, sizeof(dst));
+  if (!_disk_open_image(d->drive_num, base, true, &dst)) {
+    log_printf(LOG_CHAN_DISK, "unable to open '%s' for writing", base);
+    return false;
+  }
+  bool ok = true;
+  for (uint32_t blk = 0; ok && blk < c->head.blocks; ++blk) {
+    if (c->map[blk]) {
+      const uint32_t len = _block_len(c, blk);
+      ok = _delta_io(c, c->map[blk] - 1, 0, c->block, len, false) &&
+           _base_io(&dst, blk * COW_BLOCK, c->block, len, true);
+    }
+  }
+  if (ok && dst.flush) {
+    ok = dst.flush(dst.self);
+  }
+  dst.eject(dst.self);
+  if (!ok) {
+    log_printf(LOG_CHAN_DISK, "unable to commit overlay to '%s'", base);
+    return false;
+  }
+  // reopen the base so no stale view of it is kept
+  struct disk_info_t fresh;
+  memset(&fresh, 0, sizeof(fresh));
+  if (!_disk_open_image(d->drive_num, base, false, &fresh)) {
+    log_printf(LOG_CHAN_DISK, "unable to reopen base image '%s'", base);
+    return false;
+  }
+  c->base.eject(c->base.self);
+  c->base = fresh;
+  return _disk_cow_discard(d);
+}
+
+bool _disk_cow_snapshot(struct disk_info_t *d, const char *path) {
+  struct disk_cow_t *c = _as_cow(d);
+  if (!c) {
+    return false;
+  }
+  FILE *fd = fopen(path, "wb");
+  if (!fd) {
+    log_printf(LOG_CHAN_DISK, "unable to open file '%s'", path);
+    return false;
+  }
+  // the copy holds the same blocks packed into consecutive slots
+  uint32_t *map = (uint32_t*)calloc(c->head.blocks + 1, 4);
+  bool ok = (map != NULL);
+  uint32_t used = 0;
+  for (uint32_t blk = 0; ok && blk < c->head.blocks; ++blk) {
+    map[blk] = c->map[blk] ? ++used : 0;
+  }
+  ok = ok &&
+       fwrite(&c->head, sizeof(c->head), 1, fd) == 1 &&
+       fwrite(map, 4, c->head.blocks, fd) == c->head.blocks;
+  for (uint32_t blk = 0; ok && blk < c->head.blocks; ++blk) {
+    if (!c->map[blk]) {
+      continue;
+    }
+    const uint32_t len = _block_len(c, blk);
+    const uint64_t at = c->data_start + (uint64_t)(map[blk] - 1) * COW_BLOCK;
+    ok = _delta_io(c, c->map[blk] - 1, 0, c->block, len, false) &&
+         _disk_fseek(fd, at) &&
+         fwrite(c->block, 1, len, fd) == len;
+  }
+  free(map);
+  ok = (fclose(fd) == 0) && ok;
+  if (!ok) {
+    log_printf(LOG_CHAN_DISK, "unable to write snapshot '%s'", path);
+  }
+  return ok;
+}
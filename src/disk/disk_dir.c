@@ -0,0 +1,1409 @@
+/*
+  Fake86: A portable, open-source 8086 PC emulator.
+  Copyright (C)2010-2013 Mike Chambers
+               2019      Aidan Dodds
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+  USA.
+*/
+
+// host directory presented as a FAT volume
+//
+// the tree is scanned once at open and each file and directory is given a
+// run of clusters. only the FAT is held in memory, the boot sector and
+// directory entries are generated when read and file data is read from the
+// host file owning the cluster. a floppy is a 1.44MB FAT12 disk, a hard
+// disk a partitioned FAT16 disk with room to spare.
+//
+// guest writes are applied to the host as they arrive:
+//   FAT        updates the in memory FAT
+//   directory  each changed entry creates, renames, resizes or deletes the
+//              host file it describes
+//   data       written to the host file owning the cluster, or held until
+//              the FAT and directory writes say which file that is
+// deleted files are removed from the host when the drive is flushed, so a
+// file moved by deleting then recreating its entry keeps its contents. a
+// drive opened read only refuses every write.
+
+#include <stdio.h>
+#include <time.h>
+
+#include "disk.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <direct.h>
+#include <io.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+#define NONE 0xffffffffu
+
+// spare space on a hard disk volume for the guest to write to
+#define DIR_FREE (64 * 1024 * 1024)
+// partition offset of a hard disk volume, one track
+#define DIR_PART_LBA 63
+#define DIR_PATH_MAX 1024
+
+enum {
+  NODE_LIVE,
+  // deleted by the guest, removed from the host at flush
+  NODE_DEAD,
+  NODE_GONE,
+};
+
+enum {
+  ATTR_READ_ONLY = 0x01,
+  ATTR_VOLUME    = 0x08,
+  ATTR_DIR       = 0x10,
+  ATTR_ARCHIVE   = 0x20,
+  ATTR_LFN       = 0x0f,
+};
+
+struct dir_node_t {
+  // host file name, NULL for the root
+  char *name;
+  uint8_t short_name[11];
+  uint8_t attr;
+  uint8_t state;
+  // host file may be longer than `size` after a guest write
+  bool grown;
+  uint16_t time, date;
+  uint32_t parent;
+  uint32_t first;
+  uint32_t size;
+  // directories: node held in each entry or NONE
+  uint32_t *slot;
+  uint32_t slots;
+};
+
+// a sector written by the guest which is not file data
+struct dir_sect_t {
+  uint32_t lba;
+  uint32_t next;
+  // data for a cluster with no owner yet
+  bool pending;
+  uint8_t data[512];
+};
+
+struct disk_dir_t {
+  char *root;
+  struct dir_node_t *node;
+  uint32_t nodes, node_cap;
+
+  // layout, sectors from the start of the disk
+  uint32_t part_lba;
+  uint32_t vol_sectors;
+  uint32_t fat_lba, fat_sectors;
+  uint32_t root_lba, root_entries;
+  uint32_t data_lba;
+  uint32_t spc;
+  uint32_t clusters;
+  uint32_t fat_bits;
+  uint32_t heads, sects;
+  uint8_t media;
+
+  uint8_t *fat;
+  // node owning each cluster and the cluster's index in its chain
+  uint32_t *owner;
+  uint32_t *pos;
+  bool chains_dirty;
+
+  struct dir_sect_t *sect;
+  uint32_t sect_count, sect_cap, sect_free;
+  uint32_t *sect_hash;
+  uint32_t sect_mask;
+
+  uint64_t seek_pos;
+  uint64_t size_bytes;
+
+  // the host file last accessed
+  uint32_t open_node;
+  FILE *open_fd;
+  bool open_write;
+
+  // guest writes may reach the host
+  bool writable;
+};
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- host
+
+#ifdef _WIN32
+static bool _host_mkdir(const char *path) {
+  return _mkdir(path) == 0;
+}
+static bool _host_rmdir(const char *path) {
+  return _rmdir(path) == 0;
+}
+static bool _host_truncate(FILE *fd, const uint32_t size) {
+  return _chsize_s(_fileno(fd), size) == 0;
+}
+#else
+static bool _host_mkdir(const char *path) {
+  return mkdir(path, 0777) == 0;
+}
+static bool _host_rmdir(const char *path) {
+  return rmdir(path) == 0;
+}
+static bool _host_truncate(FILE *fd, const uint32_t size) {
+  return ftruncate(fileno(fd), (off_t)size) == 0;
+}
+#endif
+
+static void _fat_time(time_t t, uint16_t *time_out, uint16_t *date_out) {
+  const struct tm *tm = localtime(&t);
+  if (!tm || tm->tm_year < 80) {
+    *time_out = 0;
+    *date_out = (1 << 5) | 1;
+    return;
+  }
+  *time_out = (uint16_t)((tm->tm_hour << 11) | (tm->tm_min << 5) |
+                         (tm->tm_sec / 2));
+  *date_out = (uint16_t)(((tm->tm_year - 80) << 9) | ((tm->tm_mon + 1) << 5) |
+                         tm->tm_mday);
+}
+
+// full host path of node `n`
+static bool _path(struct disk_dir_t *v, uint32_t n, char *out) {
+  uint32_t chain[64];
+  uint32_t depth = 0;
+  for (; n != 0; n = v->node[n].parent) {
+    if (depth >= 64) {
+      return false;
+    }
+    chain[depth++] = n;
+  }
+  size_t len = strlen(v->root);
+  if (len >= DIR_PATH_MAX) {
+    return false;
+  }
+  memcpy(out, v->root, len + 1);
+  while (depth--) {
+    const char *name = v->node[chain[depth]].name;
+    const size_t nlen = strlen(name);
+    if (len + 1 + nlen >= DIR_PATH_MAX) {
+      return false;
+    }
+    out[len++] = '/';
+    memcpy(out + len, name, nlen + 1);
+    len += nlen;
+  }
+  return true;
+}
+
+static void _host_close(struct disk_dir_t *v) {
+  if (v->open_fd) {
+    fclose(v->open_fd);
+    v->open_fd = NULL;
+  }
+  v->open_node = NONE;
+}
+
+// open the host file of node `n`, keeping it open for the next access
+static FILE *_host_file(struct disk_dir_t *v, const uint32_t n,
+                        const bool write) {
+  if (v->open_node == n && (v->open_write || !write)) {
+    return v->open_fd;
+  }
+  _host_close(v);
+  char path[DIR_PATH_MAX];
+  if (!_path(v, n, path)) {
+    return NULL;
+  }
+  v->open_fd = fopen(path, "r+b");
+  v->open_write = (v->open_fd != NULL);
+  if (!v->open_fd && !write) {
+    v->open_fd = fopen(path, "rb");
+  }
+  if (!v->open_fd) {
+    log_printf(LOG_CHAN_DISK, "unable to open host file '%s'", path);
+    return NULL;
+  }
+  v->open_node = n;
+  return v->open_fd;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- nodes
+
+static uint32_t _node_add(struct disk_dir_t *v, const uint32_t parent) {
+  if (v->nodes == v->node_cap) {
+    const uint32_t cap = v->node_cap ? v->node_cap * 2 : 64;
+    struct dir_node_t *n =
+      (struct dir_node_t*)realloc(v->node, cap * sizeof(*n));
+    if (!n) {
+      return NONE;
+    }
+    v->node = n;
+    v->node_cap = cap;
+  }
+  struct dir_node_t *n = v->node + v->nodes;
+  memset(n, 0, sizeof(*n));
+  n->parent = parent;
+  return v->nodes++;
+}
+
+// node held in entry `i` of directory `d`, growing its slots as needed
+static uint32_t *_slot(struct disk_dir_t *v, const uint32_t d,
+                       const uint32_t i) {
+  struct dir_node_t *n = v->node + d;
+  if (i >= n->slots) {
+    uint32_t count = n->slots ? n->slots : 16;
+    while (count <= i) {
+      count *= 2;
+    }
+    uint32_t *s = (uint32_t*)realloc(n->slot, count * sizeof(uint32_t));
+    if (!s) {
+      return NULL;
+    }
+    for (uint32_t j = n->slots; j < count; ++j) {
+      s[j] = NONE;
+    }
+    n->slot = s;
+    n->slots = count;
+  }
+  return n->slot + i;
+}
+
+// host name of an 8.3 name, false if DOS would not allow the name. the
+// guest writes these bytes so nothing that could leave its directory on
+// the host gets through.
+static bool _short_text(const uint8_t *name, char *out) {
+  if (name[0] == ' ') {
+    return false;
+  }
+  for (uint32_t i = 0; i < 11; ++i) {
+    if (name[i] < 0x20 || strchr("/\\:*?\"<>|.", name[i])) {
+      return false;
+    }
+  }
+  uint32_t j = 0;
+  for (uint32_t i = 0; i < 8 && name[i] != ' '; ++i) {
+    out[j++] = name[i];
+  }
+  if (name[8] != ' ') {
+    out[j++] = '.';
+    for (uint32_t i = 8; i < 11 && name[i] != ' '; ++i) {
+      out[j++] = name[i];
+    }
+  }
+  out[j] = '\0';
+  return true;
+}
+
+static char _short_char(const char c) {
+  if (c >= 'a' && c <= 'z') {
+    return c - 'a' + 'A';
+  }
+  if ((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+      strchr("!#$%&'()-@^_`{}~", c)) {
+    return c;
+  }
+  return '_';
+}
+
+// 8.3 name of a host name, false if some of it was lost
+static bool _short_name(const char *host, uint8_t *out) {
+  memset(out, ' ', 11);
+  const char *dot = strrchr(host, '.');
+  if (dot == host) {
+    dot = NULL;
+  }
+  bool exact = true;
+  uint32_t j = 0;
+  for (const char *c = host; *c && c != dot; ++c) {
+    if (*c == '.' || *c == ' ') {
+      exact = false;
+      continue;
+    }
+    if (j == 8) {
+      exact = false;
+      break;
+    }
+    out[j] = _short_char(*c);
+    exact &= (out[j] == *c) || (*c >= 'a' && *c <= 'z');
+    ++j;
+  }
+  if (j == 0) {
+    out[j++] = '_';
+    exact = false;
+  }
+  if (dot) {
+    j = 8;
+    for (const char *c = dot + 1; *c; ++c) {
+      if (j == 11) {
+        exact = false;
+        break;
+      }
+      out[j] = _short_char(*c);
+      exact &= (out[j] == *c) || (*c >= 'a' && *c <= 'z');
+      ++j;
+    }
+  }
+  return exact;
+}
+
+static uint32_t _name_hash(const uint8_t *name) {
+  uint32_t h = 2166136261u;
+  for (uint32_t i = 0; i < 11; ++i) {
+    h = (h ^ name[i]) * 16777619u;
+  }
+  return h;
+}
+
+// give the children [first, end) of a directory unique short names
+static bool _short_names(struct disk_dir_t *v, const uint32_t first,
+                         const uint32_t end) {
+  uint32_t size = 16;
+  while (size < (end - first) * 2) {
+    size *= 2;
+  }
+  uint32_t *set = (uint32_t*)malloc(size * sizeof(uint32_t));
+  if (!set) {
+    return false;
+  }
+  memset(set, 0xff, size * sizeof(uint32_t));
+  for (uint32_t i = first; i < end; ++i) {
+    struct dir_node_t *n = v->node + i;
+    const bool exact = _short_name(n->name, n->short_name);
+    uint8_t base[11];
+    memcpy(base, n->short_name, 11);
+    // numbered tails until the name is free, as BASE~1.EXT
+    for (uint32_t tail = exact ? 0 : 1; tail < 100000; ++tail) {
+      if (tail) {
+        char num[8];
+        const int len = snprintf(num, sizeof(num), "~%u", tail);
+        uint32_t keep = 8 - len;
+        while (keep > 1 && base[keep - 1] == ' ') {
+          --keep;
+        }
+        memcpy(n->short_name, base, 11);
+        memcpy(n->short_name + keep, num, len);
+      }
+      uint32_t h = _name_hash(n->short_name) & (size - 1);
+      bool taken = false;
+      for (; set[h] != NONE; h = (h + 1) & (size - 1)) {
+        if (!memcmp(v->node[set[h]].short_name, n->short_name, 11)) {
+          taken = true;
+          break;
+        }
+      }
+      if (!taken) {
+        set[h] = i;
+        break;
+      }
+    }
+  }
+  free(set);
+  return true;
+}
+
+// add a child node for each host entry of directory `d`
+static bool _scan_add(struct disk_dir_t *v, const uint32_t d,
+                      const char *name, const bool is_dir,
+                      const uint64_t size, const time_t mtime,
+                      const bool read_only) {
+  if (name[0] == '.') {
+    return true;
+  }
+  if (size > 0xffffffffull) {
+    log_printf(LOG_CHAN_DISK, "skipping '%s', too large for FAT", name);
+    return true;
+  }
+  const uint32_t n = _node_add(v, d);
+  if (n == NONE) {
+    return false;
+  }
+  struct dir_node_t *node = v->node + n;
+  node->name = (char*)malloc(strlen(name) + 1);
+  if (!node->name) {
+    return false;
+  }
+  strcpy(node->name, name);
+  node->attr = is_dir ? ATTR_DIR : ATTR_ARCHIVE;
+  node->attr |= read_only ? ATTR_READ_ONLY : 0;
+  node->size = is_dir ? 0 : (uint32_t)size;
+  _fat_time(mtime, &node->time, &node->date);
+  return true;
+}
+
+static bool _scan(struct disk_dir_t *v, const uint32_t d) {
+  char path[DIR_PATH_MAX];
+  if (!_path(v, d, path)) {
+    return false;
+  }
+  const uint32_t first = v->nodes;
+#ifdef _WIN32
+  char pattern[DIR_PATH_MAX + 2];
+  snprintf(pattern, sizeof(pattern), "%s/*", path);
+  WIN32_FIND_DATAA fd;
+  HANDLE find = FindFirstFileA(pattern, &fd);
+  if (find == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  bool ok = true;
+  do {
+    const bool is_dir = (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY);
+    const uint64_t size =
+      ((uint64_t)fd.nFileSizeHigh << 32) | fd.nFileSizeLow;
+    const uint64_t ft = ((uint64_t)fd.ftLastWriteTime.dwHighDateTime << 32) |
+                        fd.ftLastWriteTime.dwLowDateTime;
+    const time_t mtime = (time_t)((ft - 116444736000000000ull) / 10000000);
+    const bool ro = (fd.dwFileAttributes & FILE_ATTRIBUTE_READONLY);
+    ok = _scan_add(v, d, fd.cFileName, is_dir, size, mtime, ro);
+  } while (ok && FindNextFileA(find, &fd));
+  FindClose(find);
+#else
+  DIR *dir = opendir(path);
+  if (!dir) {
+    return false;
+  }
+  bool ok = true;
+  struct dirent *e;
+  while (ok && (e = readdir(dir))) {
+    char child[DIR_PATH_MAX];
+    struct stat st;
+    if (snprintf(child, sizeof(child), "%s/%s", path, e->d_name) >=
+          (int)sizeof(child) ||
+        stat(child, &st) != 0 ||
+        !(S_ISREG(st.st_mode) || S_ISDIR(st.st_mode))) {
+      continue;
+    }
+    ok = _scan_add(v, d, e->d_name, S_ISDIR(st.st_mode), st.st_size,
+                   st.st_mtime, access(child, W_OK) != 0);
+  }
+  closedir(dir);
+#endif
+  if (!ok || !_short_names(v, first, v->nodes)) {
+    return false;
+  }
+  // entries 0 and 1 of a subdirectory are . and ..
+  uint32_t i = d ? 2 : 0;
+  for (uint32_t n = first; n < v->nodes; ++n, ++i) {
+    uint32_t *s = _slot(v, d, i);
+    if (!s) {
+      return false;
+    }
+    *s = n;
+  }
+  v->node[d].size = i;
+  return true;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- fat
+
+static uint32_t _fat_get(const struct disk_dir_t *v, const uint32_t c) {
+  if (v->fat_bits == 12) {
+    const uint32_t at = c + c / 2;
+    const uint32_t w = v->fat[at] | (v->fat[at + 1] << 8);
+    return (c & 1) ? (w >> 4) : (w & 0xfff);
+  }
+  return v->fat[c * 2] | (v->fat[c * 2 + 1] << 8);
+}
+
+static void _fat_set(struct disk_dir_t *v, const uint32_t c, uint32_t x) {
+  if (v->fat_bits == 12) {
+    const uint32_t at = c + c / 2;
+    uint32_t w = v->fat[at] | (v->fat[at + 1] << 8);
+    w = (c & 1) ? ((w & 0x000f) | (x << 4)) : ((w & 0xf000) | (x & 0xfff));
+    v->fat[at] = w & 0xff;
+    v->fat[at + 1] = w >> 8;
+    return;
+  }
+  v->fat[c * 2] = x & 0xff;
+  v->fat[c * 2 + 1] = x >> 8;
+}
+
+static bool _fat_eoc(const struct disk_dir_t *v, const uint32_t x) {
+  return x >= ((v->fat_bits == 12) ? 0xff8u : 0xfff8u);
+}
+
+// clusters held by node `n` at scan time
+static uint32_t _node_clusters(const struct disk_dir_t *v, const uint32_t n) {
+  const struct dir_node_t *node = v->node + n;
+  const uint32_t bytes = v->spc * 512;
+  if (node->attr & ATTR_DIR) {
+    return n ? (node->size * 32 + bytes - 1) / bytes : 0;
+  }
+  return (node->size + bytes - 1) / bytes;
+}
+
+// claim `count` clusters from `*next` for node `n`
+static void _fat_chain(struct disk_dir_t *v, const uint32_t n,
+                       const uint32_t count, uint32_t *next) {
+  if (!count) {
+    return;
+  }
+  v->node[n].first = *next;
+  for (uint32_t i = 0; i < count; ++i) {
+    const uint32_t c = (*next)++;
+    _fat_set(v, c, (i + 1 < count) ? (c + 1) : 0xffff);
+  }
+}
+
+// find each cluster's owner by following every chain
+static void _chains_walk(struct disk_dir_t *v) {
+  const uint32_t end = v->clusters + 2;
+  for (uint32_t c = 0; c < end; ++c) {
+    v->owner[c] = NONE;
+  }
+  for (uint32_t n = 1; n < v->nodes; ++n) {
+    const struct dir_node_t *node = v->node + n;
+    if (node->state != NODE_LIVE) {
+      continue;
+    }
+    uint32_t c = node->first;
+    for (uint32_t i = 0; c >= 2 && c < end && v->owner[c] == NONE; ++i) {
+      v->owner[c] = n;
+      v->pos[c] = i;
+      const uint32_t next = _fat_get(v, c);
+      if (next < 2 || _fat_eoc(v, next)) {
+        break;
+      }
+      c = next;
+    }
+  }
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- sector store
+
+static uint32_t *_sect_bucket(struct disk_dir_t *v, const uint32_t lba) {
+  return v->sect_hash + ((lba * 0x9E3779B1u) >> 8 & v->sect_mask);
+}
+
+static struct dir_sect_t *_sect_find(struct disk_dir_t *v,
+                                     const uint32_t lba) {
+  for (uint32_t i = *_sect_bucket(v, lba); i != NONE; i = v->sect[i].next) {
+    if (v->sect[i].lba == lba) {
+      return v->sect + i;
+    }
+  }
+  return NULL;
+}
+
+static bool _sect_grow(struct disk_dir_t *v) {
+  const uint32_t cap = v->sect_cap ? v->sect_cap * 2 : 64;
+  struct dir_sect_t *s =
+    (struct dir_sect_t*)realloc(v->sect, cap * sizeof(*s));
+  uint32_t *hash = (uint32_t*)malloc(cap * sizeof(uint32_t));
+  if (!s || !hash) {
+    if (s) {
+      v->sect = s;
+    }
+    free(hash);
+    return false;
+  }
+  v->sect = s;
+  free(v->sect_hash);
+  v->sect_hash = hash;
+  v->sect_mask = cap - 1;
+  v->sect_cap = cap;
+  memset(hash, 0xff, cap * sizeof(uint32_t));
+  for (uint32_t i = 0; i < v->sect_count; ++i) {
+    if (s[i].lba != NONE) {
+      uint32_t *b = _sect_bucket(v, s[i].lba);
+      s[i].next = *b;
+      *b = i;
+    }
+  }
+  return true;
+}
+
+static struct dir_sect_t *_sect_put(struct disk_dir_t *v, const uint32_t lba,
+                                    const uint8_t *data, const bool pending) {
+  struct dir_sect_t *s = _sect_find(v, lba);
+  if (!s) {
+    uint32_t i = v->sect_free;
+    if (i != NONE) {
+      v->sect_free = v->sect[i].next;
+    }
+    else {
+      if (v->sect_count == v->sect_cap && !_sect_grow(v)) {
+        return NULL;
+      }
+      i = v->sect_count++;
+    }
+    s = v->sect + i;
+    s->lba = lba;
+    uint32_t *b = _sect_bucket(v, lba);
+    s->next = *b;
+    *b = i;
+  }
+  memcpy(s->data, data, 512);
+  s->pending = pending;
+  return s;
+}
+
+static void _sect_drop(struct disk_dir_t *v, struct dir_sect_t *s) {
+  const uint32_t i = (uint32_t)(s - v->sect);
+  uint32_t *p = _sect_bucket(v, s->lba);
+  while (*p != i) {
+    p = &v->sect[*p].next;
+  }
+  *p = s->next;
+  s->lba = NONE;
+  s->next = v->sect_free;
+  v->sect_free = i;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- directories
+
+static void _put16(uint8_t *p, const uint32_t x) {
+  p[0] = x & 0xff;
+  p[1] = (x >> 8) & 0xff;
+}
+
+static void _put32(uint8_t *p, const uint32_t x) {
+  _put16(p, x & 0xffff);
+  _put16(p + 2, x >> 16);
+}
+
+static uint32_t _get16(const uint8_t *p) {
+  return p[0] | (p[1] << 8);
+}
+
+static uint32_t _get32(const uint8_t *p) {
+  return _get16(p) | (_get16(p + 2) << 16);
+}
+
+// directory entry `i` of directory `d` as generated from its nodes
+static void _dir_entry(struct disk_dir_t *v, const uint32_t d,
+                       const uint32_t i, uint8_t *e) {
+  memset(e, 0, 32);
+  const struct dir_node_t *dir = v->node + d;
+  if (d && i < 2) {
+    // . and ..
+    memset(e, ' ', 11);
+    memset(e, '.', i + 1);
+    e[11] = ATTR_DIR;
+    _put16(e + 22, dir->time);
+    _put16(e + 24, dir->date);
+    const uint32_t p = dir->parent;
+    _put16(e + 26, i ? (p ? v->node[p].first : 0) : dir->first);
+    return;
+  }
+  const uint32_t n = (i < dir->slots) ? dir->slot[i] : NONE;
+  if (n == NONE) {
+    return;
+  }
+  const struct dir_node_t *node = v->node + n;
+  memcpy(e, node->short_name, 11);
+  e[11] = node->attr;
+  _put16(e + 22, node->time);
+  _put16(e + 24, node->date);
+  _put16(e + 26, node->first);
+  _put32(e + 28, node->size);
+}
+
+// remove node `n` from the guest view, the host file goes at flush
+static void _kill(struct disk_dir_t *v, const uint32_t n) {
+  if (v->open_node == n) {
+    _host_close(v);
+  }
+  v->node[n].state = NODE_DEAD;
+  v->chains_dirty = true;
+}
+
+static bool _same_name(const char *a, const char *b) {
+  for (; *a && *b; ++a, ++b) {
+    if (_short_char(*a) != _short_char(*b)) {
+      return false;
+    }
+  }
+  return *a == *b;
+}
+
+// a node the guest may be moving to `first`, live or deleted
+static uint32_t _find_first(struct disk_dir_t *v, const uint32_t first) {
+  for (uint32_t n = 1; n < v->nodes; ++n) {
+    const struct dir_node_t *node = v->node + n;
+    if (node->first == first && node->state != NODE_GONE) {
+      return n;
+    }
+  }
+  return NONE;
+}
+
+// forget the slot of node `n` in directory `d`
+static void _unslot(struct disk_dir_t *v, const uint32_t d, const uint32_t n) {
+  struct dir_node_t *dir = v->node + d;
+  for (uint32_t i = 0; i < dir->slots; ++i) {
+    if (dir->slot[i] == n) {
+      dir->slot[i] = NONE;
+    }
+  }
+}
+
+// give node `n` the name in entry `e` of directory `d` on the host
+static bool _rename(struct disk_dir_t *v, const uint32_t n, const uint32_t d,
+                    const uint8_t *e) {
+  char from[DIR_PATH_MAX], to[DIR_PATH_MAX], name[13];
+  if (!_short_text(e, name)) {
+    log_printf(LOG_CHAN_DISK, "ignoring invalid file name '%.11s'", e);
+    return false;
+  }
+  if (!_path(v, n, from)) {
+    return false;
+  }
+  struct dir_node_t *node = v->node + n;
+  char *copy = (char*)malloc(strlen(name) + 1);
+  if (!copy) {
+    return false;
+  }
+  strcpy(copy, name);
+  char *old_name = node->name;
+  const uint32_t old_parent = node->parent;
+  node->name = copy;
+  node->parent = d;
+  if (!_path(v, n, to) || (strcmp(from, to) && rename(from, to))) {
+    log_printf(LOG_CHAN_DISK, "unable to rename '%s' to '%s'", from, to);
+    node->name = old_name;
+    node->parent = old_parent;
+    free(copy);
+    return false;
+  }
+  free(old_name);
+  memcpy(node->short_name, e, 11);
+  return true;
+}
+
+static uint32_t _create(struct disk_dir_t *v, const uint32_t d,
+                        const uint8_t *e) {
+  char name[13], path[DIR_PATH_MAX];
+  if (!_short_text(e, name)) {
+    log_printf(LOG_CHAN_DISK, "ignoring invalid file name '%.11s'", e);
+    return NONE;
+  }
+  const uint32_t n = _node_add(v, d);
+  if (n == NONE) {
+    return NONE;
+  }
+  struct dir_node_t *node = v->node + n;
+  node->name = (char*)malloc(strlen(name) + 1);
+  if (!node->name) {
+    return NONE;
+  }
+  strcpy(node->name, name);
+  memcpy(node->short_name, e, 11);
+  node->attr = e[11];
+  if (!_path(v, n, path)) {
+    return NONE;
+  }
+  // a deleted file by the same name is replaced now rather than at flush
+  for (uint32_t i = 1; i < n; ++i) {
+    struct dir_node_t *old = v->node + i;
+    if (old->state == NODE_DEAD && old->parent == d &&
+        !(old->attr & ATTR_DIR) && _same_name(old->name, name)) {
+      char old_path[DIR_PATH_MAX];
+      if (_path(v, i, old_path)) {
+        remove(old_path);
+      }
+      old->state = NODE_GONE;
+    }
+  }
+  bool ok;
+  if (e[11] & ATTR_DIR) {
+    ok = _host_mkdir(path);
+  }
+  else {
+    FILE *fd = fopen(path, "wb");
+    ok = (fd != NULL);
+    if (fd) {
+      fclose(fd);
+    }
+  }
+  if (!ok) {
+    log_printf(LOG_CHAN_DISK, "unable to create host file '%s'", path);
+  }
+  return n;
+}
+
+// apply a changed directory entry `i` of directory `d` to the host
+static void _entry_changed(struct disk_dir_t *v, const uint32_t d,
+                           const uint32_t i, const uint8_t *e) {
+  uint32_t *s = _slot(v, d, i);
+  if (!s) {
+    return;
+  }
+  const uint8_t attr = e[11];
+  const bool valid = e[0] && e[0] != 0xe5 && e[0] != '.' &&
+                     (attr & ATTR_LFN) != ATTR_LFN && !(attr & ATTR_VOLUME);
+  if (!valid) {
+    if (*s != NONE) {
+      _kill(v, *s);
+      *s = NONE;
+    }
+    return;
+  }
+  const uint32_t first = _get16(e + 26);
+  uint32_t n = *s;
+  if (n == NONE) {
+    // an existing file given a new entry is being moved
+    const uint32_t m = first ? _find_first(v, first) : NONE;
+    const uint32_t from = (m != NONE) ? v->node[m].parent : NONE;
+    if (m != NONE && m != d && _rename(v, m, d, e)) {
+      if (v->node[m].state == NODE_LIVE) {
+        _unslot(v, from, m);
+      }
+      v->node[m].state = NODE_LIVE;
+      n = m;
+    }
+    else {
+      n = _create(v, d, e);
+      if (n == NONE) {
+        return;
+      }
+    }
+    *s = n;
+    v->chains_dirty = true;
+  }
+  else if (memcmp(v->node[n].short_name, e, 11)) {
+    _rename(v, n, d, e);
+  }
+  struct dir_node_t *node = v->node + n;
+  node->attr = attr;
+  node->time = _get16(e + 22);
+  node->date = _get16(e + 24);
+  if (node->first != first) {
+    node->first = first;
+    v->chains_dirty = true;
+  }
+  const uint32_t size = _get32(e + 28);
+  if (!(attr & ATTR_DIR) && node->size != size) {
+    if (size < node->size) {
+      FILE *fd = _host_file(v, n, true);
+      if (fd) {
+        fflush(fd);
+        _host_truncate(fd, size);
+      }
+    }
+    node->size = size;
+  }
+}
+
+// a directory sector written by the guest, `old` is what it held before
+static void _dir_write(struct disk_dir_t *v, const uint32_t d,
+                       const uint32_t base, const uint8_t *old,
+                       const uint8_t *data) {
+  for (uint32_t j = 0; j < 16; ++j) {
+    if (memcmp(old + j * 32, data + j * 32, 32)) {
+      _entry_changed(v, d, base + j, data + j * 32);
+    }
+  }
+}
+
+// first entry held in sector `s` of cluster `c` owned by a directory
+static uint32_t _dir_base(const struct disk_dir_t *v, const uint32_t c,
+                          const uint32_t s) {
+  return (v->pos[c] * v->spc + s) * 16;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- chains
+
+static void _chains(struct disk_dir_t *v) {
+  while (v->chains_dirty) {
+    v->chains_dirty = false;
+    _chains_walk(v);
+    // held sectors whose cluster now has an owner
+    for (uint32_t i = 0; i < v->sect_count; ++i) {
+      struct dir_sect_t *s = v->sect + i;
+      if (s->lba == NONE || s->lba < v->data_lba) {
+        continue;
+      }
+      const uint32_t rel = s->lba - v->data_lba;
+      const uint32_t c = rel / v->spc + 2;
+      if (c >= v->clusters + 2) {
+        continue;
+      }
+      const uint32_t n = v->owner[c];
+      if (n == NONE) {
+        if (!s->pending) {
+          // a directory cluster the guest let go
+          _sect_drop(v, s);
+        }
+        continue;
+      }
+      const struct dir_node_t *node = v->node + n;
+      if (node->attr & ATTR_DIR) {
+        if (s->pending) {
+          uint8_t zero[512];
+          memset(zero, 0, sizeof(zero));
+          s->pending = false;
+          _dir_write(v, n, _dir_base(v, c, rel % v->spc), zero, s->data);
+        }
+        continue;
+      }
+      if (s->pending) {
+        const uint64_t at = ((uint64_t)v->pos[c] * v->spc + rel % v->spc) * 512;
+        FILE *fd = _host_file(v, n, true);
+        if (!fd || !_disk_fseek(fd, at) || fwrite(s->data, 1, 512, fd) != 512) {
+          log_printf(LOG_CHAN_DISK, "unable to write to host file");
+        }
+        v->node[n].grown = true;
+      }
+      _sect_drop(v, s);
+    }
+  }
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- sectors
+
+static void _mbr(struct disk_dir_t *v, uint8_t *dst) {
+  dst[0] = 0xcd;  // int 18h, not bootable
+  dst[1] = 0x18;
+  uint8_t *p = dst + 0x1be;
+  const uint32_t start = v->part_lba;
+  const uint32_t end = v->part_lba + v->vol_sectors - 1;
+  const uint32_t spcyl = v->heads * v->sects;
+  const uint32_t ec = SDL_min(end / spcyl, 1023);
+  p[0] = 0x00;
+  p[1] = (start / v->sects) % v->heads;
+  p[2] = (start % v->sects) + 1;
+  p[3] = 0;
+  p[4] = (v->vol_sectors < 65536) ? 0x04 : 0x06;
+  p[5] = (end / v->sects) % v->heads;
+  p[6] = ((end % v->sects) + 1) | ((ec >> 2) & 0xc0);
+  p[7] = ec & 0xff;
+  _put32(p + 8, start);
+  _put32(p + 12, v->vol_sectors);
+  dst[510] = 0x55;
+  dst[511] = 0xaa;
+}
+
+static void _boot(struct disk_dir_t *v, uint8_t *dst) {
+  static const uint8_t jump[] = {0xeb, 0x3c, 0x90};
+  memcpy(dst, jump, 3);
+  memcpy(dst + 3, "FAKE86  ", 8);
+  _put16(dst + 11, 512);
+  dst[13] = (uint8_t)v->spc;
+  _put16(dst + 14, v->fat_lba - v->part_lba);
+  dst[16] = 2;
+  _put16(dst + 17, v->root_entries);
+  _put16(dst + 19, (v->vol_sectors < 65536) ? v->vol_sectors : 0);
+  dst[21] = v->media;
+  _put16(dst + 22, v->fat_sectors);
+  _put16(dst + 24, v->sects);
+  _put16(dst + 26, v->heads);
+  _put32(dst + 28, v->part_lba);
+  _put32(dst + 32, (v->vol_sectors < 65536) ? 0 : v->vol_sectors);
+  dst[36] = v->part_lba ? 0x80 : 0x00;
+  dst[38] = 0x29;
+  _put32(dst + 39, 0x86860000u | (v->nodes & 0xffff));
+  memcpy(dst + 43, "NO NAME    ", 11);
+  memcpy(dst + 54, (v->fat_bits == 12) ? "FAT12   " : "FAT16   ", 8);
+  dst[62] = 0xcd;  // int 18h, not bootable
+  dst[63] = 0x18;
+  dst[510] = 0x55;
+  dst[511] = 0xaa;
+}
+
+static bool _sect_read(struct disk_dir_t *v, const uint32_t lba, uint8_t *dst) {
+  if (lba >= v->fat_lba && lba < v->root_lba) {
+    const uint32_t s = (lba - v->fat_lba) % v->fat_sectors;
+    memcpy(dst, v->fat + s * 512, 512);
+    return true;
+  }
+  const struct dir_sect_t *held = _sect_find(v, lba);
+  if (held) {
+    memcpy(dst, held->data, 512);
+    return true;
+  }
+  memset(dst, 0, 512);
+  if (lba == 0 && v->part_lba) {
+    _mbr(v, dst);
+    return true;
+  }
+  if (lba == v->part_lba) {
+    _boot(v, dst);
+    return true;
+  }
+  if (lba >= v->root_lba && lba < v->data_lba) {
+    const uint32_t base = (lba - v->root_lba) * 16;
+    for (uint32_t j = 0; j < 16; ++j) {
+      _dir_entry(v, 0, base + j, dst + j * 32);
+    }
+    return true;
+  }
+  if (lba < v->data_lba) {
+    return true;
+  }
+  const uint32_t rel = lba - v->data_lba;
+  const uint32_t c = rel / v->spc + 2;
+  if (c >= v->clusters + 2) {
+    return true;
+  }
+  _chains(v);
+  const uint32_t n = v->owner[c];
+  if (n == NONE) {
+    return true;
+  }
+  const struct dir_node_t *node = v->node + n;
+  if (node->attr & ATTR_DIR) {
+    const uint32_t base = _dir_base(v, c, rel % v->spc);
+    for (uint32_t j = 0; j < 16; ++j) {
+      _dir_entry(v, n, base + j, dst + j * 32);
+    }
+    return true;
+  }
+  const uint64_t at = ((uint64_t)v->pos[c] * v->spc + rel % v->spc) * 512;
+  FILE *fd = _host_file(v, n, false);
+  if (!fd || !_disk_fseek(fd, at)) {
+    return false;
+  }
+  // past the end of the host file reads as zero
+  fread(dst, 1, 512, fd);
+  return true;
+}
+
+static void _sect_write(struct disk_dir_t *v, const uint32_t lba,
+                        const uint8_t *src) {
+  if (lba >= v->fat_lba && lba < v->root_lba) {
+    const uint32_t s = (lba - v->fat_lba) % v->fat_sectors;
+    if (memcmp(v->fat + s * 512, src, 512)) {
+      memcpy(v->fat + s * 512, src, 512);
+      v->chains_dirty = true;
+    }
+    return;
+  }
+  uint8_t old[512];
+  if (lba >= v->root_lba && lba < v->data_lba) {
+    _sect_read(v, lba, old);
+    _dir_write(v, 0, (lba - v->root_lba) * 16, old, src);
+    _sect_put(v, lba, src, false);
+    return;
+  }
+  if (lba < v->data_lba) {
+    _sect_put(v, lba, src, false);
+    return;
+  }
+  const uint32_t rel = lba - v->data_lba;
+  const uint32_t c = rel / v->spc + 2;
+  if (c >= v->clusters + 2) {
+    _sect_put(v, lba, src, false);
+    return;
+  }
+  _chains(v);
+  const uint32_t n = v->owner[c];
+  if (n == NONE) {
+    // held until the guest says which file it belongs to
+    _sect_put(v, lba, src, true);
+    return;
+  }
+  struct dir_node_t *node = v->node + n;
+  if (node->attr & ATTR_DIR) {
+    _sect_read(v, lba, old);
+    _dir_write(v, n, _dir_base(v, c, rel % v->spc), old, src);
+    _sect_put(v, lba, src, false);
+    return;
+  }
+  const uint64_t at = ((uint64_t)v->pos[c] * v->spc + rel % v->spc) * 512;
+  FILE *fd = _host_file(v, n, true);
+  if (!fd || !_disk_fseek(fd, at) || fwrite(src, 1, 512, fd) != 512) {
+    log_printf(LOG_CHAN_DISK, "unable to write to host file '%s'", node->name);
+    return;
+  }
+  node->grown = true;
+}
+
+// transfer bytes at `offset`, sectors written in part are read first
+static bool _dir_io(struct disk_dir_t *v, uint64_t offset, uint8_t *buf,
+                    uint32_t size, const bool write) {
+  if (offset > v->size_bytes || size > v->size_bytes - offset) {
+    return false;
+  }
+  while (size) {
+    const uint32_t lba = (uint32_t)(offset / 512);
+    const uint32_t within = offset % 512;
+    const uint32_t part = SDL_min(size, 512 - within);
+    if (part == 512) {
+      if (write) {
+        _sect_write(v, lba, buf);
+      }
+      else if (!_sect_read(v, lba, buf)) {
+        return false;
+      }
+    }
+    else {
+      uint8_t sector[512];
+      if (!_sect_read(v, lba, sector)) {
+        return false;
+      }
+      if (write) {
+        memcpy(sector + within, buf, part);
+        _sect_write(v, lba, sector);
+      }
+      else {
+        memcpy(buf, sector + within, part);
+      }
+    }
+    offset += part;
+    buf += part;
+    size -= part;
+  }
+  return true;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- delegates
+
+static bool _disk_dir_flush(void *self) {
+  assert(self);
+  struct disk_dir_t *v = (struct disk_dir_t*)self;
+  _chains(v);
+  bool ok = true;
+  // files first then directories, nodes follow the directory holding them
+  for (uint32_t i = 0; i < 2 * v->nodes; ++i) {
+    const bool files = (i < v->nodes);
+    const uint32_t n = files ? i : (2 * v->nodes - 1 - i);
+    struct dir_node_t *node = v->node + n;
+    if (n && node->state == NODE_DEAD &&
+        files == !(node->attr & ATTR_DIR)) {
+      char path[DIR_PATH_MAX];
+      if (v->open_node == n) {
+        _host_close(v);
+      }
+      if (_path(v, n, path)) {
+        const bool gone = files ? (remove(path) == 0) : _host_rmdir(path);
+        if (!gone) {
+          log_printf(LOG_CHAN_DISK, "unable to remove host file '%s'", path);
+        }
+      }
+      node->state = NODE_GONE;
+    }
+    if (files && n && node->state == NODE_LIVE && node->grown) {
+      // drop the tail of the last sector written
+      FILE *fd = _host_file(v, n, true);
+      ok &= fd && fflush(fd) == 0 && _host_truncate(fd, node->size);
+      node->grown = false;
+    }
+  }
+  if (v->open_fd) {
+    ok &= fflush(v->open_fd) == 0;
+  }
+  return ok;
+}
+
+static void _dir_free(struct disk_dir_t *v) {
+  _host_close(v);
+  for (uint32_t n = 0; n < v->nodes; ++n) {
+    free(v->node[n].name);
+    free(v->node[n].slot);
+  }
+  free(v->node);
+  free(v->fat);
+  free(v->owner);
+  free(v->pos);
+  free(v->sect);
+  free(v->sect_hash);
+  free(v->root);
+  free(v);
+}
+
+static bool _disk_dir_eject(void *self) {
+  assert(self);
+  struct disk_dir_t *v = (struct disk_dir_t*)self;
+  _disk_dir_flush(v);
+  _dir_free(v);
+  return true;
+}
+
+static bool _disk_dir_seek(void *self, const uint64_t offset) {
+  assert(self);
+  struct disk_dir_t *v = (struct disk_dir_t*)self;
+  if (offset > v->size_bytes) {
+    return false;
+  }
+  v->seek_pos = offset;
+  return true;
+}
+
+static bool _disk_dir_read(void *self, uint8_t *dst, const uint32_t count) {
+  assert(self);
+  struct disk_dir_t *v = (struct disk_dir_t*)self;
+  if (!_dir_io(v, v->seek_pos, dst, count, false)) {
+    return false;
+  }
+  v->seek_pos += count;
+  return true;
+}
+
+static bool _disk_dir_write(
+  void *self, const uint8_t *src, const uint32_t count) {
+  assert(self);
+  struct disk_dir_t *v = (struct disk_dir_t*)self;
+  if (!v->writable || !_dir_io(v, v->seek_pos, (uint8_t*)src, count, true)) {
+    return false;
+  }
+  v->seek_pos += count;
+  return true;
+}
+
+static bool _disk_dir_tell(void *self, uint64_t *out) {
+  assert(self && out);
+  struct disk_dir_t *v = (struct disk_dir_t*)self;
+  *out = v->seek_pos;
+  return true;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- open
+
+// pick a layout with room for every node, false if none fits
+static bool _layout(struct disk_dir_t *v, const bool floppy) {
+  if (floppy) {
+    // 1.44MB
+    v->part_lba = 0;
+    v->spc = 1;
+    v->root_entries = 224;
+    v->fat_sectors = 9;
+    v->vol_sectors = 2880;
+    v->media = 0xf0;
+    v->fat_bits = 12;
+    v->heads = 2;
+    v->sects = 18;
+  }
+  else {
+    v->part_lba = DIR_PART_LBA;
+    v->root_entries = 512;
+    v->media = 0xf8;
+    v->fat_bits = 16;
+    v->sects = 63;
+    uint32_t clusters = 0;
+    for (v->spc = 4; v->spc <= 64; v->spc *= 2) {
+      uint64_t used = DIR_FREE / (v->spc * 512);
+      for (uint32_t n = 0; n < v->nodes; ++n) {
+        used += _node_clusters(v, n);
+      }
+      if (used <= 65524) {
+        // fewer clusters than this would make it FAT12
+        clusters = SDL_max((uint32_t)used, 4085);
+        break;
+      }
+    }
+    if (!clusters) {
+      log_printf(LOG_CHAN_DISK, "directory too large for a FAT16 volume");
+      return false;
+    }
+    v->fat_sectors = ((clusters + 2) * 2 + 511) / 512;
+    v->vol_sectors = 1 + 2 * v->fat_sectors + v->root_entries / 16 +
+                     clusters * v->spc;
+  }
+  v->fat_lba = v->part_lba + 1;
+  v->root_lba = v->fat_lba + 2 * v->fat_sectors;
+  v->data_lba = v->root_lba + v->root_entries / 16;
+  v->clusters = (v->part_lba + v->vol_sectors - v->data_lba) / v->spc;
+  if (floppy) {
+    v->size_bytes = (uint64_t)v->vol_sectors * 512;
+    return true;
+  }
+  // whole cylinders of the geometry the disk will be given
+  uint64_t total = v->part_lba + v->vol_sectors;
+  uint32_t cyl = 16 * 63;
+  if (total / cyl > 1024) {
+    cyl = 255 * 63;
+  }
+  total = (total + cyl - 1) / cyl * cyl;
+  v->size_bytes = total * 512;
+  return true;
+}
+
+bool _disk_dir_open(
+  const uint8_t num, const char *path, const bool shared,
+  struct disk_info_t *out) {
+  assert(path && out);
+
+  struct disk_dir_t *v =
+    (struct disk_dir_t*)calloc(1, sizeof(struct disk_dir_t));
+  if (!v) {
+    return false;
+  }
+  v->open_node = NONE;
+  v->sect_free = NONE;
+  v->writable = shared;
+  v->root = (char*)malloc(strlen(path) + 1);
+  if (!v->root || _node_add(v, 0) != 0) {
+    goto error;
+  }
+  strcpy(v->root, path);
+  v->node[0].attr = ATTR_DIR;
+
+  // nodes are added after the directory holding them
+  for (uint32_t n = 0; n < v->nodes; ++n) {
+    if ((v->node[n].attr & ATTR_DIR) && !_scan(v, n)) {
+      log_printf(LOG_CHAN_DISK, "unable to read directory '%s'",
+                 n ? v->node[n].name : path);
+      if (n == 0) {
+        goto error;
+      }
+      // shown empty
+      v->node[n].size = 2;
+    }
+  }
+  if (v->node[0].size > (num < 128 ? 224u : 512u)) {
+    log_printf(LOG_CHAN_DISK, "too many files in '%s' for a root directory",
+               path);
+    goto error;
+  }
+  if (!_layout(v, num < 128)) {
+    goto error;
+  }
+
+  const uint32_t end = v->clusters + 2;
+  v->fat = (uint8_t*)calloc(v->fat_sectors, 512);
+  v->owner = (uint32_t*)malloc(end * sizeof(uint32_t));
+  v->pos = (uint32_t*)malloc(end * sizeof(uint32_t));
+  if (!v->fat || !v->owner || !v->pos || !_sect_grow(v)) {
+    goto error;
+  }
+  _fat_set(v, 0, 0xff00 | v->media);
+  _fat_set(v, 1, 0xffff);
+  uint32_t next = 2;
+  for (uint32_t n = 1; n < v->nodes; ++n) {
+    _fat_chain(v, n, _node_clusters(v, n), &next);
+  }
+  if (next > end) {
+    log_printf(LOG_CHAN_DISK, "'%s' does not fit on the disk", path);
+    goto error;
+  }
+  v->chains_dirty = true;
+  _chains(v);
+
+  // populate disk structure
+  out->self   = v;
+  out->eject  = _disk_dir_eject;
+  out->seek   = _disk_dir_seek;
+  out->read   = _disk_dir_read;
+  out->write  = _disk_dir_write;
+  out->tell   = _disk_dir_tell;
+  out->flush  = _disk_dir_flush;
+
+  out->drive_num = num;
+  out->size_bytes = v->size_bytes;
+  // guest writes reach the host straight away, no block cache
+  out->in_memory = true;
+  out->read_only = !shared;
+
+  const bool ok = (num >= 128) ? _geom_hard_disk(out) : _geom_floppy_disk(out);
+  v->heads = out->heads;
+  log_printf(LOG_CHAN_DISK, "'%s' mounted, %u files and directories",
+             path, v->nodes - 1);
+  return ok;
+
+error:
+  _dir_free(v);
+  return false;
+}
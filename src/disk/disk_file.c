@@ -0,0 +1,56 @@
+/*
+  Fake86: A portable, open-source 8086 PC emulator.
+  Copyright (C)2010-2013 Mike Chambers
+               2019      Aidan Dodds
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+  USA.
+*/
+
+// stdio helpers shared by the backends and pack.c
+//
+// kept apart from the backends so tools can link them without the emulator.
+
+#include <stdio.h>
+
+#include "disk.h"
+
+
+bool _disk_fseek(FILE *fd, const uint64_t offset) {
+#ifdef _MSC_VER
+  return _fseeki64(fd, (__int64)offset, SEEK_SET) == 0;
+#else
+  return fseeko(fd, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+bool _disk_fsize(FILE *fd, uint64_t *out) {
+#ifdef _MSC_VER
+  if (_fseeki64(fd, 0, SEEK_END)) {
+    return false;
+  }
+  const __int64 size = _ftelli64(fd);
+#else
+  if (fseeko(fd, 0, SEEK_END)) {
+    return false;
+  }
+  const off_t size = ftello(fd);
+#endif
+  if (size < 0) {
+    return false;
+  }
+  *out = (uint64_t)size;
+  return true;
+}
@@ -0,0 +1,271 @@
+/*
+  Fake86: A portable, open-source 8086 PC emulator.
+  Copyright (C)2010-2013 Mike Chambers
+               2019      Aidan Dodds
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+  USA.
+*/
+
+// memory mapped raw disk images
+//
+// a shared mapping writes guest changes back to the image. a private mapping
+// opens the image read only and refuses guest writes as the other backends
+// do, so any number of instances can run from one base image while sharing
+// its page cache. an overlay keeps their changes.
+
+#include "disk.h"
+
+#if USE_DISK_MMAP
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+struct disk_mmap_t {
+  uint8_t *data;
+  uint64_t size;
+  uint64_t seek_pos;
+  bool shared;
+#ifdef _WIN32
+  HANDLE file, map;
+#else
+  int fd;
+#endif
+};
+
+static bool _disk_mmap_flush(void *self) {
+  assert(self);
+  struct disk_mmap_t *m = (struct disk_mmap_t*)self;
+  if (!m->shared) {
+    return true;
+  }
+#ifdef _WIN32
+  return FlushViewOfFile(m->data, 0) && FlushFileBuffers(m->file);
+#else
+  return msync(m->data, (size_t)m->size, MS_SYNC) == 0;
+#endif
+}
+
+static bool _disk_mmap_eject(void *self) {
+  assert(self);
+  struct disk_mmap_t *m = (struct disk_mmap_t*)self;
+  _disk_mmap_flush(m);
+#ifdef _WIN32
+  UnmapViewOfFile(m->data);
+  CloseHandle(m->map);
+  CloseHandle(m->file);
+#else
+  munmap(m->data, (size_t)m->size);
+  close(m->fd);
+#endif
+  free(m);
+  return true;
+}
+
+static bool _disk_mmap_seek(void *self, const uint64_t offset) {
+  assert(self);
+  struct disk_mmap_t *m = (struct disk_mmap_t*)self;
+  if (offset > m->size) {
+    return false;
+  }
+  m->seek_pos = offset;
+  return true;
+}
+
+static bool _disk_mmap_read(void *self, uint8_t *dst, const uint32_t count) {
+  assert(self);
+  struct disk_mmap_t *m = (struct disk_mmap_t*)self;
+  if (count > m->size - m->seek_pos) {
+    return false;
+  }
+  memcpy(dst, m->data + m->seek_pos, count);
+  m->seek_pos += count;
+  return true;
+}
+
+static bool _disk_mmap_write(
+  void *self, const uint8_t *src, const uint32_t count) {
+  assert(self);
+  struct disk_mmap_t *m = (struct disk_mmap_t*)self;
+  if (!m->shared || count > m->size - m->seek_pos) {
+    return false;
+  }
+  memcpy(m->data + m->seek_pos, src, count);
+  m->seek_pos += count;
+  return true;
+}
+
+static bool _disk_mmap_tell(void *self, uint64_t *out) {
+  assert(self && out);
+  struct disk_mmap_t *m = (struct disk_mmap_t*)self;
+  *out = m->seek_pos;
+  return true;
+}
+
+// sector access is a copy to or from the mapping
+static bool _disk_mmap_readv(
+  void *self, const uint64_t offset,
+  const struct disk_iov_t *iov, const uint32_t count) {
+  assert(self);
+  struct disk_mmap_t *m = (struct disk_mmap_t*)self;
+  uint64_t pos = offset;
+  for (uint32_t i = 0; i < count; ++i) {
+    if (pos > m->size || iov[i].size > m->size - pos) {
+      return false;
+    }
+    memcpy(iov[i].base, m->data + pos, iov[i].size);
+    pos += iov[i].size;
+  }
+  m->seek_pos = pos;
+  return true;
+}
+
+static bool _disk_mmap_writev(
+  void *self, const uint64_t offset,
+  const struct disk_iov_t *iov, const uint32_t count) {
+  assert(self);
+  struct disk_mmap_t *m = (struct disk_mmap_t*)self;
+  if (!m->shared) {
+    return false;
+  }
+  uint64_t pos = offset;
+  for (uint32_t i = 0; i < count; ++i) {
+    if (pos > m->size || iov[i].size > m->size - pos) {
+      return false;
+    }
+    memcpy(m->data + pos, iov[i].base, iov[i].size);
+    pos += iov[i].size;
+  }
+  m->seek_pos = pos;
+  return true;
+}
+
+// map the whole image, false leaves `m` untouched
+static bool _map(struct disk_mmap_t *m, const char *path, const bool shared) {
+#ifdef _WIN32
+  const DWORD access = GENERIC_READ | (shared ? GENERIC_WRITE : 0);
+  HANDLE file = CreateFileA(path, access, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                            NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  LARGE_INTEGER size;
+  // an image larger than the address space goes through stdio instead
+  if (!GetFileSizeEx(file, &size) || size.QuadPart == 0 ||
+      (uint64_t)size.QuadPart > (uint64_t)SIZE_MAX) {
+    CloseHandle(file);
+    return false;
+  }
+  HANDLE map = CreateFileMappingA(file, NULL,
+                                  shared ? PAGE_READWRITE : PAGE_WRITECOPY,
+                                  0, 0, NULL);
+  if (!map) {
+    CloseHandle(file);
+    return false;
+  }
+  void *data = MapViewOfFile(map, shared ? FILE_MAP_WRITE : FILE_MAP_COPY,
+                             0, 0, 0);
+  if (!data) {
+    CloseHandle(map);
+    CloseHandle(file);
+    return false;
+  }
+  m->file = file;
+  m->map = map;
+  m->size = (uint64_t)size.QuadPart;
+#else
+  const int fd = open(path, shared ? O_RDWR : O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0 ||
+      (uint64_t)st.st_size > (uint64_t)SIZE_MAX) {
+    close(fd);
+    return false;
+  }
+  void *data = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE,
+                    shared ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED) {
+    close(fd);
+    return false;
+  }
+  m->fd = fd;
+  m->size = (uint64_t)st.st_size;
+#endif
+  m->data = (uint8_t*)data;
+  m->shared = shared;
+  return true;
+}
+
+bool _disk_mmap_open(
+  const uint8_t num, const char *path, const bool shared,
+  struct disk_info_t *out) {
+  assert(path && out);
+
+  struct disk_mmap_t *m =
+    (struct disk_mmap_t*)calloc(1, sizeof(struct disk_mmap_t));
+  if (!m) {
+    return false;
+  }
+  if (!_map(m, path, shared)) {
+    free(m);
+    return false;
+  }
+
+  // populate disk structure
+  out->self   = m;
+  out->eject  = _disk_mmap_eject;
+  out->seek   = _disk_mmap_seek;
+  out->read   = _disk_mmap_read;
+  out->write  = _disk_mmap_write;
+  out->tell   = _disk_mmap_tell;
+  out->readv  = _disk_mmap_readv;
+  out->writev = _disk_mmap_writev;
+  out->flush  = _disk_mmap_flush;
+
+  out->drive_num = num;
+  out->size_bytes = m->size;
+  out->in_memory = true;
+  out->read_only = !shared;
+
+  const bool known = (num >= 128) ? _geom_hard_disk(out)
+                                  : _geom_floppy_disk(out);
+  if (!known) {
+    // leave nothing behind for a fallback backend to overwrite
+    _disk_mmap_eject(m);
+    memset(out, 0, sizeof(*out));
+    return false;
+  }
+  return true;
+}
+
+#else  // USE_DISK_MMAP
+
+bool _disk_mmap_open(
+  const uint8_t num, const char *path, const bool shared,
+  struct disk_info_t *out) {
+  return false;
+}
+
+#endif  // USE_DISK_MMAP
@@ -0,0 +1,260 @@
+/*
+  Fake86: A portable, open-source 8086 PC emulator.
+  Copyright (C)2010-2013 Mike Chambers
+               2019      Aidan Dodds
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+  USA.
+*/
+
+// packed image backend
+//
+// the index is held in memory along with the last few blocks decompressed,
+// zero blocks are never read from the file. packed images are read only,
+// run them under an overlay to write to them.
+
+#include <stdio.h>
+
+#include "disk.h"
+
+
+// decompressed blocks kept
+#define PACK_CACHED 8
+
+#define NONE 0xffffffffu
+
+struct pack_slot_t {
+  uint32_t block;
+  // larger is more recently used
+  uint32_t stamp;
+};
+
+struct disk_pack_t {
+  FILE *fd;
+  struct pack_header_t head;
+  struct pack_index_t *index;
+  uint64_t seek_pos;
+  uint32_t stamp;
+  struct pack_slot_t slot[PACK_CACHED];
+  uint8_t *data;
+  // compressed block being read
+  uint8_t *packed;
+};
+
+static uint32_t _block_len(const struct disk_pack_t *p, const uint32_t blk) {
+  return (uint32_t)SDL_min(PACK_BLOCK,
+                           p->head.size - (uint64_t)blk * PACK_BLOCK);
+}
+
+// decompressed contents of block `blk`
+static const uint8_t *_block(struct disk_pack_t *p, const uint32_t blk) {
+  uint32_t lru = 0;
+  for (uint32_t i = 0; i < PACK_CACHED; ++i) {
+    if (p->slot[i].block == blk) {
+      p->slot[i].stamp = ++p->stamp;
+      return p->data + i * PACK_BLOCK;
+    }
+    if (p->slot[i].stamp < p->slot[lru].stamp) {
+      lru = i;
+    }
+  }
+  const struct pack_index_t *x = p->index + blk;
+  const uint32_t len = _block_len(p, blk);
+  uint8_t *dst = p->data + lru * PACK_BLOCK;
+  p->slot[lru].block = NONE;
+  if (!_disk_fseek(p->fd, x->offset)) {
+    return NULL;
+  }
+  if (x->length == len) {
+    // stored
+    if (fread(dst, 1, len, p->fd) != len) {
+      return NULL;
+    }
+  }
+  else {
+    if (fread(p->packed, 1, x->length, p->fd) != x->length ||
+        !lz_decompress(p->packed, x->length, dst, len)) {
+      log_printf(LOG_CHAN_DISK, "packed block %u is corrupt", blk);
+      return NULL;
+    }
+  }
+  p->slot[lru].block = blk;
+  p->slot[lru].stamp = ++p->stamp;
+  return dst;
+}
+
+static bool _pack_read(struct disk_pack_t *p, uint64_t offset, uint8_t *dst,
+                       uint32_t size) {
+  if (offset > p->head.size || size > p->head.size - offset) {
+    return false;
+  }
+  while (size) {
+    const uint32_t blk = (uint32_t)(offset / PACK_BLOCK);
+    const uint32_t within = offset % PACK_BLOCK;
+    const uint32_t part = SDL_min(size, PACK_BLOCK - within);
+    if (p->index[blk].length == 0) {
+      memset(dst, 0, part);
+    }
+    else {
+      const uint8_t *src = _block(p, blk);
+      if (!src) {
+        return false;
+      }
+      memcpy(dst, src + within, part);
+    }
+    offset += part;
+    dst += part;
+    size -= part;
+  }
+  return true;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- delegates
+
+static void _pack_free(struct disk_pack_t *p) {
+  if (p->fd) {
+    fclose(p->fd);
+  }
+  free(p->index);
+  free(p->data);
+  free(p->packed);
+  free(p);
+}
+
+static bool _disk_pack_eject(void *self) {
+  assert(self);
+  _pack_free((struct disk_pack_t*)self);
+  return true;
+}
+
+static bool _disk_pack_seek(void *self, const uint64_t offset) {
+  assert(self);
+  struct disk_pack_t *p = (struct disk_pack_t*)self;
+  if (offset > p->head.size) {
+    return false;
+  }
+  p->seek_pos = offset;
+  return true;
+}
+
+static bool _disk_pack_read(void *self, uint8_t *dst, const uint32_t count) {
+  assert(self);
+  struct disk_pack_t *p = (struct disk_pack_t*)self;
+  if (!_pack_read(p, p->seek_pos, dst, count)) {
+    return false;
+  }
+  p->seek_pos += count;
+  return true;
+}
+
+static bool _disk_pack_write(
+  void *self, const uint8_t *src, const uint32_t count) {
+  (void)self;
+  (void)src;
+  (void)count;
+  // read only
+  return false;
+}
+
+static bool _disk_pack_tell(void *self, uint64_t *out) {
+  assert(self && out);
+  struct disk_pack_t *p = (struct disk_pack_t*)self;
+  *out = p->seek_pos;
+  return true;
+}
+
+static bool _disk_pack_readv(
+  void *self, const uint64_t offset,
+  const struct disk_iov_t *iov, const uint32_t count) {
+  assert(self);
+  struct disk_pack_t *p = (struct disk_pack_t*)self;
+  p->seek_pos = offset;
+  for (uint32_t i = 0; i < count; ++i) {
+    if (!_disk_pack_read(p, iov[i].base, iov[i].size)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool _disk_pack_open(
+  const uint8_t num, const char *path, struct disk_info_t *out) {
+  assert(path && out);
+
+  struct disk_pack_t *p =
+    (struct disk_pack_t*)calloc(1, sizeof(struct disk_pack_t));
+  if (!p) {
+    return false;
+  }
+  p->fd = fopen(path, "rb");
+  if (!p->fd) {
+    log_printf(LOG_CHAN_DISK, "unable to open packed image '%s'", path);
+    goto error;
+  }
+  struct pack_header_t *h = &p->head;
+  if (fread(h, sizeof(*h), 1, p->fd) != 1 ||
+      memcmp(h->magic, PACK_MAGIC, 8) ||
+      h->version != PACK_VERSION ||
+      h->block_size != PACK_BLOCK ||
+      h->size == 0 ||
+      h->blocks != (h->size - 1) / PACK_BLOCK + 1) {
+    log_printf(LOG_CHAN_DISK, "'%s' is not a valid packed image", path);
+    goto error;
+  }
+  p->index = (struct pack_index_t*)malloc(h->blocks * sizeof(*p->index) + 1);
+  p->data = (uint8_t*)malloc(PACK_CACHED * PACK_BLOCK);
+  p->packed = (uint8_t*)malloc(PACK_BLOCK);
+  if (!p->index || !p->data || !p->packed ||
+      fread(p->index, sizeof(*p->index), h->blocks, p->fd) != h->blocks) {
+    log_printf(LOG_CHAN_DISK, "unable to read packed image index");
+    goto error;
+  }
+  for (uint32_t i = 0; i < h->blocks; ++i) {
+    // a compressed block is never larger than it was to begin with
+    if (p->index[i].length > _block_len(p, i)) {
+      log_printf(LOG_CHAN_DISK, "packed image index is corrupt");
+      goto error;
+    }
+  }
+  for (uint32_t i = 0; i < PACK_CACHED; ++i) {
+    p->slot[i].block = NONE;
+  }
+
+  // populate disk structure
+  out->self  = p;
+  out->eject = _disk_pack_eject;
+  out->seek  = _disk_pack_seek;
+  out->read  = _disk_pack_read;
+  out->write = _disk_pack_write;
+  out->tell  = _disk_pack_tell;
+  out->readv = _disk_pack_readv;
+
+  out->drive_num = num;
+  out->size_bytes = h->size;
+  // decompressed blocks are cached here
+  out->in_memory = true;
+  out->read_only = true;
+
+  if (num >= 128) {
+    return _geom_hard_disk(out);
+  }
+  else {
+    return _geom_floppy_disk(out);
+  }
+
+error:
+  _pack_free(p);
+  return false;
+}
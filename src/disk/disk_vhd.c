@@ -0,0 +1,691 @@
+/*
+  Fake86: A portable, open-source 8086 PC emulator.
+  Copyright (C)2010-2013 Mike Chambers
+               2019      Aidan Dodds
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+  USA.
+*/
+
+// virtual pc disk images
+//
+// fixed disks hold the raw sectors followed by a footer. dynamic disks map
+// fixed size blocks through a block allocation table (BAT), each allocated
+// block starting with a bitmap of the sectors written to it. unallocated
+// blocks read as zero. differencing disks are dynamic disks on top of a
+// parent image, where sectors not marked in the bitmap come from the parent.
+//
+// all fields are big endian. the BAT is held in memory along with the bitmap
+// of the last block used, blocks are allocated on first write by moving the
+// footer along to the end of the file.
+//
+// see: Virtual Hard Disk Image Format Specification, Microsoft, 2006
+
+#include <stdio.h>
+
+#include "disk.h"
+
+
+enum {
+  VHD_FIXED = 2,
+  VHD_DYNAMIC = 3,
+  VHD_DIFFERENCING = 4,
+};
+
+// longest parent chain followed
+#define VHD_DEPTH_MAX 8
+// largest block table accepted, 64MB
+#define VHD_ENTRIES_MAX (1u << 24)
+
+#define VHD_UNUSED 0xffffffffu
+
+struct vhd_footer_t {
+
+  // "conectix"
+  char cookie[8];
+
+  // 0  - No features enabled
+  // 1  - Temporary
+  // 2  - Reserved
+  uint32_t features;
+
+  // should be 0x00010000
+  uint32_t version;
+
+  // 0xFFFFFFFF for fixed disks
+  uint64_t offset;
+  uint32_t timestamp;
+
+  // "vs  "  - virtual server
+  // "vpc "  - virtual pc
+  uint32_t creat_app;
+  uint32_t creat_ver;
+  uint32_t creat_os;
+  uint64_t orig_size;
+
+  // size of hard drive in bytes
+  uint64_t size;
+
+  // byte 0-1  - cylinders
+  // byte 2    - heads
+  // byte 3    - sectors
+  uint8_t geometry[4];
+
+  // 2  - fixed disk
+  // 3  - dynamic disk
+  // 4  - differencing disk
+  uint32_t type;
+
+  // inverted sum of hard disk footer bytes (without checksum)
+  uint32_t checksum;
+  uint8_t  uuid[16];
+  uint8_t  state;
+
+  // should be 427 bytes reserved after this
+};
+
+struct vhd_locator_t {
+  // "W2ku" absolute and "W2ru" relative utf-16 windows paths
+  uint32_t code;
+  uint32_t space;
+  uint32_t length;
+  uint32_t reserved;
+  uint64_t offset;
+};
+
+// dynamic disk header, found at the footer offset
+struct vhd_header_t {
+  // "cxsparse"
+  char cookie[8];
+  uint64_t data_offset;
+  // file offset of the BAT
+  uint64_t table_offset;
+  uint32_t version;
+  uint32_t max_entries;
+  // bytes per block, 2MB by default
+  uint32_t block_size;
+  uint32_t checksum;
+  uint8_t  parent_uuid[16];
+  uint32_t parent_timestamp;
+  uint32_t reserved;
+  // utf-16 big endian
+  uint16_t parent_name[256];
+  struct vhd_locator_t locator[8];
+  uint8_t  reserved2[256];
+};
+
+struct vhd_t {
+  FILE *fd;
+  uint32_t type;
+  uint64_t size;
+  uint64_t seek_pos;
+  // raw footer, rewritten after each newly allocated block
+  uint8_t footer[512];
+  uint8_t uuid[16];
+  // file offset of the footer, where the next block goes
+  uint64_t file_end;
+  // BAT in host byte order
+  uint32_t *bat;
+  uint32_t entries;
+  uint64_t bat_offset;
+  uint32_t block_size;
+  uint32_t bitmap_size;
+  // bitmap of block `bitmap_block`
+  uint8_t *bitmap;
+  uint32_t bitmap_block;
+  struct vhd_t *parent;
+  bool writable;
+};
+
+static void _endian(void *ptr, uint32_t size) {
+  uint8_t* x = (uint8_t*)ptr;
+  uint8_t* y = x + (size - 1);
+  for (; x < y; ++x, --y) {
+    const uint8_t t = *x;
+    *x = *y;
+    *y = t;
+  }
+}
+
+static bool _file_io(FILE *fd, const uint64_t offset, uint8_t *buf,
+                     const uint32_t size, const bool write) {
+  if (!_disk_fseek(fd, offset)) {
+    return false;
+  }
+  if (write) {
+    return fwrite(buf, 1, size, fd) == size;
+  }
+  return fread(buf, 1, size, fd) == size;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- blocks
+
+static bool _bit(const uint8_t *map, const uint32_t i) {
+  return (map[i / 8] >> (7 - (i & 7))) & 1;
+}
+
+static bool _load_bitmap(struct vhd_t *v, const uint32_t blk) {
+  if (v->bitmap_block == blk) {
+    return true;
+  }
+  v->bitmap_block = VHD_UNUSED;
+  const uint64_t at = (uint64_t)v->bat[blk] * 512;
+  if (!_file_io(v->fd, at, v->bitmap, v->bitmap_size, false)) {
+    return false;
+  }
+  v->bitmap_block = blk;
+  return true;
+}
+
+static bool _vhd_read(struct vhd_t *v, uint64_t offset, uint8_t *dst,
+                      uint32_t size);
+
+// sectors of a block not held in this disk
+static bool _read_below(struct vhd_t *v, const uint64_t offset, uint8_t *dst,
+                        const uint32_t size) {
+  if (v->parent) {
+    return _vhd_read(v->parent, offset, dst, size);
+  }
+  memset(dst, 0, size);
+  return true;
+}
+
+static bool _vhd_read(struct vhd_t *v, uint64_t offset, uint8_t *dst,
+                      uint32_t size) {
+  if (offset > v->size || size > v->size - offset) {
+    return false;
+  }
+  if (v->type == VHD_FIXED) {
+    return _file_io(v->fd, offset, dst, size, false);
+  }
+  while (size) {
+    const uint32_t blk = (uint32_t)(offset / v->block_size);
+    const uint32_t within = offset % v->block_size;
+    uint32_t part = SDL_min(size, v->block_size - within);
+    if (v->bat[blk] == VHD_UNUSED) {
+      if (!_read_below(v, offset, dst, part)) {
+        return false;
+      }
+    }
+    else {
+      const uint64_t data = (uint64_t)v->bat[blk] * 512 + v->bitmap_size;
+      bool here = true;
+      if (v->parent) {
+        // run of sectors all held here or all in the parent
+        if (!_load_bitmap(v, blk)) {
+          return false;
+        }
+        const uint32_t first = within / 512;
+        const uint32_t last = (within + part - 1) / 512;
+        here = _bit(v->bitmap, first);
+        uint32_t s = first + 1;
+        while (s <= last && _bit(v->bitmap, s) == here) {
+          ++s;
+        }
+        part = SDL_min(part, s * 512 - within);
+      }
+      const bool ok = here ?
+        _file_io(v->fd, data + within, dst, part, false) :
+        _read_below(v, offset, dst, part);
+      if (!ok) {
+        return false;
+      }
+    }
+    offset += part;
+    dst += part;
+    size -= part;
+  }
+  return true;
+}
+
+// add a block at the end of the file and move the footer after it
+static bool _alloc_block(struct vhd_t *v, const uint32_t blk) {
+  const uint64_t at = v->file_end;
+  const uint64_t end = at + v->bitmap_size + v->block_size;
+  // the BAT holds sector numbers
+  if ((end + 512) / 512 >= VHD_UNUSED) {
+    log_printf(LOG_CHAN_DISK, "VHD file too large to grow");
+    return false;
+  }
+  // the unwritten data between reads back as zero
+  memset(v->bitmap, 0, v->bitmap_size);
+  v->bitmap_block = VHD_UNUSED;
+  if (!_file_io(v->fd, end, v->footer, 512, true) ||
+      !_file_io(v->fd, at, v->bitmap, v->bitmap_size, true)) {
+    return false;
+  }
+  uint32_t entry = (uint32_t)(at / 512);
+  v->bat[blk] = entry;
+  _endian(&entry, 4);
+  if (!_file_io(v->fd, v->bat_offset + blk * 4, (uint8_t*)&entry, 4, true)) {
+    return false;
+  }
+  v->file_end = end;
+  v->bitmap_block = blk;
+  return true;
+}
+
+// mark sectors as held in this disk, copying up the rest of any partly
+// written sector from the parent first
+static bool _mark_sectors(struct vhd_t *v, const uint32_t blk,
+                          const uint32_t within, const uint32_t part) {
+  if (!_load_bitmap(v, blk)) {
+    return false;
+  }
+  const uint64_t data = (uint64_t)v->bat[blk] * 512 + v->bitmap_size;
+  const uint32_t first = within / 512;
+  const uint32_t last = (within + part - 1) / 512;
+  bool dirty = false;
+  for (uint32_t s = first; s <= last; ++s) {
+    if (_bit(v->bitmap, s)) {
+      continue;
+    }
+    const bool partial = (s == first && (within % 512)) ||
+                         (s == last && ((within + part) % 512));
+    if (partial) {
+      uint8_t sector[512];
+      const uint64_t offset = (uint64_t)blk * v->block_size + s * 512;
+      if (!_read_below(v, offset, sector, 512) ||
+          !_file_io(v->fd, data + s * 512, sector, 512, true)) {
+        return false;
+      }
+    }
+    v->bitmap[s / 8] |= 0x80 >> (s & 7);
+    dirty = true;
+  }
+  if (dirty) {
+    const uint64_t at = (uint64_t)v->bat[blk] * 512;
+    return _file_io(v->fd, at, v->bitmap, v->bitmap_size, true);
+  }
+  return true;
+}
+
+static bool _vhd_write(struct vhd_t *v, uint64_t offset, const uint8_t *src,
+                       uint32_t size) {
+  if (offset > v->size || size > v->size - offset) {
+    return false;
+  }
+  if (v->type == VHD_FIXED) {
+    return _file_io(v->fd, offset, (uint8_t*)src, size, true);
+  }
+  while (size) {
+    const uint32_t blk = (uint32_t)(offset / v->block_size);
+    const uint32_t within = offset % v->block_size;
+    const uint32_t part = SDL_min(size, v->block_size - within);
+    if (v->bat[blk] == VHD_UNUSED && !_alloc_block(v, blk)) {
+      return false;
+    }
+    if (!_mark_sectors(v, blk, within, part)) {
+      return false;
+    }
+    const uint64_t data = (uint64_t)v->bat[blk] * 512 + v->bitmap_size;
+    if (!_file_io(v->fd, data + within, (uint8_t*)src, part, true)) {
+      return false;
+    }
+    offset += part;
+    src += part;
+    size -= part;
+  }
+  return true;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- open
+
+static void _vhd_free(struct vhd_t *v) {
+  while (v) {
+    struct vhd_t *parent = v->parent;
+    if (v->fd) {
+      fclose(v->fd);
+    }
+    free(v->bat);
+    free(v->bitmap);
+    free(v);
+    v = parent;
+  }
+}
+
+static struct vhd_t *_vhd_open(const char *path, const bool writable,
+                               const uint32_t depth);
+
+// utf-16 path to utf-8 with the host separator
+static void _utf16_path(char *out, const uint32_t out_size,
+                        const uint8_t *src, const uint32_t units,
+                        const bool big_endian) {
+  uint32_t n = 0;
+  for (uint32_t i = 0; i < units; ++i) {
+    const uint32_t c = big_endian ?
+      ((src[i * 2] << 8) | src[i * 2 + 1]) :
+      (src[i * 2] | (src[i * 2 + 1] << 8));
+    if (c == 0 || n + 4 >= out_size) {
+      break;
+    }
+    if (c < 0x80) {
+#ifdef _WIN32
+      out[n++] = (char)c;
+#else
+      out[n++] = (c == '\\') ? '/' : (char)c;
+#endif
+    }
+    else if (c < 0x800) {
+      out[n++] = (char)(0xc0 | (c >> 6));
+      out[n++] = (char)(0x80 | (c & 0x3f));
+    }
+    else {
+      out[n++] = (char)(0xe0 | (c >> 12));
+      out[n++] = (char)(0x80 | ((c >> 6) & 0x3f));
+      out[n++] = (char)(0x80 | (c & 0x3f));
+    }
+  }
+  out[n] = '\0';
+}
+
+// prefix `name` with the directory of `path`
+static void _sibling(char *out, const uint32_t out_size, const char *path,
+                     const char *name) {
+  const char *slash = strrchr(path, '/');
+#ifdef _WIN32
+  const char *bslash = strrchr(path, '\\');
+  slash = (bslash > slash) ? bslash : slash;
+#endif
+  const int dir = slash ? (int)(slash - path + 1) : 0;
+  // drop a leading ".\" from relative locators
+  if (name[0] == '.' && (name[1] == '/' || name[1] == '\\')) {
+    name += 2;
+  }
+  snprintf(out, out_size, "%.*s%s", dir, path, name);
+}
+
+static struct vhd_t *_open_parent(const char *path,
+                                  const struct vhd_header_t *h,
+                                  const uint32_t depth) {
+  char name[1024], cand[1024];
+  // try the relative then absolute locators, then the parent name
+  const uint32_t codes[] = {0x57327275 /* W2ru */, 0x57326b75 /* W2ku */};
+  for (uint32_t c = 0; c < 2; ++c) {
+    for (uint32_t i = 0; i < 8; ++i) {
+      const struct vhd_locator_t *l = h->locator + i;
+      if (l->code != codes[c] || l->length == 0 || l->length > 1024) {
+        continue;
+      }
+      uint8_t raw[1024];
+      FILE *fd = fopen(path, "rb");
+      const bool ok = fd && _file_io(fd, l->offset, raw, l->length, false);
+      if (fd) {
+        fclose(fd);
+      }
+      if (!ok) {
+        continue;
+      }
+      _utf16_path(name, sizeof(name), raw, l->length / 2, false);
+      if (codes[c] == 0x57327275) {
+        _sibling(cand, sizeof(cand), path, name);
+      }
+      else {
+        snprintf(cand, sizeof(cand), "%s", name);
+      }
+      struct vhd_t *p = _vhd_open(cand, false, depth + 1);
+      if (p) {
+        return p;
+      }
+    }
+  }
+  _utf16_path(name, sizeof(name), (const uint8_t*)h->parent_name, 256, true);
+  _sibling(cand, sizeof(cand), path, name);
+  return _vhd_open(cand, false, depth + 1);
+}
+
+// set up the BAT and parent of a dynamic or differencing disk
+static bool _open_sparse(struct vhd_t *v, const char *path,
+                         const uint64_t header_offset, const uint32_t depth) {
+  struct vhd_header_t h;
+  if (!_file_io(v->fd, header_offset, (uint8_t*)&h, sizeof(h), false) ||
+      memcmp(h.cookie, "cxsparse", 8)) {
+    log_printf(LOG_CHAN_DISK, "VHD dynamic header invalid");
+    return false;
+  }
+  _endian(&h.table_offset, 8);
+  _endian(&h.max_entries, 4);
+  _endian(&h.block_size, 4);
+  for (uint32_t i = 0; i < 8; ++i) {
+    _endian(&h.locator[i].code, 4);
+    _endian(&h.locator[i].length, 4);
+    _endian(&h.locator[i].offset, 8);
+  }
+  // blocks are a power of two sectors and the table covers the disk
+  if (h.block_size < 512 || (h.block_size & (h.block_size - 1))) {
+    log_printf(LOG_CHAN_DISK, "VHD block size invalid");
+    return false;
+  }
+  const uint64_t needed = (v->size + h.block_size - 1) / h.block_size;
+  if (h.max_entries < needed || h.max_entries > VHD_ENTRIES_MAX) {
+    log_printf(LOG_CHAN_DISK, "VHD block table invalid");
+    return false;
+  }
+  // the table must lie within the file
+  const size_t bat_bytes = (size_t)h.max_entries * sizeof(uint32_t);
+  if (h.table_offset > v->file_end ||
+      bat_bytes > v->file_end - h.table_offset) {
+    log_printf(LOG_CHAN_DISK, "VHD block table outside of the file");
+    return false;
+  }
+  v->block_size = h.block_size;
+  v->entries = h.max_entries;
+  v->bat_offset = h.table_offset;
+  // one bit per sector padded to a whole sector
+  v->bitmap_size = ((h.block_size / 512 / 8) + 511) & ~511u;
+  v->bitmap = (uint8_t*)malloc(v->bitmap_size);
+  v->bitmap_block = VHD_UNUSED;
+  v->bat = (uint32_t*)malloc(bat_bytes);
+  if (!v->bitmap || !v->bat ||
+      !_file_io(v->fd, v->bat_offset, (uint8_t*)v->bat, (uint32_t)bat_bytes,
+                false)) {
+    log_printf(LOG_CHAN_DISK, "unable to read VHD block table");
+    return false;
+  }
+  for (uint32_t i = 0; i < v->entries; ++i) {
+    _endian(v->bat + i, 4);
+  }
+  if (v->type == VHD_DIFFERENCING) {
+    v->parent = _open_parent(path, &h, depth);
+    if (!v->parent) {
+      log_printf(LOG_CHAN_DISK, "unable to find parent of '%s'", path);
+      return false;
+    }
+    if (memcmp(v->parent->uuid, h.parent_uuid, 16) ||
+        v->parent->size != v->size) {
+      log_printf(LOG_CHAN_DISK, "VHD parent of '%s' does not match", path);
+      return false;
+    }
+  }
+  return true;
+}
+
+static struct vhd_t *_vhd_open(const char *path, const bool writable,
+                               const uint32_t depth) {
+  if (depth >= VHD_DEPTH_MAX) {
+    log_printf(LOG_CHAN_DISK, "VHD parent chain too deep");
+    return NULL;
+  }
+  struct vhd_t *v = (struct vhd_t*)calloc(1, sizeof(struct vhd_t));
+  if (!v) {
+    return NULL;
+  }
+  v->fd = fopen(path, writable ? "r+b" : "rb");
+  v->writable = writable;
+  if (!v->fd) {
+    log_printf(LOG_CHAN_DISK, "unable to open VHD file '%s'", path);
+    goto error;
+  }
+  uint64_t file_size = 0;
+  if (!_disk_fsize(v->fd, &file_size) || file_size < 512 ||
+      !_file_io(v->fd, file_size - 512, v->footer, 512, false)) {
+    log_printf(LOG_CHAN_DISK, "unable to read VHD file footer");
+    goto error;
+  }
+  v->file_end = file_size - 512;
+
+  struct vhd_footer_t footer;
+  memcpy(&footer, v->footer, sizeof(footer));
+  if (memcmp(footer.cookie, "conectix", 8)) {
+    log_printf(LOG_CHAN_DISK, "VHD file invalid");
+    goto error;
+  }
+  _endian(&footer.type, 4);
+  _endian(&footer.offset, 8);
+  _endian(&footer.size, 8);
+  v->type = footer.type;
+  v->size = footer.size;
+  memcpy(v->uuid, footer.uuid, 16);
+
+  switch (v->type) {
+  case VHD_FIXED:
+    if (footer.offset != ~0ull || v->size > v->file_end) {
+      log_printf(LOG_CHAN_DISK, "VHD offset non fixed");
+      goto error;
+    }
+    return v;
+  case VHD_DYNAMIC:
+  case VHD_DIFFERENCING:
+    if (!_open_sparse(v, path, footer.offset, depth)) {
+      goto error;
+    }
+    return v;
+  default:
+    log_printf(LOG_CHAN_DISK, "VHD disk type %u not supported", v->type);
+    goto error;
+  }
+error:
+  _vhd_free(v);
+  return NULL;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- delegates
+
+static bool _disk_vhd_eject(void *self) {
+  assert(self);
+  _vhd_free((struct vhd_t*)self);
+  return true;
+}
+
+static bool _disk_vhd_flush(void *self) {
+  assert(self);
+  struct vhd_t *v = (struct vhd_t*)self;
+  return fflush(v->fd) == 0;
+}
+
+static bool _disk_vhd_seek(void *self, const uint64_t offset) {
+  assert(self);
+  struct vhd_t *v = (struct vhd_t*)self;
+  if (offset > v->size) {
+    return false;
+  }
+  v->seek_pos = offset;
+  return true;
+}
+
+static bool _disk_vhd_read(void *self, uint8_t *dst, const uint32_t count) {
+  assert(self);
+  struct vhd_t *v = (struct vhd_t*)self;
+  if (!_vhd_read(v, v->seek_pos, dst, count)) {
+    return false;
+  }
+  v->seek_pos += count;
+  return true;
+}
+
+static bool _disk_vhd_write(
+  void *self, const uint8_t *src, const uint32_t count) {
+  assert(self);
+  struct vhd_t *v = (struct vhd_t*)self;
+  // fail before a block is allocated in memory
+  if (!v->writable || !_vhd_write(v, v->seek_pos, src, count)) {
+    return false;
+  }
+  v->seek_pos += count;
+  return true;
+}
+
+static bool _disk_vhd_tell(void *self, uint64_t *out) {
+  assert(self && out);
+  struct vhd_t *v = (struct vhd_t*)self;
+  *out = v->seek_pos;
+  return true;
+}
+
+static bool _disk_vhd_readv(
+  void *self, const uint64_t offset,
+  const struct disk_iov_t *iov, const uint32_t count) {
+  assert(self);
+  struct vhd_t *v = (struct vhd_t*)self;
+  v->seek_pos = offset;
+  for (uint32_t i = 0; i < count; ++i) {
+    if (!_disk_vhd_read(v, iov[i].base, iov[i].size)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool _disk_vhd_writev(
+  void *self, const uint64_t offset,
+  const struct disk_iov_t *iov, const uint32_t count) {
+  assert(self);
+  struct vhd_t *v = (struct vhd_t*)self;
+  v->seek_pos = offset;
+  for (uint32_t i = 0; i < count; ++i) {
+    if (!_disk_vhd_write(v, iov[i].base, iov[i].size)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool _disk_vhd_open(
+  const uint8_t num, const char *path, const bool shared,
+  struct disk_info_t *out) {
+
+  assert(path && out);
+
+  struct vhd_t *v = _vhd_open(path, shared, 0);
+  if (!v) {
+    return false;
+  }
+
+  struct vhd_footer_t footer;
+  memcpy(&footer, v->footer, sizeof(footer));
+  const uint8_t *g = footer.geometry;
+
+  // populate disk structure
+  out->self   = v;
+  out->eject  = _disk_vhd_eject;
+  out->seek   = _disk_vhd_seek;
+  out->read   = _disk_vhd_read;
+  out->write  = _disk_vhd_write;
+  out->tell   = _disk_vhd_tell;
+  out->readv  = _disk_vhd_readv;
+  out->writev = _disk_vhd_writev;
+  out->flush  = _disk_vhd_flush;
+
+  out->drive_num = num;
+  out->size_bytes = v->size;
+  out->read_only = !shared;
+
+  out->sector_size = 512;
+  out->cyls = g[1] | (g[0] << 8);
+  out->sects = g[3];
+  out->heads = g[2];
+
+  return true;
+}
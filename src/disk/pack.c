@@ -0,0 +1,172 @@
+/*
+  Fake86: A portable, open-source 8086 PC emulator.
+  Copyright (C)2010-2013 Mike Chambers
+               2019      Aidan Dodds
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+  USA.
+*/
+
+// conversion between raw and packed images
+//
+// kept apart from the backend so tools can link it without the emulator.
+
+#include <stdio.h>
+
+#include "disk.h"
+
+
+static bool _is_zero(const uint8_t *p, const uint32_t size) {
+  for (uint32_t i = 0; i < size; ++i) {
+    if (p[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool pack_image(const char *raw_path, const char *pack_path) {
+  FILE *in = fopen(raw_path, "rb");
+  if (!in) {
+    log_printf(LOG_CHAN_DISK, "unable to open file '%s'", raw_path);
+    return false;
+  }
+  uint64_t size = 0;
+  if (!_disk_fsize(in, &size) || !_disk_fseek(in, 0) ||
+      size == 0 || (size - 1) / PACK_BLOCK >= 0xffffffffull) {
+    log_printf(LOG_CHAN_DISK, "'%s' is not a usable image size", raw_path);
+    fclose(in);
+    return false;
+  }
+  FILE *out = fopen(pack_path, "wb");
+  if (!out) {
+    log_printf(LOG_CHAN_DISK, "unable to open file '%s'", pack_path);
+    fclose(in);
+    return false;
+  }
+
+  struct pack_header_t head;
+  memset(&head, 0, sizeof(head));
+  memcpy(head.magic, PACK_MAGIC, 8);
+  head.version = PACK_VERSION;
+  head.block_size = PACK_BLOCK;
+  head.size = size;
+  head.blocks = (uint32_t)((size - 1) / PACK_BLOCK + 1);
+
+  struct pack_index_t *index =
+    (struct pack_index_t*)calloc((size_t)head.blocks + 1, sizeof(*index));
+  uint8_t *raw = (uint8_t*)malloc(PACK_BLOCK);
+  uint8_t *packed = (uint8_t*)malloc(PACK_BLOCK);
+  bool ok = index && raw && packed;
+
+  // blocks follow the index, which is written last
+  uint64_t pos = sizeof(head) + (uint64_t)head.blocks * sizeof(*index);
+  ok = ok && _disk_fseek(out, pos);
+  for (uint32_t i = 0; ok && i < head.blocks; ++i) {
+    const uint32_t len =
+      (uint32_t)SDL_min(PACK_BLOCK, head.size - (uint64_t)i * PACK_BLOCK);
+    if (fread(raw, 1, len, in) != len) {
+      ok = false;
+      break;
+    }
+    if (_is_zero(raw, len)) {
+      continue;
+    }
+    // keep it as it is unless compressing saves space
+    uint32_t plen = lz_compress(raw, len, packed, len - 1);
+    const uint8_t *src = plen ? packed : raw;
+    plen = plen ? plen : len;
+    index[i].offset = pos;
+    index[i].length = plen;
+    ok = fwrite(src, 1, plen, out) == plen;
+    pos += plen;
+  }
+  ok = ok &&
+       _disk_fseek(out, 0) &&
+       fwrite(&head, sizeof(head), 1, out) == 1 &&
+       fwrite(index, sizeof(*index), head.blocks, out) == head.blocks;
+
+  free(index);
+  free(raw);
+  free(packed);
+  fclose(in);
+  ok = (fclose(out) == 0) && ok;
+  if (!ok) {
+    log_printf(LOG_CHAN_DISK, "unable to pack '%s'", raw_path);
+  }
+  return ok;
+}
+
+bool unpack_image(const char *pack_path, const char *raw_path) {
+  FILE *in = fopen(pack_path, "rb");
+  if (!in) {
+    log_printf(LOG_CHAN_DISK, "unable to open file '%s'", pack_path);
+    return false;
+  }
+  struct pack_header_t head;
+  if (fread(&head, sizeof(head), 1, in) != 1 ||
+      memcmp(head.magic, PACK_MAGIC, 8) ||
+      head.version != PACK_VERSION ||
+      head.block_size != PACK_BLOCK ||
+      head.size == 0 ||
+      head.blocks != (head.size - 1) / PACK_BLOCK + 1) {
+    log_printf(LOG_CHAN_DISK, "'%s' is not a valid packed image", pack_path);
+    fclose(in);
+    return false;
+  }
+  FILE *out = fopen(raw_path, "wb");
+  if (!out) {
+    log_printf(LOG_CHAN_DISK, "unable to open file '%s'", raw_path);
+    fclose(in);
+    return false;
+  }
+
+  struct pack_index_t *index =
+    (struct pack_index_t*)calloc((size_t)head.blocks + 1, sizeof(*index));
+  uint8_t *raw = (uint8_t*)malloc(PACK_BLOCK);
+  uint8_t *packed = (uint8_t*)malloc(PACK_BLOCK);
+  bool ok = index && raw && packed &&
+            fread(index, sizeof(*index), head.blocks, in) == head.blocks;
+
+  for (uint32_t i = 0; ok && i < head.blocks; ++i) {
+    const uint32_t len =
+      (uint32_t)SDL_min(PACK_BLOCK, head.size - (uint64_t)i * PACK_BLOCK);
+    const struct pack_index_t *x = index + i;
+    if (x->length == 0) {
+      memset(raw, 0, len);
+    }
+    else if (x->length == len) {
+      ok = _disk_fseek(in, x->offset) &&
+           fread(raw, 1, len, in) == len;
+    }
+    else {
+      ok = x->length < len &&
+           _disk_fseek(in, x->offset) &&
+           fread(packed, 1, x->length, in) == x->length &&
+           lz_decompress(packed, x->length, raw, len);
+    }
+    ok = ok && fwrite(raw, 1, len, out) == len;
+  }
+
+  free(index);
+  free(raw);
+  free(packed);
+  fclose(in);
+  ok = (fclose(out) == 0) && ok;
+  if (!ok) {
+    log_printf(LOG_CHAN_DISK, "unable to unpack '%s'", pack_path);
+  }
+  return ok;
+}
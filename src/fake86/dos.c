@@ -23,14 +23,124 @@
 #include "../cpu/cpu.h"
 
 
+// batch mode
+//
+// from bootstrap on, guest console output is streamed to the host's stdout
+// and the emulator exits with the guest's return code. under a booted DOS
+// every console write, 02h, 09h and 40h to CON alike, reaches the screen
+// through the int 10h teletype, so that is where it is captured. a guest
+// can also leave by writing its code to port F4h, or with int 21h AH=FAh
+// BX=8686h.
+
+#define DOS_EXIT_PORT 0xF4
+#define DOS_EXIT_MAGIC 0x8686
+
+static bool _batch;
+static bool _capture;
+static bool _exited;
+static int _exit_code;
+
+// console output is written out in large blocks
+static char _out_buf[4096];
+static uint32_t _out_len;
+// a '\r' held back in case a '\n' follows it
+static bool _out_cr;
+
+static void _out_put(const char c) {
+  if (_out_len == sizeof(_out_buf)) {
+    dos_console_flush();
+  }
+  _out_buf[_out_len++] = c;
+}
+
+void dos_console_out(const uint8_t c) {
+  if (_out_cr) {
+    _out_cr = false;
+    if (c == '\n') {
+      _out_put('\n');
+      return;
+    }
+    _out_put('\r');
+  }
+  if (c == '\r') {
+    _out_cr = true;
+    return;
+  }
+  _out_put((char)c);
+}
+
+void dos_console_flush(void) {
+  if (_out_len) {
+    fwrite(_out_buf, 1, _out_len, stdout);
+    fflush(stdout);
+    _out_len = 0;
+  }
+}
+
+void dos_exit(const int code) {
+  if (_out_cr) {
+    _out_cr = false;
+    _out_put('\r');
+  }
+  dos_console_flush();
+  _exit_code = code;
+  _exited = true;
+  cpu_running = false;
+  log_printf(LOG_CHAN_DOS, "program exited with code %d", code);
+}
+
+bool dos_exited(int *code) {
+  if (_exited) {
+    *code = _exit_code;
+  }
+  return _exited;
+}
+
+void dos_batch(void) {
+  _batch = true;
+}
+
+bool dos_is_batch(void) {
+  return _batch;
+}
+
+void dos_boot(void) {
+  // the BIOS has had its say
+  _capture = _batch;
+}
+
+void dos_int10(void) {
+  if (_capture && cpu_regs.ah == 0x0E) {
+    dos_console_out(cpu_regs.al);
+  }
+}
+
+static void _on_exit_port(uint16_t port, uint8_t value) {
+  (void)port;
+  dos_exit(value);
+}
+
+void dos_init(void) {
+  if (_batch) {
+    set_port_write_redirector(DOS_EXIT_PORT, DOS_EXIT_PORT, _on_exit_port);
+  }
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- int 21h
+
 static void _on_dos_write_stdout(void) {
   const uint32_t offset = (cpu_regs.ds << 4) + cpu_regs.dx;
-  char *str = (char*)(RAM + offset);
-  char *term = str;
-  for (;*term != '$'; ++term);
-  *term = '\0';
+  char str[128];
+  uint32_t len = 0;
+  for (; len < sizeof(str) - 1; ++len) {
+    const char c = (char)read86((offset + len) & 0xFFFFF);
+    if (c == '$') {
+      break;
+    }
+    str[len] = c;
+  }
+  str[len] = '\0';
   log_printf(LOG_CHAN_DOS, "stdout: '%s'", str);
-  *term = '$';
 }
 
 static void _on_dos_load_exec(void) {
@@ -174,6 +284,18 @@ static const char *_get_int_desc(int num) {
 
 bool on_dos_int(void) {
 
+  if (_batch && cpu_regs.ah == 0xFA && cpu_regs.bx == DOS_EXIT_MAGIC) {
+    dos_exit(cpu_regs.al);
+    return true;
+  }
+  if (dos_host_int() || dos_exec_int(0x21)) {
+    return true;
+  }
+  if (_batch && cpu_regs.ah == 0x4C) {
+    dos_exit(cpu_regs.al);
+    return true;
+  }
+
   switch (cpu_regs.ah) {
   case 0x09:  // Write stdout
     _on_dos_write_stdout();
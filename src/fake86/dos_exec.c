@@ -0,0 +1,685 @@
+/*
+  Fake86: A portable, open-source 8086 PC emulator.
+  Copyright (C)2010-2013 Mike Chambers
+               2019      Aidan Dodds
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+  USA.
+*/
+
+// run a DOS program without booting DOS
+//
+// the program is loaded from the bootstrap interrupt in place of a boot
+// sector, with a PSP, environment and command tail built as DOS would. the
+// int 21h calls a console tool makes are answered here, file calls go to
+// the host drive, which is the program's own directory unless one was
+// mounted, and the console is the host's stdin and stdout. the emulator
+// stops when the program terminates and exits with its return code.
+//
+//   0x0600  environment
+//   0x1000  PSP
+//   0x1100  program image, then the memory it keeps. 48h allocates from
+//           what it gives back through 4Ah, as DOS does.
+
+#include <stdio.h>
+#include <ctype.h>
+#include <time.h>
+
+#include "../common/common.h"
+#include "../cpu/cpu.h"
+
+
+#define ENV_SEG 0x0060
+#define ENV_SIZE 0x0a00
+#define PSP_SEG 0x0100
+
+// blocks allocated through 48h
+#define EXEC_BLOCKS 16
+
+struct mz_header_t {
+  uint16_t magic;
+  uint16_t last_page;
+  uint16_t pages;
+  uint16_t relocs;
+  uint16_t header_paras;
+  uint16_t min_alloc;
+  uint16_t max_alloc;
+  uint16_t ss, sp;
+  uint16_t checksum;
+  uint16_t ip, cs;
+  uint16_t reloc_offset;
+  uint16_t overlay;
+};
+
+struct exec_block_t {
+  uint16_t seg;
+  uint16_t paras;
+};
+
+static const char *_path;
+static const char *_args = "";
+static const char *_env[16];
+static uint32_t _env_count;
+
+static bool _active;
+
+// end of the program's own block and the top of memory, as segments
+static uint16_t _prog_end;
+static uint16_t _mem_top;
+static struct exec_block_t _block[EXEC_BLOCKS];
+
+static uint32_t _dta;
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- loading
+
+static void _put_string(uint32_t addr, const char *s) {
+  do {
+    write86(addr++, (uint8_t)*s);
+  } while (*s++);
+}
+
+// guest form of the host program path, C:\NAME.EXE
+static void _guest_name(const char *host, char *out, const size_t size) {
+  const char *base = host;
+  for (const char *c = host; *c; ++c) {
+    if (*c == '/' || *c == '\\') {
+      base = c + 1;
+    }
+  }
+  snprintf(out, size, "%c:\\%s", dos_host_letter(), base);
+  for (char *c = out; *c; ++c) {
+    *c = (char)toupper((uint8_t)*c);
+  }
+}
+
+static bool _build_env(const char *name) {
+  uint32_t addr = ENV_SEG << 4;
+  const uint32_t end = addr + ENV_SIZE;
+  char drive[16];
+  snprintf(drive, sizeof(drive), "PATH=%c:\\", dos_host_letter());
+  const char *fixed[] = {drive, "COMSPEC=C:\\COMMAND.COM"};
+  for (uint32_t i = 0; i < 2 + _env_count; ++i) {
+    const char *var = (i < 2) ? fixed[i] : _env[i - 2];
+    if (addr + strlen(var) + 1 >= end - 128) {
+      return false;
+    }
+    _put_string(addr, var);
+    addr += (uint32_t)strlen(var) + 1;
+  }
+  // end of the variables, then the program path
+  write86(addr++, 0);
+  writew86(addr, 1);
+  _put_string(addr + 2, name);
+  return true;
+}
+
+static void _build_psp(void) {
+  const uint32_t psp = PSP_SEG << 4;
+  memset(RAM + psp, 0, 0x100);
+  // int 20h
+  RAM[psp + 0x00] = 0xcd;
+  RAM[psp + 0x01] = 0x20;
+  writew86(psp + 0x02, _mem_top);
+  // job file table, stdin, stdout, stderr, aux and prn
+  static const uint8_t jft[20] = {
+    1, 1, 1, 0, 2, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  };
+  memcpy(RAM + psp + 0x18, jft, sizeof(jft));
+  writew86(psp + 0x2c, ENV_SEG);
+  writew86(psp + 0x32, 20);
+  writew86(psp + 0x34, 0x18);
+  writew86(psp + 0x36, PSP_SEG);
+  // int 21h, retf
+  RAM[psp + 0x50] = 0xcd;
+  RAM[psp + 0x51] = 0x21;
+  RAM[psp + 0x52] = 0xcb;
+  // blank FCBs
+  memset(RAM + psp + 0x5d, ' ', 11);
+  memset(RAM + psp + 0x6d, ' ', 11);
+  // command tail, a leading space as COMMAND.COM gives it
+  const size_t len = SDL_min(strlen(_args), 125);
+  if (len) {
+    RAM[psp + 0x81] = ' ';
+    memcpy(RAM + psp + 0x82, _args, len);
+  }
+  RAM[psp + 0x80] = (uint8_t)(len ? len + 1 : 0);
+  RAM[psp + 0x81 + RAM[psp + 0x80]] = 0x0d;
+}
+
+static bool _load_com(FILE *fd, const uint32_t size) {
+  const uint32_t addr = (PSP_SEG << 4) + 0x100;
+  if (size > 0xff00 - 2 || fread(RAM + addr, 1, size, fd) != size) {
+    return false;
+  }
+  cpu_regs.cs = cpu_regs.ds = cpu_regs.es = cpu_regs.ss = PSP_SEG;
+  cpu_regs.ip = 0x100;
+  // a return from the program reaches the int 20h at PSP:0000
+  cpu_regs.sp = 0xfffe;
+  writew86((PSP_SEG << 4) + 0xfffe, 0);
+  _prog_end = _mem_top;
+  return true;
+}
+
+static bool _load_exe(FILE *fd, const struct mz_header_t *h) {
+  uint32_t size = h->pages * 512u;
+  if (h->last_page) {
+    size -= 512 - h->last_page;
+  }
+  const uint32_t header = h->header_paras * 16u;
+  if (h->pages == 0 || size <= header) {
+    return false;
+  }
+  size -= header;
+  const uint16_t start = PSP_SEG + 0x10;
+  const uint32_t need = (size + 15) / 16 + h->min_alloc;
+  if (start + need > _mem_top) {
+    log_printf(LOG_CHAN_DOS, "program needs %u KB of memory", need / 64);
+    return false;
+  }
+  if (fseek(fd, header, SEEK_SET) != 0 ||
+      fread(RAM + (start << 4), 1, size, fd) != size) {
+    return false;
+  }
+  // segment fixups for the load address
+  if (fseek(fd, h->reloc_offset, SEEK_SET) != 0) {
+    return false;
+  }
+  for (uint32_t i = 0; i < h->relocs; ++i) {
+    uint8_t r[4];
+    if (fread(r, 1, 4, fd) != 4) {
+      return false;
+    }
+    const uint16_t off = r[0] | (r[1] << 8);
+    const uint16_t seg = r[2] | (r[3] << 8);
+    const uint32_t addr = (((start + seg) << 4) + off) & 0xFFFFF;
+    writew86(addr, readw86(addr) + start);
+  }
+  cpu_regs.cs = start + h->cs;
+  cpu_regs.ip = h->ip;
+  cpu_regs.ss = start + h->ss;
+  cpu_regs.sp = h->sp;
+  cpu_regs.ds = cpu_regs.es = PSP_SEG;
+  // as much memory as was asked for, up to all there is
+  const uint32_t want = (size + 15) / 16 + h->max_alloc + 0x10;
+  _prog_end = (uint16_t)SDL_min((uint32_t)_mem_top, PSP_SEG + want);
+  return true;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- services
+
+static void _ok(void) {
+  cpu_flags.cf = 0;
+}
+
+static void _fail(const uint16_t err) {
+  cpu_regs.ax = err;
+  cpu_flags.cf = 1;
+}
+
+// largest free run of memory between the program and the top
+static uint16_t _mem_free(uint16_t *seg) {
+  uint16_t best = 0, at = _prog_end;
+  for (uint16_t from = _prog_end;;) {
+    // next block at or above `from`
+    uint16_t next = _mem_top;
+    uint32_t hit = EXEC_BLOCKS;
+    for (uint32_t i = 0; i < EXEC_BLOCKS; ++i) {
+      if (_block[i].paras && _block[i].seg >= from && _block[i].seg < next) {
+        next = _block[i].seg;
+        hit = i;
+      }
+    }
+    if (next - from > best) {
+      best = next - from;
+      at = from;
+    }
+    if (hit == EXEC_BLOCKS) {
+      break;
+    }
+    from = _block[hit].seg + _block[hit].paras;
+  }
+  *seg = at;
+  return best;
+}
+
+// 48h
+static void _on_alloc(void) {
+  uint16_t seg;
+  const uint16_t free_paras = _mem_free(&seg);
+  uint32_t i = 0;
+  for (; i < EXEC_BLOCKS && _block[i].paras; ++i);
+  if (cpu_regs.bx > free_paras || i == EXEC_BLOCKS || cpu_regs.bx == 0) {
+    cpu_regs.bx = free_paras;
+    _fail(8);
+    return;
+  }
+  _block[i].seg = seg;
+  _block[i].paras = cpu_regs.bx;
+  cpu_regs.ax = seg;
+  _ok();
+}
+
+// 49h
+static void _on_free(void) {
+  for (uint32_t i = 0; i < EXEC_BLOCKS; ++i) {
+    if (_block[i].paras && _block[i].seg == cpu_regs.es) {
+      _block[i].paras = 0;
+      _ok();
+      return;
+    }
+  }
+  _fail(9);
+}
+
+// 4Ah
+static void _on_resize(void) {
+  if (cpu_regs.es == PSP_SEG) {
+    // the program's own block, blocks above it stay where they are
+    uint16_t limit = _mem_top;
+    for (uint32_t i = 0; i < EXEC_BLOCKS; ++i) {
+      if (_block[i].paras && _block[i].seg < limit) {
+        limit = _block[i].seg;
+      }
+    }
+    if (PSP_SEG + (uint32_t)cpu_regs.bx > limit) {
+      cpu_regs.bx = limit - PSP_SEG;
+      _fail(8);
+      return;
+    }
+    _prog_end = PSP_SEG + cpu_regs.bx;
+    _ok();
+    return;
+  }
+  for (uint32_t i = 0; i < EXEC_BLOCKS; ++i) {
+    struct exec_block_t *b = _block + i;
+    if (!b->paras || b->seg != cpu_regs.es) {
+      continue;
+    }
+    // free it while looking for the space above it
+    const uint16_t old = b->paras;
+    b->paras = 0;
+    uint16_t limit = _mem_top;
+    for (uint32_t j = 0; j < EXEC_BLOCKS; ++j) {
+      if (_block[j].paras && _block[j].seg > b->seg && _block[j].seg < limit) {
+        limit = _block[j].seg;
+      }
+    }
+    if (b->seg + (uint32_t)cpu_regs.bx > limit) {
+      b->paras = old;
+      cpu_regs.bx = limit - b->seg;
+      _fail(8);
+      return;
+    }
+    b->paras = cpu_regs.bx;
+    _ok();
+    return;
+  }
+  _fail(9);
+}
+
+static int _in(void) {
+  dos_console_flush();
+  const int c = fgetc(stdin);
+  // end of input reads as ^Z
+  return (c == EOF) ? 0x1a : (c == '\n' ? '\r' : c);
+}
+
+// 0Ah
+static void _on_buffered_input(void) {
+  const uint32_t buf = (cpu_regs.ds << 4) + cpu_regs.dx;
+  const uint8_t size = read86(buf);
+  uint8_t len = 0;
+  for (;;) {
+    const int c = _in();
+    if (c == '\r' || c == 0x1a) {
+      break;
+    }
+    if (len + 1 < size) {
+      write86(buf + 2 + len++, (uint8_t)c);
+    }
+  }
+  write86(buf + 1, len);
+  write86(buf + 2 + len, '\r');
+}
+
+// 40h to a device handle
+static void _on_write(void) {
+  const uint32_t addr = (cpu_regs.ds << 4) + cpu_regs.dx;
+  if (cpu_regs.bx == 2) {
+    // keep stderr in order with what was written before it
+    dos_console_flush();
+    for (uint32_t i = 0; i < cpu_regs.cx; ++i) {
+      fputc(read86((addr + i) & 0xFFFFF), stderr);
+    }
+  }
+  else if (cpu_regs.bx != 3 && cpu_regs.bx != 4) {
+    for (uint32_t i = 0; i < cpu_regs.cx; ++i) {
+      dos_console_out(read86((addr + i) & 0xFFFFF));
+    }
+  }
+  cpu_regs.ax = cpu_regs.cx;
+  _ok();
+}
+
+// 3Fh from a device handle
+static void _on_read(void) {
+  const uint32_t addr = (cpu_regs.ds << 4) + cpu_regs.dx;
+  uint32_t done = 0;
+  if (cpu_regs.bx == 0) {
+    dos_console_flush();
+    // a line at a time as the console would
+    while (done < cpu_regs.cx) {
+      const int c = fgetc(stdin);
+      if (c == EOF) {
+        break;
+      }
+      if (c == '\n') {
+        write86((addr + done++) & 0xFFFFF, '\r');
+        if (done < cpu_regs.cx) {
+          write86((addr + done++) & 0xFFFFF, '\n');
+        }
+        break;
+      }
+      write86((addr + done++) & 0xFFFFF, (uint8_t)c);
+    }
+  }
+  cpu_regs.ax = (uint16_t)done;
+  _ok();
+}
+
+static void _on_time(const bool date) {
+  const time_t t = time(NULL);
+  const struct tm *tm = localtime(&t);
+  if (!tm) {
+    _fail(1);
+    return;
+  }
+  if (date) {
+    cpu_regs.cx = (uint16_t)(tm->tm_year + 1900);
+    cpu_regs.dh = (uint8_t)(tm->tm_mon + 1);
+    cpu_regs.dl = (uint8_t)tm->tm_mday;
+    cpu_regs.al = (uint8_t)tm->tm_wday;
+  }
+  else {
+    cpu_regs.ch = (uint8_t)tm->tm_hour;
+    cpu_regs.cl = (uint8_t)tm->tm_min;
+    cpu_regs.dh = (uint8_t)tm->tm_sec;
+    cpu_regs.dl = 0;
+  }
+}
+
+static void _int21(void) {
+  const uint32_t ds_dx = (cpu_regs.ds << 4) + cpu_regs.dx;
+  switch (cpu_regs.ah) {
+  case 0x00:  // terminate
+    dos_exit(0);
+    break;
+  case 0x4C:  // terminate with return code
+  case 0x31:  // stay resident, there is nothing to stay for
+    dos_exit(cpu_regs.al);
+    break;
+  case 0x01:  // read with echo
+    cpu_regs.al = (uint8_t)_in();
+    dos_console_out(cpu_regs.al);
+    break;
+  case 0x07:  // read
+  case 0x08:
+    cpu_regs.al = (uint8_t)_in();
+    break;
+  case 0x02:  // write character
+    dos_console_out(cpu_regs.dl);
+    cpu_regs.al = cpu_regs.dl;
+    break;
+  case 0x06:  // direct console io
+    if (cpu_regs.dl == 0xff) {
+      // no key waiting
+      cpu_flags.zf = 1;
+      cpu_regs.al = 0;
+    }
+    else {
+      dos_console_out(cpu_regs.dl);
+      cpu_regs.al = cpu_regs.dl;
+    }
+    break;
+  case 0x09:  // write string
+    for (uint32_t i = 0; i < 0x10000; ++i) {
+      const uint8_t c = read86((ds_dx + i) & 0xFFFFF);
+      if (c == '$') {
+        break;
+      }
+      dos_console_out(c);
+    }
+    cpu_regs.al = '$';
+    break;
+  case 0x0A:
+    _on_buffered_input();
+    break;
+  case 0x0B:  // input status
+    cpu_regs.al = 0;
+    break;
+  case 0x0C:  // flush input then read
+    if (cpu_regs.al == 0x01 || cpu_regs.al == 0x06 || cpu_regs.al == 0x07 ||
+        cpu_regs.al == 0x08 || cpu_regs.al == 0x0A) {
+      cpu_regs.ah = cpu_regs.al;
+      _int21();
+      cpu_regs.ah = 0x0C;
+    }
+    break;
+  case 0x0D:  // disk reset
+    break;
+  case 0x0E:  // select drive
+    cpu_regs.al = 26;
+    break;
+  case 0x19:  // current drive
+    cpu_regs.al = (uint8_t)(dos_host_letter() - 'A');
+    break;
+  case 0x1A:  // set DTA, also seen by the host drive
+    _dta = ds_dx & 0xFFFFF;
+    break;
+  case 0x2F:  // get DTA
+    cpu_regs.es = (uint16_t)(_dta >> 4);
+    cpu_regs.bx = (uint16_t)(_dta & 0xf);
+    break;
+  case 0x25:  // set vector
+    writew86(cpu_regs.al * 4, cpu_regs.dx);
+    writew86(cpu_regs.al * 4 + 2, cpu_regs.ds);
+    break;
+  case 0x35:  // get vector
+    cpu_regs.bx = readw86(cpu_regs.al * 4);
+    cpu_regs.es = readw86(cpu_regs.al * 4 + 2);
+    break;
+  case 0x2A:
+    _on_time(true);
+    break;
+  case 0x2C:
+    _on_time(false);
+    break;
+  case 0x30:  // version, 5.0
+    cpu_regs.ax = 0x0005;
+    cpu_regs.bx = 0;
+    cpu_regs.cx = 0;
+    break;
+  case 0x33:  // ctrl-break checking, off
+    cpu_regs.dl = 0;
+    break;
+  case 0x3E:  // close a device handle
+    _ok();
+    break;
+  case 0x3F:
+    if (cpu_regs.bx <= 4) {
+      _on_read();
+    }
+    else {
+      _fail(6);
+    }
+    break;
+  case 0x40:
+    if (cpu_regs.bx <= 4) {
+      _on_write();
+    }
+    else {
+      _fail(6);
+    }
+    break;
+  case 0x44:  // ioctl, device information
+    if (cpu_regs.al == 0x00 && cpu_regs.bx <= 4) {
+      // character device, stdin and stdout are the console
+      cpu_regs.dx = 0x80 | ((cpu_regs.bx == 0) ? 0x01 : 0) |
+                    ((cpu_regs.bx == 1) ? 0x02 : 0);
+      _ok();
+    }
+    else if (cpu_regs.al == 0x00) {
+      // a file on the host drive
+      cpu_regs.dx = (uint16_t)(dos_host_letter() - 'A');
+      _ok();
+    }
+    else {
+      _fail(1);
+    }
+    break;
+  case 0x47:  // current directory, always the root
+    write86(((cpu_regs.ds << 4) + cpu_regs.si) & 0xFFFFF, 0);
+    _ok();
+    break;
+  case 0x48:
+    _on_alloc();
+    break;
+  case 0x49:
+    _on_free();
+    break;
+  case 0x4A:
+    _on_resize();
+    break;
+  case 0x4D:  // return code of a child, there are none
+    cpu_regs.ax = 0;
+    break;
+  case 0x51:  // current PSP
+  case 0x62:
+    cpu_regs.bx = PSP_SEG;
+    break;
+  default:
+    log_printf(LOG_CHAN_DOS, "unsupported call %02xh", cpu_regs.ah);
+    _fail(1);
+  }
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- interface
+
+void dos_exec_set(const char *path) {
+  _path = path;
+  // its console is the host's
+  dos_batch();
+}
+
+void dos_exec_args(const char *args) {
+  _args = args;
+}
+
+bool dos_exec_env(const char *var) {
+  if (_env_count >= sizeof(_env) / sizeof(*_env) || !strchr(var, '=')) {
+    return false;
+  }
+  _env[_env_count++] = var;
+  return true;
+}
+
+// the program can't be run, nothing else is booted in its place
+static bool _load_failed(const char *what) {
+  log_printf(LOG_CHAN_DOS, "unable to %s '%s'", what, _path);
+  // the log may be muted and stdout is the guest's
+  fprintf(stderr, "unable to %s '%s'\n", what, _path);
+  dos_exit(DOS_EXIT_LOAD_FAILED);
+  return true;
+}
+
+bool dos_exec_boot(void) {
+  if (!_path) {
+    return false;
+  }
+  FILE *fd = fopen(_path, "rb");
+  if (!fd) {
+    return _load_failed("open");
+  }
+  // the program's own directory is its drive unless one was given
+  if (!dos_host_letter()) {
+    char dir[1024];
+    snprintf(dir, sizeof(dir), "%s", _path);
+    char *slash = dir;
+    for (char *c = dir; *c; ++c) {
+      if (*c == '/' || *c == '\\') {
+        slash = c;
+      }
+    }
+    if (slash == dir) {
+      strcpy(dir, ".");
+    }
+    else {
+      *slash = '\0';
+    }
+    dos_host_mount('C', dir);
+  }
+  dos_host_default(true);
+
+  _mem_top = (uint16_t)(readw86(0x413) * 64);
+  uint64_t size = 0;
+  fseek(fd, 0, SEEK_END);
+  size = (uint64_t)ftell(fd);
+  fseek(fd, 0, SEEK_SET);
+
+  struct mz_header_t h;
+  memset(&h, 0, sizeof(h));
+  const bool mz = fread(&h, 1, sizeof(h), fd) == sizeof(h) &&
+                  (h.magic == 0x5a4d || h.magic == 0x4d5a);
+  fseek(fd, 0, SEEK_SET);
+
+  char name[128];
+  _guest_name(_path, name, sizeof(name));
+  bool ok = _build_env(name);
+  _build_psp();
+  ok = ok && (mz ? _load_exe(fd, &h) : _load_com(fd, (uint32_t)size));
+  fclose(fd);
+  if (!ok) {
+    return _load_failed("load");
+  }
+  writew86((PSP_SEG << 4) + 0x02, _prog_end);
+  _dta = (PSP_SEG << 4) + 0x80;
+  dos_host_set_psp(PSP_SEG);
+  memset(_block, 0, sizeof(_block));
+  // no FCB drives were given
+  cpu_regs.ax = 0;
+  cpu_regs.bx = 0;
+  cpu_regs.cx = 0xff;
+  _active = true;
+  log_printf(LOG_CHAN_DOS, "running '%s' as %s", _path, name);
+  return true;
+}
+
+bool dos_exec_int(const uint8_t num) {
+  if (!_active) {
+    return false;
+  }
+  switch (num) {
+  case 0x20:
+    dos_exit(0);
+    break;
+  case 0x29:  // fast console output
+    dos_console_out(cpu_regs.al);
+    break;
+  default:
+    _int21();
+  }
+  return true;
+}
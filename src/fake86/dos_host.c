@@ -0,0 +1,893 @@
+/*
+  Fake86: A portable, open-source 8086 PC emulator.
+  Copyright (C)2010-2013 Mike Chambers
+               2019      Aidan Dodds
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+  USA.
+*/
+
+// int 21h file calls served from a host directory
+//
+// paths on the mounted drive letter are opened on the host and the handle
+// calls that follow are answered here without running guest DOS, reads and
+// writes go between the host file and guest memory in one transfer. a host
+// handle takes a free entry in the job file table of the running program's
+// PSP, marked so DOS will not give the same number out, and is closed when
+// that program terminates.
+//
+// the running program is the one whose memory block holds the calling code,
+// unless function 50h has named another. find first/next keep their state
+// in the reserved part of the DTA, which is followed through function 1Ah
+// and is the PSP:80h of a program until it sets one, as DOS does on exec
+// and termination.
+
+#include <stdio.h>
+#include <ctype.h>
+#include <time.h>
+
+#include "../common/common.h"
+#include "../cpu/cpu.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <io.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+#define HOST_PATH_MAX 1024
+#define HOST_FILES 15
+// job file table entry of a host handle, an SFT index DOS never reaches
+#define HOST_JFT_MARK 0xFE
+// searches in progress at once, the oldest is reused
+#define HOST_FINDS 8
+
+enum {
+  ERR_FUNCTION   = 0x01,
+  ERR_NOT_FOUND  = 0x02,
+  ERR_NO_PATH    = 0x03,
+  ERR_TOO_MANY   = 0x04,
+  ERR_DENIED     = 0x05,
+  ERR_HANDLE     = 0x06,
+  ERR_NO_MORE    = 0x12,
+};
+
+enum {
+  ATTR_READ_ONLY = 0x01,
+  ATTR_VOLUME    = 0x08,
+  ATTR_DIR       = 0x10,
+  ATTR_ARCHIVE   = 0x20,
+};
+
+struct host_entry_t {
+  char name[13];
+  uint8_t attr;
+  uint16_t time, date;
+  uint32_t size;
+};
+
+struct host_file_t {
+  FILE *fd;
+  // stdio needs a seek between reading and writing
+  bool writing;
+  // owning program and its handle
+  uint16_t psp;
+  uint16_t handle;
+};
+
+struct host_find_t {
+  struct host_entry_t *entry;
+  uint32_t count, next;
+  uint16_t stamp;
+};
+
+static char _root[HOST_PATH_MAX];
+static char _letter;
+// paths with no drive are on the host drive
+static bool _default;
+
+static struct host_file_t _file[HOST_FILES];
+
+static struct host_find_t _find[HOST_FINDS];
+static uint32_t _find_next;
+static uint16_t _find_stamp;
+
+// PSP of a program run with no DOS
+static uint16_t _psp;
+// PSP given with function 50h, 0 once a program starts or ends
+static uint16_t _psp_set;
+
+// linear address of the DTA set by program `_dta_psp`
+static uint32_t _dta;
+static uint16_t _dta_psp;
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- host
+
+static void _fat_time(time_t t, uint16_t *time_out, uint16_t *date_out) {
+  const struct tm *tm = localtime(&t);
+  if (!tm || tm->tm_year < 80) {
+    *time_out = 0;
+    *date_out = (1 << 5) | 1;
+    return;
+  }
+  *time_out = (uint16_t)((tm->tm_hour << 11) | (tm->tm_min << 5) |
+                         (tm->tm_sec / 2));
+  *date_out = (uint16_t)(((tm->tm_year - 80) << 9) | ((tm->tm_mon + 1) << 5) |
+                         tm->tm_mday);
+}
+
+#ifdef _WIN32
+static bool _host_truncate(FILE *fd, const uint32_t size) {
+  return _chsize_s(_fileno(fd), size) == 0;
+}
+
+static bool _host_stat(const char *path, struct host_entry_t *e) {
+  WIN32_FILE_ATTRIBUTE_DATA fa;
+  if (!GetFileAttributesExA(path, GetFileExInfoStandard, &fa)) {
+    return false;
+  }
+  const uint64_t ft = ((uint64_t)fa.ftLastWriteTime.dwHighDateTime << 32) |
+                      fa.ftLastWriteTime.dwLowDateTime;
+  _fat_time((time_t)((ft - 116444736000000000ull) / 10000000),
+            &e->time, &e->date);
+  e->attr = (fa.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ?
+    ATTR_DIR : ATTR_ARCHIVE;
+  e->attr |= (fa.dwFileAttributes & FILE_ATTRIBUTE_READONLY) ?
+    ATTR_READ_ONLY : 0;
+  e->size = fa.nFileSizeHigh ? 0xffffffffu : fa.nFileSizeLow;
+  e->size = (e->attr & ATTR_DIR) ? 0 : e->size;
+  return true;
+}
+#else
+static bool _host_truncate(FILE *fd, const uint32_t size) {
+  return ftruncate(fileno(fd), (off_t)size) == 0;
+}
+
+static bool _host_stat(const char *path, struct host_entry_t *e) {
+  struct stat st;
+  if (stat(path, &st) != 0 ||
+      !(S_ISREG(st.st_mode) || S_ISDIR(st.st_mode))) {
+    return false;
+  }
+  _fat_time(st.st_mtime, &e->time, &e->date);
+  e->attr = S_ISDIR(st.st_mode) ? ATTR_DIR : ATTR_ARCHIVE;
+  e->attr |= (access(path, W_OK) != 0) ? ATTR_READ_ONLY : 0;
+  e->size = (st.st_size > 0xffffffff) ? 0xffffffffu : (uint32_t)st.st_size;
+  e->size = S_ISDIR(st.st_mode) ? 0 : e->size;
+  return true;
+}
+#endif
+
+// call `fn` for each name in host directory `dir`
+static bool _host_list(const char *dir,
+                       bool (*fn)(const char *name, void *user), void *user) {
+#ifdef _WIN32
+  char pattern[HOST_PATH_MAX + 2];
+  snprintf(pattern, sizeof(pattern), "%s/*", dir);
+  WIN32_FIND_DATAA fd;
+  HANDLE find = FindFirstFileA(pattern, &fd);
+  if (find == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  while (fn(fd.cFileName, user) && FindNextFileA(find, &fd));
+  FindClose(find);
+#else
+  DIR *d = opendir(dir);
+  if (!d) {
+    return false;
+  }
+  struct dirent *e;
+  while ((e = readdir(d)) && fn(e->d_name, user));
+  closedir(d);
+#endif
+  return true;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- paths
+
+// DOS 8.3 form of a host name, false if it has none
+static bool _dos_name(const char *name, char *out) {
+  static const char *valid = "!#$%&'()-@^_`{}~";
+  const char *dot = strchr(name, '.');
+  const size_t len = strlen(name);
+  const size_t base = dot ? (size_t)(dot - name) : len;
+  if (base == 0 || base > 8 || (dot && (strchr(dot + 1, '.') ||
+                                        len - base - 1 > 3))) {
+    return false;
+  }
+  for (size_t i = 0; i <= len; ++i) {
+    const char c = name[i];
+    if (c && c != '.' && !isalnum((uint8_t)c) && !strchr(valid, c)) {
+      return false;
+    }
+    out[i] = (char)toupper((uint8_t)c);
+  }
+  return true;
+}
+
+struct host_match_t {
+  const char *want;
+  char *out;
+  bool found;
+};
+
+static bool _match_name(const char *name, void *user) {
+  struct host_match_t *m = (struct host_match_t*)user;
+  char dos[13];
+  if (_dos_name(name, dos) && strcmp(dos, m->want) == 0) {
+    strcpy(m->out, name);
+    m->found = true;
+    return false;
+  }
+  return true;
+}
+
+// append to directory `path` the host name matching guest name `want`, which
+// is used as given when nothing matches
+static void _host_name(char *path, size_t len, const char *want) {
+  char *out = path + len;
+  *out++ = '/';
+  strcpy(out, want);
+#ifndef _WIN32
+  // host names may be in any case
+  struct host_entry_t e;
+  if (!_host_stat(path, &e)) {
+    char upper[13];
+    struct host_match_t m = {upper, out, false};
+    if (strlen(want) < sizeof(upper) && _dos_name(want, upper)) {
+      path[len] = '\0';
+      _host_list(path, _match_name, &m);
+      path[len] = '/';
+      if (!m.found) {
+        strcpy(out, want);
+      }
+    }
+  }
+#endif
+}
+
+// read the ASCIIZ guest string at `addr`
+static bool _guest_string(uint32_t addr, char *out, const uint32_t size) {
+  for (uint32_t i = 0; i < size; ++i) {
+    out[i] = (char)read86((addr + i) & 0xFFFFF);
+    if (!out[i]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// is the guest path at DS:DX on the host drive, given a drive if it has none
+static bool _is_host(char *path) {
+  if (!_letter || !_guest_string((cpu_regs.ds << 4) + cpu_regs.dx, path + 2,
+                                 128)) {
+    return false;
+  }
+  if (path[3] == ':') {
+    memmove(path, path + 2, strlen(path + 2) + 1);
+    return toupper((uint8_t)path[0]) == _letter;
+  }
+  path[0] = _letter;
+  path[1] = ':';
+  return _default;
+}
+
+// host path of a guest path on the host drive, the last `keep` components
+// are left off
+static uint8_t _host_path(const char *guest, char *out, const uint32_t keep) {
+  char comp[64][13];
+  uint32_t depth = 0;
+  const char *p = guest + 2;
+  for (;;) {
+    while (*p == '\\' || *p == '/') {
+      ++p;
+    }
+    if (!*p) {
+      break;
+    }
+    const char *end = p;
+    while (*end && *end != '\\' && *end != '/') {
+      ++end;
+    }
+    const size_t len = end - p;
+    if (len > 12 || depth >= 64) {
+      return ERR_NO_PATH;
+    }
+    if (len == 2 && p[0] == '.' && p[1] == '.') {
+      if (depth == 0) {
+        return ERR_NO_PATH;
+      }
+      --depth;
+    }
+    else if (!(len == 1 && p[0] == '.')) {
+      memcpy(comp[depth], p, len);
+      comp[depth][len] = '\0';
+      ++depth;
+    }
+    p = end;
+  }
+  if (depth < keep) {
+    return ERR_NO_PATH;
+  }
+  strcpy(out, _root);
+  size_t len = strlen(out);
+  for (uint32_t i = 0; i < depth - keep; ++i) {
+    if (len + 14 >= HOST_PATH_MAX) {
+      return ERR_NO_PATH;
+    }
+    _host_name(out, len, comp[i]);
+    len = strlen(out);
+  }
+  return 0;
+}
+
+// host path of a guest file, its directory must exist
+static uint8_t _host_file(const char *guest, char *out) {
+  char dir[HOST_PATH_MAX];
+  struct host_entry_t e;
+  uint8_t err = _host_path(guest, dir, 1);
+  if (err) {
+    return err;
+  }
+  if (!_host_stat(dir, &e) || !(e.attr & ATTR_DIR)) {
+    return ERR_NO_PATH;
+  }
+  return _host_path(guest, out, 0) ? ERR_NOT_FOUND : 0;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- programs
+
+// PSP segment of the running program, 0 if it can't be found
+static uint16_t _current_psp(void) {
+  if (_psp || _psp_set) {
+    return _psp ? _psp : _psp_set;
+  }
+  // the owner of the memory control block covering the calling code
+  const uint32_t cs = cpu_regs.cs;
+  for (uint32_t seg = cs; seg-- > 0x40;) {
+    const uint32_t mcb = seg << 4;
+    const uint8_t type = read86(mcb);
+    if ((type != 'M' && type != 'Z') || cs >= seg + 1 + readw86(mcb + 3)) {
+      continue;
+    }
+    const uint16_t owner = readw86(mcb + 1);
+    if (owner >= 0x40 && read86(owner << 4) == 0xcd &&
+        read86((owner << 4) + 1) == 0x20) {
+      return owner;
+    }
+  }
+  return 0;
+}
+
+// linear address of job file table entry `handle` of `psp`, 0 past its end
+static uint32_t _jft_entry(const uint16_t psp, const uint16_t handle) {
+  const uint32_t base = psp << 4;
+  uint32_t size = readw86(base + 0x32);
+  uint32_t table = (readw86(base + 0x36) << 4) + readw86(base + 0x34);
+  if (size == 0) {
+    // DOS 2 has only the table in the PSP
+    size = 20;
+    table = base + 0x18;
+  }
+  return (handle < size) ? ((table + handle) & 0xFFFFF) : 0;
+}
+
+// the DTA of the running program
+static uint32_t _dta_addr(void) {
+  const uint16_t psp = _current_psp();
+  if (psp && psp == _dta_psp) {
+    return _dta;
+  }
+  return psp ? (psp << 4) + 0x80 : 0;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- handles
+
+static struct host_file_t *_handle(const uint16_t handle) {
+  uint16_t psp = 0;
+  for (uint32_t i = 0; i < HOST_FILES; ++i) {
+    struct host_file_t *f = _file + i;
+    if (!f->fd || f->handle != handle) {
+      continue;
+    }
+    psp = psp ? psp : _current_psp();
+    if (f->psp == psp) {
+      const uint32_t entry = _jft_entry(psp, handle);
+      return (entry && read86(entry) == HOST_JFT_MARK) ? f : NULL;
+    }
+  }
+  return NULL;
+}
+
+// close a host file and give its handle back
+static bool _release(struct host_file_t *f) {
+  const uint32_t entry = _jft_entry(f->psp, f->handle);
+  if (entry && read86(entry) == HOST_JFT_MARK) {
+    write86(entry, 0xff);
+  }
+  FILE *fd = f->fd;
+  f->fd = NULL;
+  return fclose(fd) == 0;
+}
+
+// ready a file for reading or writing
+static FILE *_direction(struct host_file_t *f, const bool write) {
+  if (f->writing != write) {
+    fseek(f->fd, 0, SEEK_CUR);
+    f->writing = write;
+  }
+  return f->fd;
+}
+
+static void _ok(void) {
+  cpu_flags.cf = 0;
+}
+
+static void _fail(const uint8_t err) {
+  cpu_regs.ax = err;
+  cpu_flags.cf = 1;
+}
+
+static void _open(const char *guest, const char *mode, const bool create) {
+  char path[HOST_PATH_MAX];
+  uint8_t err = _host_file(guest, path);
+  if (err) {
+    _fail(err);
+    return;
+  }
+  uint32_t i = 0;
+  for (; i < HOST_FILES && _file[i].fd; ++i);
+  if (i == HOST_FILES) {
+    _fail(ERR_TOO_MANY);
+    return;
+  }
+  // a free handle of the running program
+  const uint16_t psp = _current_psp();
+  uint16_t handle = 0;
+  uint32_t entry = 0;
+  for (; psp && (entry = _jft_entry(psp, handle)) != 0; ++handle) {
+    if (read86(entry) == 0xff) {
+      break;
+    }
+  }
+  if (!entry) {
+    _fail(ERR_TOO_MANY);
+    return;
+  }
+  struct host_entry_t e;
+  const bool exists = _host_stat(path, &e);
+  if ((!create && !exists) || (exists && (e.attr & ATTR_DIR))) {
+    _fail(exists ? ERR_DENIED : ERR_NOT_FOUND);
+    return;
+  }
+  _file[i].fd = fopen(path, mode);
+  _file[i].writing = false;
+  if (!_file[i].fd) {
+    _fail(ERR_DENIED);
+    return;
+  }
+  _file[i].psp = psp;
+  _file[i].handle = handle;
+  write86(entry, HOST_JFT_MARK);
+  cpu_regs.ax = handle;
+  _ok();
+}
+
+// 3Ch
+static void _on_create(const char *guest) {
+  _open(guest, "w+b", true);
+}
+
+// 3Dh
+static void _on_open(const char *guest) {
+  _open(guest, (cpu_regs.al & 7) ? "r+b" : "rb", false);
+}
+
+// 3Eh
+static void _on_close(struct host_file_t *f) {
+  if (!_release(f)) {
+    _fail(ERR_DENIED);
+    return;
+  }
+  _ok();
+}
+
+// 3Fh
+static void _on_read(struct host_file_t *f) {
+  FILE *fd = _direction(f, false);
+  const uint32_t addr = (cpu_regs.ds << 4) + cpu_regs.dx;
+  const uint32_t count = cpu_regs.cx;
+  size_t done;
+  if (addr + count <= 0xA0000) {
+    // straight into guest memory
+    done = fread(RAM + addr, 1, count, fd);
+  }
+  else {
+    uint8_t buf[0x10000];
+    done = fread(buf, 1, count, fd);
+    mem_write(addr & 0xFFFFF, buf, done);
+  }
+  if (ferror(fd)) {
+    clearerr(fd);
+    _fail(ERR_DENIED);
+    return;
+  }
+  cpu_regs.ax = (uint16_t)done;
+  _ok();
+}
+
+// 40h
+static void _on_write(struct host_file_t *f) {
+  FILE *fd = _direction(f, true);
+  const uint32_t addr = (cpu_regs.ds << 4) + cpu_regs.dx;
+  const uint32_t count = cpu_regs.cx;
+  if (count == 0) {
+    // truncate or extend to the file pointer
+    const long pos = ftell(fd);
+    if (pos < 0 || fflush(fd) != 0 || !_host_truncate(fd, (uint32_t)pos)) {
+      _fail(ERR_DENIED);
+      return;
+    }
+    cpu_regs.ax = 0;
+    _ok();
+    return;
+  }
+  size_t done;
+  if (addr + count <= 0xA0000) {
+    done = fwrite(RAM + addr, 1, count, fd);
+  }
+  else {
+    uint8_t buf[0x10000];
+    mem_read(buf, addr & 0xFFFFF, count);
+    done = fwrite(buf, 1, count, fd);
+  }
+  if (done == 0) {
+    _fail(ERR_DENIED);
+    return;
+  }
+  cpu_regs.ax = (uint16_t)done;
+  _ok();
+}
+
+// 41h
+static void _on_delete(const char *guest) {
+  char path[HOST_PATH_MAX];
+  struct host_entry_t e;
+  const uint8_t err = _host_file(guest, path);
+  if (err || !_host_stat(path, &e) || (e.attr & ATTR_DIR)) {
+    _fail(err ? err : ERR_NOT_FOUND);
+    return;
+  }
+  if (remove(path) != 0) {
+    _fail(ERR_DENIED);
+    return;
+  }
+  _ok();
+}
+
+// 42h
+static void _on_seek(struct host_file_t *f) {
+  FILE *fd = f->fd;
+  static const int whence[] = {SEEK_SET, SEEK_CUR, SEEK_END};
+  if (cpu_regs.al > 2) {
+    _fail(ERR_FUNCTION);
+    return;
+  }
+  const int32_t offset = (int32_t)(((uint32_t)cpu_regs.cx << 16) |
+                                   cpu_regs.dx);
+  if (fseek(fd, offset, whence[cpu_regs.al]) != 0) {
+    _fail(ERR_FUNCTION);
+    return;
+  }
+  const long pos = ftell(fd);
+  cpu_regs.dx = (uint16_t)(pos >> 16);
+  cpu_regs.ax = (uint16_t)pos;
+  _ok();
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- find
+
+// FCB form of a file spec, * fills the rest of a field with ?
+static void _fcb_name(const char *spec, char *out) {
+  memset(out, ' ', 11);
+  uint32_t i = 0, limit = 8;
+  for (const char *c = spec; *c; ++c) {
+    if (*c == '.') {
+      i = 8;
+      limit = 11;
+    }
+    else if (*c == '*') {
+      while (i < limit) {
+        out[i++] = '?';
+      }
+    }
+    else if (i < limit) {
+      out[i++] = (char)toupper((uint8_t)*c);
+    }
+  }
+}
+
+static bool _fcb_match(const char *fcb, const char *name) {
+  char n[11];
+  _fcb_name(name, n);
+  if (name[0] == '.') {
+    // . and .. are not split at their dot
+    memset(n, ' ', 11);
+    memcpy(n, name, strlen(name));
+  }
+  for (uint32_t i = 0; i < 11; ++i) {
+    if (fcb[i] != '?' && fcb[i] != n[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+struct host_scan_t {
+  struct host_find_t *find;
+  const char *dir;
+  const char *fcb;
+  uint8_t attr;
+};
+
+static bool _find_add(struct host_find_t *f, const struct host_entry_t *e) {
+  if ((f->count & 15) == 0) {
+    struct host_entry_t *n = (struct host_entry_t*)realloc(
+      f->entry, (f->count + 16) * sizeof(*n));
+    if (!n) {
+      return false;
+    }
+    f->entry = n;
+  }
+  f->entry[f->count++] = *e;
+  return true;
+}
+
+static bool _find_name(const char *name, void *user) {
+  struct host_scan_t *s = (struct host_scan_t*)user;
+  struct host_entry_t e;
+  char path[HOST_PATH_MAX];
+  if (name[0] == '.' || !_dos_name(name, e.name) ||
+      !_fcb_match(s->fcb, e.name) ||
+      snprintf(path, sizeof(path), "%s/%s", s->dir, name) >=
+        (int)sizeof(path) ||
+      !_host_stat(path, &e)) {
+    return true;
+  }
+  // plain files are always found, directories only when asked for
+  if ((e.attr & ATTR_DIR) && !(s->attr & ATTR_DIR)) {
+    return true;
+  }
+  return _find_add(s->find, &e);
+}
+
+// write the next entry of a search to the DTA
+static void _find_step(struct host_find_t *f, const uint32_t slot) {
+  if (f->next >= f->count) {
+    _fail(ERR_NO_MORE);
+    return;
+  }
+  const struct host_entry_t *e = f->entry + f->next++;
+  const uint32_t dta = _dta_addr();
+  // reserved area, marked as a remote drive as a redirector would
+  write86(dta + 0, 0x80 | (_letter - 'A' + 1));
+  writew86(dta + 13, (uint16_t)slot);
+  writew86(dta + 15, f->stamp);
+  write86(dta + 21, e->attr);
+  writew86(dta + 22, e->time);
+  writew86(dta + 24, e->date);
+  writew86(dta + 26, (uint16_t)e->size);
+  writew86(dta + 28, (uint16_t)(e->size >> 16));
+  for (uint32_t i = 0; i < 13; ++i) {
+    write86(dta + 30 + i, (uint8_t)e->name[i]);
+  }
+  cpu_regs.ax = 0;
+  _ok();
+}
+
+// 4Eh
+static void _on_find_first(const char *guest) {
+  if (!_dta_addr()) {
+    log_printf(LOG_CHAN_DOS, "find first on host drive with no program "
+               "running");
+    _fail(ERR_NO_MORE);
+    return;
+  }
+  char dir[HOST_PATH_MAX];
+  struct host_entry_t e;
+  if (_host_path(guest, dir, 1) || !_host_stat(dir, &e) ||
+      !(e.attr & ATTR_DIR)) {
+    _fail(ERR_NO_PATH);
+    return;
+  }
+  const char *spec = guest + strlen(guest);
+  while (spec > guest + 2 && spec[-1] != '\\' && spec[-1] != '/') {
+    --spec;
+  }
+  char fcb[11];
+  _fcb_name(*spec ? spec : "*.*", fcb);
+
+  const uint32_t slot = _find_next;
+  _find_next = (_find_next + 1) % HOST_FINDS;
+  struct host_find_t *f = _find + slot;
+  f->count = f->next = 0;
+  f->stamp = ++_find_stamp;
+
+  // volume labels only
+  if (cpu_regs.cx & ATTR_VOLUME && !(cpu_regs.cx & ATTR_DIR)) {
+    _fail(ERR_NO_MORE);
+    return;
+  }
+  struct host_scan_t s = {f, dir, fcb, cpu_regs.cl};
+  if (strcmp(dir, _root) && (s.attr & ATTR_DIR)) {
+    // every directory but the root holds . and ..
+    e.attr = ATTR_DIR;
+    e.size = 0;
+    strcpy(e.name, ".");
+    if (_fcb_match(fcb, e.name)) {
+      _find_add(f, &e);
+    }
+    strcpy(e.name, "..");
+    if (_fcb_match(fcb, e.name)) {
+      _find_add(f, &e);
+    }
+  }
+  _host_list(dir, _find_name, &s);
+  if (f->count == 0) {
+    _fail(ERR_NOT_FOUND);
+    return;
+  }
+  _find_step(f, slot);
+}
+
+// 4Fh, false if the search is not one of ours
+static bool _on_find_next(void) {
+  const uint32_t dta = _dta_addr();
+  if (!dta || read86(dta) != (0x80 | (_letter - 'A' + 1))) {
+    return false;
+  }
+  const uint32_t slot = readw86(dta + 13);
+  if (slot >= HOST_FINDS || _find[slot].stamp != readw86(dta + 15)) {
+    _fail(ERR_NO_MORE);
+    return true;
+  }
+  _find_step(_find + slot, slot);
+  return true;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- interface
+
+bool dos_host_mount(const char letter, const char *path) {
+  const char upper = (char)toupper((uint8_t)letter);
+  struct host_entry_t e;
+  if (upper < 'C' || upper > 'Z' || strlen(path) >= HOST_PATH_MAX - 16 ||
+      !_host_stat(path, &e) || !(e.attr & ATTR_DIR)) {
+    log_printf(LOG_CHAN_DOS, "unable to mount '%s' as drive %c:", path,
+               letter);
+    return false;
+  }
+  strcpy(_root, path);
+  _letter = upper;
+  log_printf(LOG_CHAN_DOS, "'%s' mounted as drive %c:", path, upper);
+  return true;
+}
+
+char dos_host_letter(void) {
+  return _letter;
+}
+
+void dos_host_default(const bool on) {
+  _default = on;
+}
+
+void dos_host_set_psp(const uint16_t seg) {
+  _psp = seg;
+}
+
+void dos_host_terminate(void) {
+  if (!_letter) {
+    return;
+  }
+  uint16_t psp = 0;
+  for (uint32_t i = 0; i < HOST_FILES; ++i) {
+    psp = (psp || !_file[i].fd) ? psp : _current_psp();
+    if (_file[i].fd && _file[i].psp == psp) {
+      _release(_file + i);
+    }
+  }
+  // the parent's PSP:80h is the DTA again
+  _dta_psp = 0;
+  _psp_set = 0;
+}
+
+bool dos_host_int(void) {
+  char guest[130];
+  struct host_file_t *f;
+  if (!_letter) {
+    return false;
+  }
+  // calls followed but left to DOS
+  switch (cpu_regs.ah) {
+  case 0x00:
+  case 0x4C:
+    dos_host_terminate();
+    return false;
+  case 0x1A:
+    _dta = ((cpu_regs.ds << 4) + cpu_regs.dx) & 0xFFFFF;
+    _dta_psp = _current_psp();
+    return false;
+  case 0x4B:
+    if (cpu_regs.al <= 1) {
+      // the child is found from its own code from here on
+      _psp_set = 0;
+    }
+    return false;
+  case 0x50:
+    // the DTA stays where it is
+    _dta = _dta_addr();
+    _dta_psp = cpu_regs.bx;
+    _psp_set = cpu_regs.bx;
+    return false;
+  }
+  switch (cpu_regs.ah) {
+  case 0x3C:
+    if (_is_host(guest)) {
+      _on_create(guest);
+      return true;
+    }
+    return false;
+  case 0x3D:
+    if (_is_host(guest)) {
+      _on_open(guest);
+      return true;
+    }
+    return false;
+  case 0x41:
+    if (_is_host(guest)) {
+      _on_delete(guest);
+      return true;
+    }
+    return false;
+  case 0x4E:
+    if (_is_host(guest)) {
+      _on_find_first(guest);
+      return true;
+    }
+    return false;
+  case 0x4F:
+    return _letter && _on_find_next();
+  case 0x3E:
+  case 0x3F:
+  case 0x40:
+  case 0x42:
+    f = _handle(cpu_regs.bx);
+    if (!f) {
+      return false;
+    }
+    switch (cpu_regs.ah) {
+    case 0x3E: _on_close(f); break;
+    case 0x3F: _on_read(f);  break;
+    case 0x40: _on_write(f); break;
+    case 0x42: _on_seek(f);  break;
+    }
+    return true;
+  }
+  return false;
+}
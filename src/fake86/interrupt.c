@@ -37,12 +37,14 @@ void intcall86(uint16_t intnum) {
   switch (intnum) {
   // Video services
   case 0x10:
+    dos_int10();
     if (neo_int10_handler()) {
       return;
     }
     break;
   // Bootstrap loader interupt
   case 0x19:
+    dos_boot();
     disk_bootstrap(intnum);
     return;
   // Disk services
@@ -50,6 +52,19 @@ void intcall86(uint16_t intnum) {
   case 0xFD:
     disk_int_handler(intnum);
     return;
+  // DOS program terminate
+  case 0x20:
+    dos_host_terminate();
+    if (dos_exec_int(0x20)) {
+      return;
+    }
+    break;
+  // DOS fast console output
+  case 0x29:
+    if (dos_exec_int(0x29)) {
+      return;
+    }
+    break;
   // DOS services
   case 0x21:
     if (on_dos_int()) {
@@ -42,6 +42,12 @@ void write86(uint32_t addr, uint8_t value) {
       RAM[addr] = value;
       return;
     }
+    // chain-4 writes with nothing to process go straight to video memory
+    if (neo_chain4_ram) {
+      neo_chain4_ram[addr - 0xA0000] = value;
+      neo_vga_dirty |= 1u << ((addr - 0xA0000) >> 14);
+      return;
+    }
     neo_mem_write_A0000(addr, value); // vga/ega
     return;
   }
@@ -59,18 +65,45 @@ void writew86(uint32_t addr32, uint16_t value) {
   if (addr32 < 0xA0000) {
     *(uint16_t*)(RAM + addr32) = value;
   }
+  else if (addr32 < 0xAFFFF) {
+    neo_mem_writew_A0000(addr32, value);
+  }
   else {
     write86(addr32 + 0, (uint8_t)(value >> 0));
     write86(addr32 + 1, (uint8_t)(value >> 8));
   }
 }
 
-void mem_write(uint32_t addr, const uint8_t *src, size_t size) {
+// memory regions which can be accessed in bulk
+enum mem_region_t {
+  region_ram,    // plain memory
+  region_vga,    // vga window A0000-AFFFF
+  region_other,  // rom or a range spanning regions
+};
+
+static enum mem_region_t _mem_region(uint32_t addr, uint32_t size) {
   const uint32_t end = addr + size;
   if (end <= 0xA0000) {
-    memcpy(RAM + addr, src, size);
+    return region_ram;
   }
-  else {
+  if (addr >= 0xA0000 && end <= 0xB0000) {
+    return region_vga;
+  }
+  if (addr >= 0xB0000 && end <= 0xC0000) {
+    return region_ram;
+  }
+  return region_other;
+}
+
+void mem_write(uint32_t addr, const uint8_t *src, size_t size) {
+  switch (_mem_region(addr, size)) {
+  case region_ram:
+    memcpy(RAM + addr, src, size);
+    break;
+  case region_vga:
+    neo_mem_write_block(addr, src, size);
+    break;
+  default:
     for (uint32_t i = 0; i < size; i++) {
       write86(addr + i, src[i]);
     }
@@ -78,17 +111,69 @@ void mem_write(uint32_t addr, const uint8_t *src, size_t size) {
 }
 
 void mem_read(uint8_t *dst, uint32_t addr, size_t size) {
-  const uint32_t end = addr + size;
-  if (end <= 0xA0000) {
+  switch (_mem_region(addr, size)) {
+  case region_ram:
     memcpy(dst, RAM + addr, size);
-  }
-  else {
+    break;
+  case region_vga:
+    neo_mem_read_block(dst, addr, size);
+    break;
+  default:
     for (uint32_t i = 0; i < size; i++) {
       dst[i] = read86(addr + i);
     }
   }
 }
 
+bool mem_fill(uint32_t addr, uint16_t value, uint32_t count, uint32_t size) {
+  const uint32_t bytes = count * size;
+  switch (_mem_region(addr, bytes)) {
+  case region_ram:
+    if (size == 1) {
+      memset(RAM + addr, (uint8_t)value, bytes);
+    }
+    else {
+      for (uint32_t i = 0; i < bytes; i += 2) {
+        RAM[addr + i + 0] = (uint8_t)(value >> 0);
+        RAM[addr + i + 1] = (uint8_t)(value >> 8);
+      }
+    }
+    return true;
+  case region_vga:
+    neo_mem_fill(addr, value, count, size);
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool mem_move(uint32_t dst, uint32_t src, uint32_t count, uint32_t size) {
+  const uint32_t bytes = count * size;
+  const enum mem_region_t rd = _mem_region(dst, bytes);
+  const enum mem_region_t rs = _mem_region(src, bytes);
+  if (rd == region_vga && rs == region_vga) {
+    neo_mem_move(dst, src, count, size);
+    return true;
+  }
+  if (rd == region_vga && rs == region_ram) {
+    neo_mem_write_block(dst, RAM + src, bytes);
+    return true;
+  }
+  if (rd == region_ram && rs == region_vga) {
+    neo_mem_read_block(RAM + dst, src, bytes);
+    return true;
+  }
+  if (rd == region_ram && rs == region_ram) {
+    // a forward copy onto itself repeats the source which memmove won't do
+    if (dst > src && dst < src + bytes) {
+      return false;
+    }
+    memmove(RAM + dst, RAM + src, bytes);
+    return true;
+  }
+  return false;
+}
+
 uint8_t read86(uint32_t addr) {
   addr &= 0xFFFFF;
 
@@ -116,6 +201,9 @@ uint16_t readw86(uint32_t addr) {
     if (addr >= 0xB0000) {
       return *(const uint16_t*)(RAM + addr);
     }
+    if (addr < 0xAFFFF) {
+      return neo_mem_readw_A0000(addr);
+    }
     return (uint16_t)(read86(addr + 0) << 0) |
            (uint16_t)(read86(addr + 1) << 8);
   }
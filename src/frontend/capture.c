@@ -0,0 +1,381 @@
+/*
+  Fake86: A portable, open-source 8086 PC emulator.
+  Copyright (C)2010-2013 Mike Chambers
+               2019      Aidan Dodds
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+  USA.
+*/
+
+// headless frame capture
+//
+// at vblank the emulator snapshots the video state into a small ring. a
+// worker thread renders each snapshot into a memory buffer the size of the
+// window and writes it to the y4m stream and/or a png file. the emulator only
+// waits when the worker has fallen a full ring behind.
+//
+// frames can also be logged as 64 bit hashes with their cycle count. a state
+// hash covers vga memory, text memory, mode and palette and is computed at
+// vblank without rendering. a frame hash is taken of the rendered buffer on
+// the worker. both only rehash what changed since the last frame.
+
+#include "frontend.h"
+#include "../video/video.h"
+
+
+// snapshots in flight between the emulator and the worker
+#define CAPTURE_SLOTS 4
+#define SHOT_MAX 8
+
+struct capture_job_t {
+  struct video_snapshot_t snap;
+  // write to the video stream
+  bool video;
+  // write a png here if not NULL
+  const char *png;
+  // log a hash of the rendered frame
+  bool hash;
+  uint32_t frame;
+  uint64_t cycles;
+};
+
+struct shot_t {
+  uint64_t cycles;
+  const char *path;
+  bool taken;
+};
+
+static const char *_video_path;
+// frames per vblank written to the stream
+static uint32_t _video_every;
+static struct shot_t _shots[SHOT_MAX];
+static uint32_t _shot_count;
+
+static const char *_hash_path;
+static bool _hash_rendered;
+
+static FILE *_video;
+static FILE *_hash;
+// hash of each row of the render buffer
+static uint64_t *_row_hash;
+static uint32_t *_buffer;
+static uint32_t _width, _height;
+static uint8_t *_yuv;
+// vblanks since the stream started
+static uint32_t _vblank;
+
+static struct capture_job_t _ring[CAPTURE_SLOTS];
+// vga memory pages which are stale in each slot
+static uint32_t _ring_pages[CAPTURE_SLOTS];
+// next slot to fill and jobs waiting for the worker
+static uint32_t _head, _count;
+
+// any capture was asked for
+static bool _active;
+static SDL_Thread *_thread;
+static SDL_mutex *_mux;
+static SDL_cond *_cond;
+static bool _quit;
+
+
+void capture_set_video(const char *path) {
+  _video_path = path;
+}
+
+bool capture_add_shot(const uint64_t cycles, const char *path) {
+  if (_shot_count >= SHOT_MAX) {
+    return false;
+  }
+  _shots[_shot_count].cycles = cycles;
+  _shots[_shot_count].path = path;
+  _shots[_shot_count].taken = false;
+  ++_shot_count;
+  return true;
+}
+
+void capture_set_hash(const char *path, const bool rendered) {
+  _hash_path = path;
+  _hash_rendered = rendered;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- hash log
+
+static void _hash_log(const uint32_t frame, const uint64_t cycles,
+                      const uint64_t hash) {
+  fprintf(_hash, "%u %llu %016llx\n", frame, (unsigned long long)cycles,
+          (unsigned long long)hash);
+}
+
+// hash of the render buffer, rows outside the dirty regions keep their hash
+static uint64_t _frame_hash(const struct render_dirty_t *dirty) {
+  const size_t row = _width * sizeof(uint32_t);
+  if (dirty->full) {
+    for (uint32_t y = 0; y < _height; ++y) {
+      _row_hash[y] = hash64(_buffer + y * _width, row, 0);
+    }
+  }
+  else {
+    for (uint32_t i = 0; i < dirty->count; ++i) {
+      const struct render_rect_t *r = &dirty->rect[i];
+      for (uint32_t y = r->y; y < r->y + r->h; ++y) {
+        _row_hash[y] = hash64(_buffer + y * _width, row, 0);
+      }
+    }
+  }
+  return hash64(_row_hash, _height * sizeof(uint64_t), _height);
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- y4m
+
+static bool _y4m_header(void) {
+  // frames per emulated second as a ratio, allowing for skipped frames
+  const uint32_t rate = (uint32_t)(vga_timing_refresh() * 1000.0);
+  return fprintf(_video, "YUV4MPEG2 W%u H%u F%u:%u Ip A1:1 C420jpeg\n",
+                 _width, _height, rate, 1000 * _video_every) > 0;
+}
+
+// full range BT.601 in 16 bit fixed point
+static inline uint8_t _luma(const uint32_t rgb) {
+  const int32_t r = (rgb >> 16) & 0xff, g = (rgb >> 8) & 0xff, b = rgb & 0xff;
+  return (uint8_t)((19595 * r + 38470 * g + 7471 * b + 32768) >> 16);
+}
+
+// chroma from the sum of four pixels
+static inline uint8_t _chroma(const int32_t r, const int32_t g, const int32_t b,
+                              const int32_t kr, const int32_t kg,
+                              const int32_t kb) {
+  const int32_t v = (kr * r + kg * g + kb * b + (128 << 18) + (1 << 17)) >> 18;
+  return (uint8_t)SDL_max(0, SDL_min(v, 255));
+}
+
+static void _y4m_frame(void) {
+  const uint32_t cw = (_width + 1) / 2, ch = (_height + 1) / 2;
+  uint8_t *y = _yuv;
+  uint8_t *u = y + _width * _height;
+  uint8_t *v = u + cw * ch;
+  for (uint32_t j = 0; j < _height; ++j) {
+    const uint32_t *row = _buffer + j * _width;
+    for (uint32_t i = 0; i < _width; ++i) {
+      *y++ = _luma(row[i]);
+    }
+  }
+  // chroma from the average of each 2x2 block
+  for (uint32_t j = 0; j < ch; ++j) {
+    const uint32_t *r0 = _buffer + (j * 2) * _width;
+    const uint32_t *r1 = (j * 2 + 1 < _height) ? (r0 + _width) : r0;
+    for (uint32_t i = 0; i < cw; ++i) {
+      const uint32_t i1 = (i * 2 + 1 < _width) ? (i * 2 + 1) : (i * 2);
+      const uint32_t px[4] = { r0[i * 2], r0[i1], r1[i * 2], r1[i1] };
+      int32_t r = 0, g = 0, b = 0;
+      for (uint32_t k = 0; k < 4; ++k) {
+        r += (px[k] >> 16) & 0xff;
+        g += (px[k] >> 8) & 0xff;
+        b += px[k] & 0xff;
+      }
+      *u++ = _chroma(r, g, b, -11059, -21709, 32768);
+      *v++ = _chroma(r, g, b, 32768, -27439, -5329);
+    }
+  }
+  const size_t size = _width * _height + cw * ch * 2;
+  if (fputs("FRAME\n", _video) < 0 || fwrite(_yuv, 1, size, _video) != size) {
+    log_printf(LOG_CHAN_FRONTEND, "unable to write to '%s'", _video_path);
+    fclose(_video);
+    _video = NULL;
+  }
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- worker
+
+static void _process(const struct capture_job_t *job) {
+  const struct render_target_t target = {
+    _buffer, _width, _height, _width
+  };
+  // only the worker renders so the buffer holds the last frame and the
+  // renderer can update it incrementally
+  struct render_dirty_t dirty;
+  neo_render_tick(&job->snap, &target, &dirty);
+
+  if (job->hash) {
+    _hash_log(job->frame, job->cycles, _frame_hash(&dirty));
+  }
+  if (job->video && _video) {
+    _y4m_frame();
+  }
+  if (job->png) {
+    if (png_write(job->png, _buffer, _width, _height, _width)) {
+      log_printf(LOG_CHAN_FRONTEND, "saved screenshot '%s'", job->png);
+    }
+  }
+}
+
+static int _worker(void *data) {
+  (void)data;
+  SDL_mutexP(_mux);
+  for (;;) {
+    while (!_count && !_quit) {
+      SDL_CondWait(_cond, _mux);
+    }
+    if (!_count) {
+      break;
+    }
+    const uint32_t slot = (_head + CAPTURE_SLOTS - _count) % CAPTURE_SLOTS;
+    SDL_mutexV(_mux);
+    _process(&_ring[slot]);
+    SDL_mutexP(_mux);
+    --_count;
+    SDL_CondSignal(_cond);
+  }
+  SDL_mutexV(_mux);
+  return 0;
+}
+
+static bool _hash_init(void) {
+  _hash = fopen(_hash_path, "w");
+  if (!_hash) {
+    log_printf(LOG_CHAN_FRONTEND, "unable to open file '%s'", _hash_path);
+    return false;
+  }
+  fprintf(_hash, "# frame cycles %s\n",
+          _hash_rendered ? "frame_hash" : "state_hash");
+  return true;
+}
+
+bool capture_init(void) {
+  _active = _video_path || _shot_count || _hash_path;
+  if (_hash_path && !_hash_init()) {
+    return false;
+  }
+  // a state hash is all that needs no rendering
+  if (!_video_path && !_shot_count && !_hash_rendered) {
+    return true;
+  }
+  _width = win_width;
+  _height = win_height;
+  _video_every = frame_skip ? frame_skip : 1;
+  _buffer = calloc(_width * _height, sizeof(uint32_t));
+  const uint32_t chroma = ((_width + 1) / 2) * ((_height + 1) / 2);
+  _yuv = malloc(_width * _height + chroma * 2);
+  _row_hash = calloc(_height, sizeof(uint64_t));
+  if (!_buffer || !_yuv || !_row_hash) {
+    return false;
+  }
+  if (_video_path) {
+    _video = fopen(_video_path, "wb");
+    if (!_video || !_y4m_header()) {
+      log_printf(LOG_CHAN_FRONTEND, "unable to open file '%s'", _video_path);
+      return false;
+    }
+  }
+  for (uint32_t i = 0; i < CAPTURE_SLOTS; ++i) {
+    _ring_pages[i] = ~0u;
+  }
+  _mux = SDL_CreateMutex();
+  _cond = SDL_CreateCond();
+  _thread = SDL_CreateThread(_worker, NULL);
+  if (!_mux || !_cond || !_thread) {
+    log_printf(LOG_CHAN_FRONTEND, "unable to start capture thread");
+    return false;
+  }
+  return true;
+}
+
+// next screenshot due by `cycles`
+static struct shot_t *_shot_due(const uint64_t cycles) {
+  for (uint32_t i = 0; i < _shot_count; ++i) {
+    if (!_shots[i].taken && _shots[i].cycles <= cycles) {
+      return &_shots[i];
+    }
+  }
+  return NULL;
+}
+
+void capture_frame(const uint64_t cycles) {
+  if (!_active) {
+    return;
+  }
+  // vga memory is tracked every frame whether it is captured or not
+  const uint32_t pages = neo_vram_dirty();
+  for (uint32_t i = 0; i < CAPTURE_SLOTS; ++i) {
+    _ring_pages[i] |= pages;
+  }
+  const uint32_t frame = _vblank++;
+  if (_hash && !_hash_rendered) {
+    _hash_log(frame, cycles, neo_state_hash(pages));
+  }
+  const bool video = _video && (frame % _video_every) == 0;
+  const bool hash = _hash && _hash_rendered;
+  struct shot_t *shot = _shot_due(cycles);
+  if (!video && !shot && !hash) {
+    return;
+  }
+  // wait for a free slot
+  SDL_mutexP(_mux);
+  while (_count == CAPTURE_SLOTS) {
+    SDL_CondWait(_cond, _mux);
+  }
+  SDL_mutexV(_mux);
+
+  struct capture_job_t *job = &_ring[_head];
+  neo_snapshot(&job->snap, _ring_pages[_head]);
+  _ring_pages[_head] = 0;
+  job->video = video;
+  job->hash = hash;
+  job->frame = frame;
+  job->cycles = cycles;
+  job->png = shot ? shot->path : NULL;
+  if (shot) {
+    shot->taken = true;
+  }
+
+  SDL_mutexP(_mux);
+  _head = (_head + 1) % CAPTURE_SLOTS;
+  ++_count;
+  SDL_CondSignal(_cond);
+  SDL_mutexV(_mux);
+}
+
+void capture_close(void) {
+  if (_thread) {
+    // the worker drains the ring before it exits
+    SDL_mutexP(_mux);
+    _quit = true;
+    SDL_CondSignal(_cond);
+    SDL_mutexV(_mux);
+    SDL_WaitThread(_thread, NULL);
+    _thread = NULL;
+    SDL_DestroyCond(_cond);
+    SDL_DestroyMutex(_mux);
+  }
+  for (uint32_t i = 0; i < _shot_count; ++i) {
+    if (!_shots[i].taken) {
+      log_printf(LOG_CHAN_FRONTEND, "screenshot '%s' was never reached",
+                 _shots[i].path);
+    }
+  }
+  if (_video) {
+    fclose(_video);
+    _video = NULL;
+  }
+  if (_hash) {
+    fclose(_hash);
+    _hash = NULL;
+  }
+  free(_row_hash);
+  _row_hash = NULL;
+  free(_buffer);
+  free(_yuv);
+  _buffer = NULL;
+  _yuv = NULL;
+}
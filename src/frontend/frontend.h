@@ -29,6 +29,7 @@ extern const char *biosfile;
 extern uint8_t bootdrive;
 extern bool do_fullscreen;
 extern uint32_t frame_skip;
+extern uint32_t win_width, win_height;
 extern bool _cl_headless;
 
 extern bool cpu_halt;
@@ -40,7 +41,66 @@ struct render_target_t {
   uint32_t w, h, pitch;
 };
 
-void neo_render_tick(const struct render_target_t *target);
+// region of the render target that was redrawn
+struct render_rect_t {
+  uint32_t x, y, w, h;
+};
+
+#define RENDER_MAX_RECTS 64
+
+// regions updated during one render tick
+struct render_dirty_t {
+  // the entire target was redrawn
+  bool full;
+  uint32_t count;
+  struct render_rect_t rect[RENDER_MAX_RECTS];
+};
+
+struct video_snapshot_t;
+
+// draw a frame from a snapshot of the video state
+void neo_render_tick(const struct video_snapshot_t *snap,
+                     const struct render_target_t *target,
+                     struct render_dirty_t *dirty);
+
+// force the next render tick to redraw the entire target
+void neo_render_invalidate(void);
+
+// vga_timing_frames() from which the last frame drawn is out of date even
+// though the video state has not changed, such as when the cursor blinks
+uint32_t neo_render_stale_at(void);
+
+// scale.c
+#define SCALE_MAX 4
+
+// placement of a rendered frame on the render target
+struct scale_plan_t {
+  // source frame size
+  uint32_t src_w, src_h;
+  // horizontal pixel replication
+  uint32_t kx;
+  // scaled frame size and its top left on the target, negative if cropped
+  uint32_t out_w, out_h;
+  int32_t x, y;
+};
+
+// output scale 1..SCALE_MAX, 0 picks the largest that fits the target
+void scale_set_factor(uint32_t factor);
+// stretch every mode to a 4:3 display, 5:6 line replication at 200 lines
+void scale_set_aspect(bool enable);
+// darken the last output row of each repeated source row
+void scale_set_scanlines(bool enable);
+
+void scale_plan(struct scale_plan_t *plan,
+                const uint32_t w, const uint32_t h,
+                const struct render_target_t *target);
+// scale the source rect `in` onto the target, `out` receives the target
+// region written. returns false if none of it is visible.
+bool scale_blit(const struct scale_plan_t *plan,
+                const uint32_t *src, const uint32_t src_pitch,
+                const struct render_rect_t *in,
+                const struct render_target_t *target,
+                struct render_rect_t *out);
 
 // on screen display
 void osd_disk_fdd_used(void);
@@ -62,9 +122,76 @@ extern const uint8_t asset_disk_pic[256];
 // window.c
 void win_fs_toggle(void);
 bool win_init(void);
-void win_render(void);
+void win_close(void);
+// called at vblank, `behind` if the emulation is lagging real time
+void win_render(const bool behind);
 void win_size(uint32_t *w, uint32_t *h);
 
+// frame presentation counters
+struct win_stats_t {
+  uint32_t presented;
+  // skipped as nothing on screen changed
+  uint32_t skipped_idle;
+  // skipped to save host time or by a fixed frame skip
+  uint32_t skipped_load;
+  // published but replaced before the render thread took it
+  uint32_t dropped;
+  // render and present time
+  uint64_t cost_us;
+  uint32_t cost_max_us;
+  // average time between vblanks
+  uint32_t budget_us;
+};
+
+// return the counters since the last call and reset them
+void win_stats(struct win_stats_t *stats);
+
+// metrics.c
+extern bool metrics_enable;
+
+// monotonic host clock in microseconds
+uint64_t host_time_us(void);
+// log a metrics report once a second if enabled
+void metrics_tick(void);
+void metrics_report(void (*print)(const char *fmt, ...));
+
+// capture.c
+// stream frames to a y4m file, one in every frame_skip if set
+void capture_set_video(const char *path);
+// save a png at the first vblank after `cycles`
+bool capture_add_shot(const uint64_t cycles, const char *path);
+// log a hash of every frame, of the rendered image or of the video state
+void capture_set_hash(const char *path, const bool rendered);
+bool capture_init(void);
+// called at vblank with the cycles executed so far
+void capture_frame(const uint64_t cycles);
+// finish writing queued frames
+void capture_close(void);
+
+// screen.c
+typedef void (*screen_match_t)(const char *text, void *user);
+
+// current text screen as utf-8, `out` holds TEXT_SCREEN_SIZE bytes. returns
+// false in graphics modes.
+bool screen_text(char *out);
+// true if a pattern is found on the text screen now
+bool screen_search(const char *pattern);
+// call `on_match` once, at the first vblank the pattern is on screen
+bool screen_watch(const char *pattern, screen_match_t on_match, void *user);
+// called at vblank to check the watches
+void screen_tick(void);
+// write the text screen to a file, "-" for stdout
+bool screen_dump(const char *path);
+// print the screen and stop the emulator once the pattern appears
+bool screen_wait_exit(const char *pattern);
+// dump the screen when the emulator exits
+void screen_set_dump(const char *path);
+void screen_close(void);
+
+// png.c
+bool png_write(const char *path, const uint32_t *src, const uint32_t w,
+               const uint32_t h, const uint32_t pitch);
+
 // events.c
 void tick_events(void);
 
@@ -36,8 +36,8 @@ static int64_t tick_cpu(int64_t num_cycles) {
   return cpu_exec86((int32_t)num_cycles);
 }
 
-static void tick_render() {
-  win_render();
+static void tick_render(bool behind) {
+  win_render(behind);
 }
 
 static uint64_t get_ticks() {
@@ -64,17 +64,30 @@ static void tick_hardware(uint64_t cycles) {
   audio_tick(cycles);
   //
   neo_tick(cycles);
+  // complete disk requests
+  disk_async_tick();
 }
 
 static void emulate_loop_headless(void) {
+  uint64_t cycles = 0;
   // enter main emulation loop
   while (cpu_running) {
     // set ourselves some cycle targets
     const int64_t target = SDL_min(CYCLES_PER_SLICE, i8253_cycles_before_irq());
     // run for some cycles
     const int64_t executed = tick_cpu(target);
+    cycles += executed;
     // tick the hardware
     tick_hardware(executed);
+    // capture the display at vblank
+    if (vga_timing_should_flip()) {
+      vga_timing_did_flip();
+      capture_frame(cycles);
+      screen_tick();
+      dos_console_flush();
+    }
+
+    metrics_tick();
 
     // exit if we are locked up
     if (cpu_in_hlt_state()) {
@@ -84,8 +97,14 @@ static void emulate_loop_headless(void) {
     }
 
   }
+  int code;
+  if (dos_exited(&code)) {
+    return;
+  }
+  dos_console_flush();
   log_printf(LOG_CHAN_CPU, "cpu reached halt state");
-  cpu_dump_state(stdout);
+  // in batch mode stdout carries only the guest's output
+  cpu_dump_state(dos_is_batch() ? stderr : stdout);
 }
 
 static void emulate_loop(void) {
@@ -144,10 +163,15 @@ static void emulate_loop(void) {
         break;
       }
     }
-    // refresh the screen buffer
+    // refresh the screen buffer, more than a refresh behind is lagging
     if (video_redraw || cpu_halt) {
-      tick_render();
+      tick_render(cpu_acc < -CYCLES_PER_REFRESH);
+    }
+    if (video_redraw) {
+      screen_tick();
+      dos_console_flush();
     }
+    metrics_tick();
     // parse events from host
     tick_events();
     // advance cpu or sleep
@@ -210,6 +234,8 @@ static void cpu_setup(void) {
   io.port_write_8  = portout;
   io.port_write_16 = portout16;
   io.int_call      = intcall86;
+  io.mem_fill      = mem_fill;
+  io.mem_move      = mem_move;
   cpu_set_io(&io);
 }
 
@@ -228,14 +254,25 @@ static bool emulate_init(void) {
   i8255_init();
   cmos_init();
   mouse_init(0x3F8, 4);
+  dos_init();
   // initalize vga refresh timing
   vga_timing_init();
   if (!_cl_headless) {
-    // initalize new video renderer
     if (!win_init()) {
       return false;
     }
-    if (!neo_init()) {
+    // headless runs keep disk timing independent of the host
+    if (!disk_async_init()) {
+      return false;
+    }
+  }
+  // initalize new video renderer
+  if (!neo_init()) {
+    return false;
+  }
+  if (_cl_headless) {
+    // render into memory for capture
+    if (!capture_init()) {
       return false;
     }
   }
@@ -314,13 +351,31 @@ int main(int argc, const char *argv[]) {
     emulate_loop();
   }
 
+  screen_close();
+  disk_async_close();
+  disk_flush();
+
+  // stop the render thread
+  if (!_cl_headless) {
+    win_close();
+  }
+  else {
+    capture_close();
+  }
+
   // close the audio device
   if (audio_enable) {
     SDL_CloseAudio();
   }
 
   SDL_Quit();
-  return 0;
+
+  // a program run with -exe or -batch gives the exit code
+  int code = 0;
+  if (!dos_exited(&code) && dos_is_batch()) {
+    code = DOS_EXIT_HALTED;
+  }
+  return code;
 }
 
 void state_save(const char *path) {
@@ -0,0 +1,108 @@
+/*
+  Fake86: A portable, open-source 8086 PC emulator.
+  Copyright (C)2010-2013 Mike Chambers
+               2019      Aidan Dodds
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+  USA.
+*/
+
+#include <stdarg.h>
+#include <time.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+#include "frontend.h"
+
+
+bool metrics_enable;
+
+// host time of the last report
+static uint64_t _last_report;
+
+// a monotonic clock, SDL_GetTicks() is too coarse to time a single frame
+#ifdef _WIN32
+uint64_t host_time_us(void) {
+  static LARGE_INTEGER freq;
+  LARGE_INTEGER now;
+  if (!freq.QuadPart) {
+    QueryPerformanceFrequency(&freq);
+  }
+  QueryPerformanceCounter(&now);
+  return (uint64_t)(now.QuadPart / freq.QuadPart) * 1000000 +
+         (uint64_t)(now.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart;
+}
+#else
+uint64_t host_time_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+#endif
+
+static void _log_line(const char *fmt, ...) {
+  char line[128];
+  va_list vargs;
+  va_start(vargs, fmt);
+  vsnprintf(line, sizeof(line), fmt, vargs);
+  va_end(vargs);
+  log_printf(LOG_CHAN_FRONTEND, "%s", line);
+}
+
+static double _ms(const uint64_t us) {
+  return (double)us / 1000.0;
+}
+
+void metrics_report(void (*print)(const char *fmt, ...)) {
+  struct win_stats_t win;
+  win_stats(&win);
+  const uint32_t skipped = win.skipped_idle + win.skipped_load;
+  const uint32_t frames = win.presented + skipped;
+  const double skip_rate = frames ? (100.0 * skipped / frames) : 0.0;
+  print("video: %u frames, %u presented, %u idle, %u skipped, %u dropped "
+        "(%.1f%% skip)",
+        frames, win.presented, win.skipped_idle, win.skipped_load,
+        win.dropped, skip_rate);
+  const uint64_t avg = win.presented ? (win.cost_us / win.presented) : 0;
+  print("render: %.2fms avg, %.2fms max, %.2fms budget",
+        _ms(avg), _ms(win.cost_max_us), _ms(win.budget_us));
+  struct disk_cache_stats_t disk;
+  disk_cache_stats(&disk);
+  const uint64_t lookups = disk.hits + disk.misses;
+  print("disk cache: %llu hits, %llu misses (%.1f%% hit), %llu read ahead, "
+        "%llu written back",
+        (unsigned long long)disk.hits, (unsigned long long)disk.misses,
+        lookups ? (100.0 * disk.hits / lookups) : 0.0,
+        (unsigned long long)disk.read_ahead,
+        (unsigned long long)disk.write_backs);
+}
+
+void metrics_tick(void) {
+  if (!metrics_enable) {
+    return;
+  }
+  const uint64_t now = host_time_us();
+  if (!_last_report) {
+    _last_report = now;
+  }
+  if (now - _last_report < 1000000) {
+    return;
+  }
+  _last_report = now;
+  metrics_report(_log_line);
+}
@@ -149,6 +149,39 @@ static void _on_cmd_disk_insert(int num, const char **tokens) {
   }
 }
 
+static void _on_cmd_disk_discard(int num, const char **tokens) {
+  if (num <= 0) {
+    osd_printf("usage: disk discard [fd0,hd0...]");
+    return;
+  }
+  uint8_t drive = 0;
+  if (_drive_num(tokens[0], &drive) && disk_discard(drive)) {
+    osd_printf("overlay discarded, reboot the guest");
+  }
+}
+
+static void _on_cmd_disk_commit(int num, const char **tokens) {
+  if (num <= 0) {
+    osd_printf("usage: disk commit [fd0,hd0...]");
+    return;
+  }
+  uint8_t drive = 0;
+  if (_drive_num(tokens[0], &drive) && disk_commit(drive)) {
+    osd_printf("overlay committed to its base");
+  }
+}
+
+static void _on_cmd_disk_snapshot(int num, const char **tokens) {
+  if (num <= 1) {
+    osd_printf("usage: disk snapshot [fd0,hd0...] [path]");
+    return;
+  }
+  uint8_t drive = 0;
+  if (_drive_num(tokens[0], &drive) && disk_snapshot(drive, tokens[1])) {
+    osd_printf("overlay saved to '%s'", tokens[1]);
+  }
+}
+
 static void _on_cmd_disk_info(int num, const char **tokens) {
   // show which disks are inserted, etc
 }
@@ -159,6 +192,16 @@ static void _on_cmd_disk(int num, const char **tokens) {
   }
   const char *tok = *tokens;
   switch (*tok) {
+  case 'c':
+    if (_pstrcmp(tok, "commit")) {
+      _on_cmd_disk_commit(num - 1, tokens + 1);
+    }
+    break;
+  case 'd':
+    if (_pstrcmp(tok, "discard")) {
+      _on_cmd_disk_discard(num - 1, tokens + 1);
+    }
+    break;
   case 'e':
     if (_pstrcmp(tok, "eject")) {
       _on_cmd_disk_eject(num - 1, tokens + 1);
@@ -172,6 +215,11 @@ static void _on_cmd_disk(int num, const char **tokens) {
       _on_cmd_disk_info(num - 1, tokens + 1);
     }
     break;
+  case 's':
+    if (_pstrcmp(tok, "snapshot")) {
+      _on_cmd_disk_snapshot(num - 1, tokens + 1);
+    }
+    break;
   default:
     osd_printf("unexpected input '%s'", tok);
     break;
@@ -344,6 +392,9 @@ static void _on_cmd(int num, const char **tokens) {
     if (_pstrcmp(tok, "memory")) {
       _on_cmd_memory(num-1, tokens+1);
     }
+    if (_pstrcmp(tok, "metrics")) {
+      metrics_report(osd_printf);
+    }
     break;
   case 's':
     if (_pstrcmp(tok, "state")) {
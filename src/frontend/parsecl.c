@@ -21,6 +21,7 @@
 
 #include "../common/common.h"
 #include "../disk/disk.h"
+#include "../video/video.h"
 #include "frontend.h"
 
 
@@ -88,15 +89,166 @@ static bool _cl_do_fullscreen(const char *opt, const char *arg[]) {
 
 static bool _cl_do_frameskip(const char *opt, const char *arg[]) {
   frame_skip = atoi(*arg);
-  log_printf(LOG_CHAN_FRONTEND, "skipping %d frames", frame_skip);
+  if (frame_skip) {
+    log_printf(LOG_CHAN_FRONTEND, "presenting every %d frames", frame_skip);
+  }
+  return true;
+}
+
+static bool _cl_do_disk_cache(const char *opt, const char *arg[]) {
+  disk_cache_kb = (uint32_t)atoi(*arg);
+  return true;
+}
+
+static bool _cl_do_metrics(const char *opt, const char *arg[]) {
+  metrics_enable = true;
+  return true;
+}
+
+static bool _cl_do_window(const char *opt, const char *arg[]) {
+  unsigned w = 0, h = 0;
+  if (sscanf(*arg, "%ux%u", &w, &h) != 2) {
+    printf("Window size '%s' should be given as WIDTHxHEIGHT\n", *arg);
+    return false;
+  }
+  // the on screen display is drawn at 640x480
+  if (w < 640 || h < 480) {
+    printf("Window size must be at least 640x480\n");
+    return false;
+  }
+  win_width = w;
+  win_height = h;
+  return true;
+}
+
+static bool _cl_do_scale(const char *opt, const char *arg[]) {
+  if (strcmp(*arg, "auto") == 0) {
+    scale_set_factor(0);
+    return true;
+  }
+  const int factor = atoi(*arg);
+  if (factor < 1 || factor > SCALE_MAX) {
+    printf("Scale must be 1 to %d or auto\n", SCALE_MAX);
+    return false;
+  }
+  scale_set_factor(factor);
+  return true;
+}
+
+static bool _cl_do_aspect(const char *opt, const char *arg[]) {
+  scale_set_aspect(true);
+  return true;
+}
+
+static bool _cl_do_scanlines(const char *opt, const char *arg[]) {
+  scale_set_scanlines(true);
   return true;
 }
 
+static bool _cl_do_video_out(const char *opt, const char *arg[]) {
+  capture_set_video(*arg);
+  return true;
+}
+
+static bool _cl_do_screenshot_at(const char *opt, const char *arg[]) {
+  if (!arg[0] || !arg[1]) {
+    printf("Screenshot needs a cycle count and a file name\n");
+    return false;
+  }
+  const uint64_t cycles = strtoull(arg[0], NULL, 0);
+  if (!capture_add_shot(cycles, arg[1])) {
+    printf("Too many screenshots\n");
+    return false;
+  }
+  return true;
+}
+
+static bool _cl_do_frame_hash(const char *opt, const char *arg[]) {
+  if (!arg[0] || !arg[1]) {
+    printf("Frame hash needs a kind and a file name\n");
+    return false;
+  }
+  if (strcmp(arg[0], "state") == 0) {
+    capture_set_hash(arg[1], false);
+    return true;
+  }
+  if (strcmp(arg[0], "frame") == 0) {
+    capture_set_hash(arg[1], true);
+    return true;
+  }
+  printf("Unknown frame hash '%s'\n", arg[0]);
+  return false;
+}
+
+static bool _cl_do_wait_text(const char *opt, const char *arg[]) {
+  if (!screen_wait_exit(*arg)) {
+    printf("Too many screen watches\n");
+    return false;
+  }
+  return true;
+}
+
+static bool _cl_do_screen_dump(const char *opt, const char *arg[]) {
+  screen_set_dump(*arg);
+  return true;
+}
+
+static bool _cl_do_font(const char *opt, const char *arg[]) {
+  if (strcmp(*arg, "cga") == 0) {
+    font_select(font_cga_8x8);
+    return true;
+  }
+  if (strcmp(*arg, "rom14") == 0) {
+    font_select(font_rom_8x14);
+    return true;
+  }
+  if (strcmp(*arg, "rom16") == 0) {
+    font_select(font_rom_8x16);
+    return true;
+  }
+  printf("Unknown font '%s'\n", *arg);
+  return false;
+}
+
 static bool _cl_do_com(const char *opt, const char *arg[]) {
   disk_load_com(*arg);
   return true;
 }
 
+static bool _cl_do_dos_drive(const char *opt, const char *arg[]) {
+  const char *path = *arg;
+  if (!path[0] || path[1] != ':') {
+    printf("Host drive '%s' should be given as LETTER:PATH\n", path);
+    return false;
+  }
+  return dos_host_mount(path[0], path + 2);
+}
+
+static bool _cl_do_exe(const char *opt, const char *arg[]) {
+  dos_exec_set(*arg);
+  return true;
+}
+
+static bool _cl_do_exe_args(const char *opt, const char *arg[]) {
+  dos_exec_args(*arg);
+  return true;
+}
+
+static bool _cl_do_exe_env(const char *opt, const char *arg[]) {
+  if (!dos_exec_env(*arg)) {
+    printf("Environment variable '%s' should be given as NAME=VALUE\n", *arg);
+    return false;
+  }
+  return true;
+}
+
+static bool _cl_do_batch(const char *opt, const char *arg[]) {
+  dos_batch();
+  // the console is for the guest
+  log_mute(true);
+  return true;
+}
+
 static bool _cl_do_quiet(const char *opt, const char *arg[]) {
   log_mute(true);
   return true;
@@ -116,9 +268,19 @@ static const struct cl_entry_t _cl_list[] = {
   {"-hd*", 1, _cl_do_hd, "Specify a hard disk image (* = 0..3)",
     "   -hd0 [image file path]\n"
     "   -hd0 hard_drive.img\n"
+    "   -hd0 ro:base.img   (read only, guest writes fail)\n"
+    "   -hd0 a.cow=base.img (overlay on a shared base, created if needed)\n"
+    "   -hd0 a.cow          (existing overlay on its recorded base)\n"
+    "   -hd0 disk.pack      (compressed read only image, see imgpack)\n"
+    "   -hd1 dir:/path/to/dir (host directory as a FAT drive)\n"
     "   -hd1 \\\\.\\F:\n"
     "   -hd2 \\\\.\\PhysicalDrive2:\n"
   },
+  {"-disk-cache", 1, _cl_do_disk_cache, "Block cache size per drive in KB",
+    "   -disk-cache 4096   (default)\n"
+    "   -disk-cache 0      (disabled)\n"
+    "   (give before the drives it applies to)\n"
+  },
   {"-boot", 1, _cl_do_boot, "Specify BIOS drive ID to boot from",
     "   -boot [BIOSDiskId]\n"
     "   -boot 0            (floppy disk 0)\n"
@@ -132,19 +294,98 @@ static const struct cl_entry_t _cl_list[] = {
   },
   {"-fullscreen", 0, _cl_do_fullscreen, "Enable fullscreen mode"
   },
-  {"-frameskip", 1, _cl_do_frameskip, "Number of frames to skip",
-    "   -frameskip 1\n"
+  {"-frameskip", 1, _cl_do_frameskip, "Present one in every N frames",
+    "   -frameskip 0       (adaptive, default)\n"
+    "   -frameskip 2\n"
+  },
+  {"-window", 1, _cl_do_window, "Window size, at least 640x480",
+    "   -window 1280x960\n"
+  },
+  {"-scale", 1, _cl_do_scale, "Integer output scale",
+    "   -scale auto        (largest that fits the window, default)\n"
+    "   -scale 2\n"
+  },
+  {"-aspect", 0, _cl_do_aspect, "Stretch all modes to a 4:3 display"
+  },
+  {"-scanlines", 0, _cl_do_scanlines, "Darken alternate scaled lines"
+  },
+  {"-font", 1, _cl_do_font, "Text mode font",
+    "   -font cga          (built in 8x8 font, default)\n"
+    "   -font rom14        (8x14 font from the video bios)\n"
+    "   -font rom16        (8x16 font from the video bios)\n"
   },
   {
     "-headless", 0, _cl_do_headless, "Run without a window"
   },
+  {
+    "-video-out", 1, _cl_do_video_out, "Stream the display to a y4m file "
+    "(-headless)",
+    "   -video-out run.y4m\n"
+    "   (with -frameskip N to write one in every N frames)\n"
+  },
+  {
+    "-screenshot-at", 2, _cl_do_screenshot_at, "Save a png at the first "
+    "vblank after N cycles (-headless)",
+    "   -screenshot-at 50000000 boot.png\n"
+  },
+  {
+    "-frame-hash", 2, _cl_do_frame_hash, "Log a hash of every frame "
+    "(-headless)",
+    "   -frame-hash state hashes.txt  (video memory, mode and palette)\n"
+    "   -frame-hash frame hashes.txt  (rendered image)\n"
+  },
+  {
+    "-wait-text", 1, _cl_do_wait_text, "Print the text screen and exit once "
+    "a pattern appears",
+    "   -wait-text \"^C:\\\\>\"\n"
+    "   (. [a-z] [^a-z] \\d \\s \\w * + ? ^ $ are supported)\n"
+  },
+  {
+    "-screen-dump", 1, _cl_do_screen_dump, "Write the text screen as utf-8 "
+    "on exit",
+    "   -screen-dump screen.txt\n"
+    "   -screen-dump -     (stdout)\n"
+  },
   {
     "-com", 1, _cl_do_com, "Boot into a COM file at address 0x01100",
     "   -com myprog.com"
   },
+  {
+    "-exe-args", 1, _cl_do_exe_args, "Command tail for -exe",
+    "   -exe-args \"/c input.txt\"\n"
+  },
+  {
+    "-exe-env", 1, _cl_do_exe_env, "Environment variable for -exe, "
+    "may be repeated",
+    "   -exe-env INCLUDE=C:\\INC\n"
+  },
+  {
+    // after the options it is a prefix of
+    "-exe", 1, _cl_do_exe, "Run a DOS program (COM or EXE) without booting "
+    "DOS",
+    "   -exe tool.exe\n"
+    "   (its directory is drive C: unless -dos-drive is given, the console\n"
+    "    is stdin and stdout and fake86 exits with its return code)\n"
+  },
+  {
+    "-dos-drive", 1, _cl_do_dos_drive, "Serve DOS file calls on a drive "
+    "letter from a host directory",
+    "   -dos-drive H:/path/to/dir\n"
+    "   (int 21h 3Ch-42h, 4Eh and 4Fh on H: never reach guest DOS)\n"
+  },
+  {
+    "-batch", 0, _cl_do_batch, "Write guest console output to stdout and "
+    "exit with its return code",
+    "   -batch -headless -hd0 dos.img\n"
+    "   (int 21h 4Ch, a byte written to port F4h or int 21h AH=FAh with\n"
+    "    BX=8686h exits fake86 with the code in AL)\n"
+  },
   {
     "-quiet", 0, _cl_do_quiet, "Dont output on console"
   },
+  {
+    "-metrics", 0, _cl_do_metrics, "Log performance counters every second"
+  },
   {NULL, 0, NULL, NULL}
 };
 
@@ -0,0 +1,336 @@
+/*
+  Fake86: A portable, open-source 8086 PC emulator.
+  Copyright (C)2010-2013 Mike Chambers
+               2019      Aidan Dodds
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+  USA.
+*/
+
+// minimal PNG writer
+//
+// images are stored as 8 bit RGB with no row filtering, compressed as a
+// single deflate block using the fixed huffman codes. matches are found with
+// a hash of the next three bytes and a short chain of earlier positions,
+// which is plenty for emulated screens made of flat colour and repeated
+// glyphs.
+
+#include "frontend.h"
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- checksums
+
+static uint32_t _crc_table[256];
+
+static void _crc_build(void) {
+  for (uint32_t n = 0; n < 256; ++n) {
+    uint32_t c = n;
+    for (uint32_t k = 0; k < 8; ++k) {
+      c = (c & 1) ? (0xedb88320u ^ (c >> 1)) : (c >> 1);
+    }
+    _crc_table[n] = c;
+  }
+}
+
+static uint32_t _crc(uint32_t crc, const uint8_t *data, const size_t size) {
+  crc = ~crc;
+  for (size_t i = 0; i < size; ++i) {
+    crc = _crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+static uint32_t _adler(const uint8_t *data, const size_t size) {
+  uint32_t a = 1, b = 0;
+  for (size_t i = 0; i < size;) {
+    // largest run before the sums must be reduced
+    const size_t end = SDL_min(size, i + 5552);
+    for (; i < end; ++i) {
+      a += data[i];
+      b += a;
+    }
+    a %= 65521;
+    b %= 65521;
+  }
+  return (b << 16) | a;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- bit stream
+
+struct bits_t {
+  uint8_t *data;
+  size_t size, cap;
+  uint32_t acc, count;
+  bool fail;
+};
+
+static void _put_byte(struct bits_t *b, const uint8_t v) {
+  if (b->size == b->cap) {
+    const size_t cap = b->cap ? b->cap * 2 : 0x10000;
+    uint8_t *data = realloc(b->data, cap);
+    if (!data) {
+      b->fail = true;
+      return;
+    }
+    b->data = data;
+    b->cap = cap;
+  }
+  b->data[b->size++] = v;
+}
+
+// write `n` bits lsb first
+static void _put_bits(struct bits_t *b, const uint32_t v, const uint32_t n) {
+  b->acc |= v << b->count;
+  b->count += n;
+  while (b->count >= 8) {
+    _put_byte(b, (uint8_t)b->acc);
+    b->acc >>= 8;
+    b->count -= 8;
+  }
+}
+
+// huffman codes are packed msb first
+static void _put_code(struct bits_t *b, const uint32_t code, const uint32_t n) {
+  uint32_t rev = 0;
+  for (uint32_t i = 0; i < n; ++i) {
+    rev |= ((code >> i) & 1) << (n - 1 - i);
+  }
+  _put_bits(b, rev, n);
+}
+
+static void _flush_bits(struct bits_t *b) {
+  if (b->count) {
+    _put_bits(b, 0, 8 - b->count);
+  }
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- deflate
+
+#define WINDOW_SIZE 0x8000
+#define HASH_BITS   15
+#define MATCH_MIN   3
+#define MATCH_MAX   258
+// earlier positions tried for each match
+#define CHAIN_MAX   16
+
+static const uint16_t _len_base[] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t _len_extra[] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t _dist_base[] = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+  257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289,
+  16385, 24577
+};
+static const uint8_t _dist_extra[] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+  7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+// fixed literal/length code
+static void _put_sym(struct bits_t *b, const uint32_t sym) {
+  if (sym < 144) {
+    _put_code(b, 0x30 + sym, 8);
+  }
+  else if (sym < 256) {
+    _put_code(b, 0x190 + (sym - 144), 9);
+  }
+  else if (sym < 280) {
+    _put_code(b, sym - 256, 7);
+  }
+  else {
+    _put_code(b, 0xc0 + (sym - 280), 8);
+  }
+}
+
+static void _put_match(struct bits_t *b, const uint32_t len,
+                       const uint32_t dist) {
+  uint32_t i = 0;
+  while (i + 1 < sizeof(_len_base) / 2 && _len_base[i + 1] <= len) {
+    ++i;
+  }
+  _put_sym(b, 257 + i);
+  _put_bits(b, len - _len_base[i], _len_extra[i]);
+  uint32_t j = 0;
+  while (j + 1 < sizeof(_dist_base) / 2 && _dist_base[j + 1] <= dist) {
+    ++j;
+  }
+  _put_code(b, j, 5);
+  _put_bits(b, dist - _dist_base[j], _dist_extra[j]);
+}
+
+static inline uint32_t _hash(const uint8_t *p) {
+  const uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16);
+  return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// compress `src` as a zlib stream
+static bool _zlib(struct bits_t *b, const uint8_t *src, const size_t size) {
+  int32_t *head = malloc(sizeof(int32_t) << HASH_BITS);
+  int32_t *prev = malloc(sizeof(int32_t) * WINDOW_SIZE);
+  if (!head || !prev) {
+    free(head);
+    free(prev);
+    return false;
+  }
+  for (uint32_t i = 0; i < (1u << HASH_BITS); ++i) {
+    head[i] = -1;
+  }
+  // deflate with a 32k window, no preset dictionary
+  _put_byte(b, 0x78);
+  _put_byte(b, 0x01);
+  // one final block with fixed codes
+  _put_bits(b, 1, 1);
+  _put_bits(b, 1, 2);
+
+  size_t i = 0;
+  while (i < size) {
+    uint32_t best_len = 0, best_dist = 0;
+    if (i + MATCH_MIN <= size) {
+      const uint32_t h = _hash(src + i);
+      const size_t limit = SDL_min(size - i, MATCH_MAX);
+      int32_t cand = head[h];
+      for (uint32_t n = 0; n < CHAIN_MAX && cand >= 0; ++n) {
+        const size_t dist = i - (size_t)cand;
+        if (dist > WINDOW_SIZE) {
+          break;
+        }
+        uint32_t len = 0;
+        while (len < limit && src[cand + len] == src[i + len]) {
+          ++len;
+        }
+        if (len > best_len) {
+          best_len = len;
+          best_dist = (uint32_t)dist;
+          if (len == limit) {
+            break;
+          }
+        }
+        cand = prev[cand % WINDOW_SIZE];
+      }
+    }
+    // positions covered by this step, each is added to the hash chains
+    const size_t step = (best_len >= MATCH_MIN) ? best_len : 1;
+    if (step > 1) {
+      _put_match(b, best_len, best_dist);
+    }
+    else {
+      _put_sym(b, src[i]);
+    }
+    for (const size_t end = i + step; i < end; ++i) {
+      if (i + MATCH_MIN <= size) {
+        const uint32_t h = _hash(src + i);
+        prev[i % WINDOW_SIZE] = head[h];
+        head[h] = (int32_t)i;
+      }
+    }
+  }
+  // end of block
+  _put_sym(b, 256);
+  _flush_bits(b);
+
+  const uint32_t adler = _adler(src, size);
+  _put_byte(b, (uint8_t)(adler >> 24));
+  _put_byte(b, (uint8_t)(adler >> 16));
+  _put_byte(b, (uint8_t)(adler >> 8));
+  _put_byte(b, (uint8_t)(adler >> 0));
+
+  free(head);
+  free(prev);
+  return !b->fail;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- png
+
+static void _put_be32(uint8_t *dst, const uint32_t v) {
+  dst[0] = (uint8_t)(v >> 24);
+  dst[1] = (uint8_t)(v >> 16);
+  dst[2] = (uint8_t)(v >> 8);
+  dst[3] = (uint8_t)(v >> 0);
+}
+
+static bool _chunk(FILE *fd, const char *type, const uint8_t *data,
+                   const uint32_t size) {
+  uint8_t tmp[8];
+  _put_be32(tmp, size);
+  memcpy(tmp + 4, type, 4);
+  uint32_t crc = _crc(0, tmp + 4, 4);
+  crc = _crc(crc, data, size);
+  uint8_t tail[4];
+  _put_be32(tail, crc);
+  return fwrite(tmp, 1, 8, fd) == 8 &&
+         fwrite(data, 1, size, fd) == size &&
+         fwrite(tail, 1, 4, fd) == 4;
+}
+
+bool png_write(const char *path, const uint32_t *src, const uint32_t w,
+               const uint32_t h, const uint32_t pitch) {
+  assert(path && src);
+  if (!_crc_table[1]) {
+    _crc_build();
+  }
+  // unfiltered scanlines, each prefixed by its filter type
+  const size_t stride = 1 + (size_t)w * 3;
+  uint8_t *raw = malloc(stride * h);
+  if (!raw) {
+    return false;
+  }
+  for (uint32_t y = 0; y < h; ++y) {
+    uint8_t *dst = raw + y * stride;
+    const uint32_t *row = src + y * pitch;
+    *dst++ = 0;
+    for (uint32_t x = 0; x < w; ++x) {
+      *dst++ = (uint8_t)(row[x] >> 16);
+      *dst++ = (uint8_t)(row[x] >> 8);
+      *dst++ = (uint8_t)(row[x] >> 0);
+    }
+  }
+  struct bits_t bits;
+  memset(&bits, 0, sizeof(bits));
+  const bool packed = _zlib(&bits, raw, stride * h);
+  free(raw);
+  if (!packed) {
+    free(bits.data);
+    return false;
+  }
+
+  FILE *fd = fopen(path, "wb");
+  if (!fd) {
+    log_printf(LOG_CHAN_FRONTEND, "unable to open file '%s'", path);
+    free(bits.data);
+    return false;
+  }
+  static const uint8_t sig[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+  // 8 bit truecolour, no interlace
+  uint8_t ihdr[13] = {0};
+  _put_be32(ihdr + 0, w);
+  _put_be32(ihdr + 4, h);
+  ihdr[8] = 8;
+  ihdr[9] = 2;
+  const bool ok = fwrite(sig, 1, sizeof(sig), fd) == sizeof(sig) &&
+                  _chunk(fd, "IHDR", ihdr, sizeof(ihdr)) &&
+                  _chunk(fd, "IDAT", bits.data, (uint32_t)bits.size) &&
+                  _chunk(fd, "IEND", NULL, 0);
+  fclose(fd);
+  free(bits.data);
+  if (!ok) {
+    log_printf(LOG_CHAN_FRONTEND, "unable to write file '%s'", path);
+  }
+  return ok;
+}
@@ -0,0 +1,272 @@
+/*
+  Fake86: A portable, open-source 8086 PC emulator.
+  Copyright (C)2010-2013 Mike Chambers
+               2019      Aidan Dodds
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+  USA.
+*/
+
+// text screen scraping for scripted runs
+//
+// watches hold a pattern which is searched for in the text screen at each
+// vblank, the emulation keeps running while they wait. the screen is only
+// searched again after its text has changed.
+//
+// patterns are a small regular expression subset with no dependencies:
+//   c      literal, \c escapes any character
+//   .      any character except a line break
+//   [a-z]  class with ranges, [^...] negated
+//   \d \s \w  digit, blank and word classes
+//   * + ?  repeat the previous item, greedily
+//   ^ $    start and end of a screen line
+// matching is bytewise so '.' and classes see one byte of a multibyte
+// character, literal utf-8 in a pattern matches as expected.
+
+#include <ctype.h>
+
+#include "frontend.h"
+#include "../video/video.h"
+
+
+#define WATCH_MAX 8
+
+struct watch_t {
+  const char *pattern;
+  screen_match_t on_match;
+  void *user;
+};
+
+static struct watch_t _watch[WATCH_MAX];
+static uint32_t _watch_count;
+// hash of the screen text last searched
+static uint64_t _last_hash;
+static bool _last_valid;
+static char _text[TEXT_SCREEN_SIZE];
+static const char *_dump_path;
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- patterns
+
+// end of the item starting at `p`
+static const char *_re_item_end(const char *p) {
+  if (*p == '\\') {
+    return p[1] ? (p + 2) : (p + 1);
+  }
+  if (*p == '[') {
+    const char *q = p + 1;
+    if (*q == '^') {
+      ++q;
+    }
+    // a leading ']' is a literal
+    if (*q == ']') {
+      ++q;
+    }
+    while (*q && *q != ']') {
+      ++q;
+    }
+    return *q ? (q + 1) : q;
+  }
+  return p + 1;
+}
+
+static bool _re_escape(const char e, const uint8_t c) {
+  switch (e) {
+  case 'd': return c >= '0' && c <= '9';
+  case 's': return c == ' ' || c == '\t';
+  case 'w': return isalnum(c) || c == '_';
+  case 'n': return c == '\n';
+  default:  return (uint8_t)e == c;
+  }
+}
+
+// true if the item at `p` matches the character `c`
+static bool _re_item(const char *p, const uint8_t c) {
+  if (c == '\0') {
+    return false;
+  }
+  switch (*p) {
+  case '\\':
+    return _re_escape(p[1], c);
+  case '.':
+    return c != '\n';
+  case '[': {
+    const char *q = p + 1;
+    const bool negate = (*q == '^');
+    q += negate ? 1 : 0;
+    bool found = false;
+    for (bool first = true; *q && (first || *q != ']'); first = false) {
+      if (q[1] == '-' && q[2] && q[2] != ']') {
+        found |= (c >= (uint8_t)q[0] && c <= (uint8_t)q[2]);
+        q += 3;
+      }
+      else {
+        found |= ((uint8_t)*q == c);
+        q += 1;
+      }
+    }
+    return found != negate;
+  }
+  default:
+    return (uint8_t)*p == c;
+  }
+}
+
+static bool _re_here(const char *p, const char *s) {
+  for (;;) {
+    if (*p == '\0') {
+      return true;
+    }
+    if (p[0] == '$' && p[1] == '\0') {
+      return *s == '\0' || *s == '\n';
+    }
+    const char *next = _re_item_end(p);
+    if (*next == '*' || *next == '+' || *next == '?') {
+      const uint32_t min = (*next == '+') ? 1 : 0;
+      const uint32_t max = (*next == '?') ? 1 : ~0u;
+      // longest run first then back off
+      uint32_t n = 0;
+      while (n < max && _re_item(p, (uint8_t)s[n])) {
+        ++n;
+      }
+      for (;; --n) {
+        if (n >= min && _re_here(next + 1, s + n)) {
+          return true;
+        }
+        if (n == 0) {
+          return false;
+        }
+      }
+    }
+    if (!_re_item(p, (uint8_t)*s)) {
+      return false;
+    }
+    p = next;
+    ++s;
+  }
+}
+
+static bool _re_search(const char *p, const char *s) {
+  if (*p == '^') {
+    // anchored to the start of each line
+    for (const char *line = s; line; ) {
+      if (_re_here(p + 1, line)) {
+        return true;
+      }
+      line = strchr(line, '\n');
+      line = line ? (line + 1) : NULL;
+    }
+    return false;
+  }
+  for (;; ++s) {
+    if (_re_here(p, s)) {
+      return true;
+    }
+    if (*s == '\0') {
+      return false;
+    }
+  }
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- screen
+
+bool screen_text(char *out) {
+  return neo_text_screen(out, NULL, NULL);
+}
+
+bool screen_search(const char *pattern) {
+  return screen_text(_text) && _re_search(pattern, _text);
+}
+
+bool screen_watch(const char *pattern, screen_match_t on_match, void *user) {
+  assert(pattern && on_match);
+  if (_watch_count >= WATCH_MAX) {
+    return false;
+  }
+  _watch[_watch_count].pattern = pattern;
+  _watch[_watch_count].on_match = on_match;
+  _watch[_watch_count].user = user;
+  ++_watch_count;
+  // search the current screen at the next vblank
+  _last_valid = false;
+  return true;
+}
+
+void screen_tick(void) {
+  if (!_watch_count) {
+    return;
+  }
+  if (!screen_text(_text)) {
+    return;
+  }
+  const uint64_t hash = hash64(_text, strlen(_text), 0);
+  if (_last_valid && hash == _last_hash) {
+    return;
+  }
+  _last_hash = hash;
+  _last_valid = true;
+  for (uint32_t i = 0; i < _watch_count;) {
+    struct watch_t w = _watch[i];
+    if (!_re_search(w.pattern, _text)) {
+      ++i;
+      continue;
+    }
+    // watches fire once, the callback may add another
+    _watch[i] = _watch[--_watch_count];
+    w.on_match(_text, w.user);
+  }
+}
+
+bool screen_dump(const char *path) {
+  if (!screen_text(_text)) {
+    log_printf(LOG_CHAN_FRONTEND, "screen is not in a text mode");
+    return false;
+  }
+  if (strcmp(path, "-") == 0) {
+    fputs(_text, stdout);
+    fflush(stdout);
+    return true;
+  }
+  FILE *fd = fopen(path, "wb");
+  if (!fd) {
+    log_printf(LOG_CHAN_FRONTEND, "unable to open file '%s'", path);
+    return false;
+  }
+  fputs(_text, fd);
+  fclose(fd);
+  return true;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- command line
+
+static void _on_wait_text(const char *text, void *user) {
+  log_printf(LOG_CHAN_FRONTEND, "found '%s' on screen", (const char*)user);
+  fputs(text, stdout);
+  fflush(stdout);
+  cpu_running = false;
+}
+
+bool screen_wait_exit(const char *pattern) {
+  return screen_watch(pattern, _on_wait_text, (void*)pattern);
+}
+
+void screen_set_dump(const char *path) {
+  _dump_path = path;
+}
+
+void screen_close(void) {
+  if (_dump_path) {
+    screen_dump(_dump_path);
+  }
+}
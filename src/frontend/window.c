@@ -20,17 +20,74 @@
 */
 
 #include "frontend.h"
+#include "../video/video.h"
 
 
 // params
 bool do_fullscreen;
 uint32_t frame_skip;
+uint32_t win_width = 640;
+uint32_t win_height = 480;
 
 static SDL_Surface *_surface;
 static uint32_t frame_index;
+static bool _osd_was_active;
 
+// longest run of frames skipped while the host is behind real time
+#define SKIP_MAX 4
 
-void win_fs_toggle(void) {
+static struct win_stats_t _stats;
+// running averages of the present cost and vblank interval in microseconds
+static uint32_t _cost_avg;
+static uint32_t _interval_avg;
+static uint64_t _last_vblank;
+// frames skipped since one was last presented
+static uint32_t _skipped;
+// video state has changed since a frame was last presented
+static bool _pending;
+// overlays shown last frame
+static bool _osd_last, _disk_last;
+
+// triple buffered snapshot handoff
+//
+// the emulator fills `_slot_write` at vblank and swaps it with `_slot_ready`.
+// the renderer swaps `_slot_ready` with `_slot_read` when a new frame is
+// waiting so neither side ever waits on the other for more than a swap.
+static struct video_snapshot_t _snap[3];
+// vga memory pages which are stale in each snapshot
+static uint32_t _snap_pages[3] = { ~0u, ~0u, ~0u };
+static uint32_t _slot_write = 0;
+static uint32_t _slot_ready = 1;
+static uint32_t _slot_read = 2;
+
+// regions of the surface changed by the last frame drawn
+static struct render_dirty_t _dirty;
+// the next frame drawn must redraw the whole surface
+static bool _redraw = true;
+// vblank from which the last frame drawn is out of date, published by
+// whichever thread draws
+static uint32_t _stale_at;
+
+// SDL 1.2 video calls are only made from the thread which created the
+// surface. the render thread just rasterises into the surface pixels, the
+// flip, the osd and full screen toggles are done here at vblank while it
+// is idle.
+#if USE_RENDER_THREAD
+static SDL_Thread *_thread;
+static SDL_mutex *_mux;
+static SDL_cond *_cond;
+// a snapshot is waiting in `_slot_ready`
+static bool _fresh;
+// the render thread is drawing into the surface
+static bool _busy;
+// a frame has been drawn and is waiting to be flipped
+static bool _drawn;
+static bool _quit;
+static bool _fs_pending;
+#endif
+
+
+static void _fs_toggle(void) {
   assert(_surface);
   const int flags = _surface->flags ^ SDL_FULLSCREEN;
   _surface = SDL_SetVideoMode(_surface->w, _surface->h, 32, flags);
@@ -38,6 +95,125 @@ void win_fs_toggle(void) {
     log_printf(LOG_CHAN_VIDEO, "SDL_SetVideoMode failed");
   }
   SDL_WM_SetCaption(BUILD_STRING, NULL);
+  // new surface contents are undefined
+  _redraw = true;
+  _pending = true;
+}
+
+static void _target(struct render_target_t *target) {
+  target->dst = (uint32_t*)_surface->pixels;
+  target->w = _surface->w;
+  target->h = _surface->h;
+  target->pitch = _surface->pitch / sizeof(uint32_t);
+}
+
+// rasterise a snapshot into the surface
+static void _draw(const struct video_snapshot_t *snap,
+                  const struct render_target_t *target, const bool redraw) {
+  if (redraw) {
+    neo_render_invalidate();
+  }
+  neo_render_tick(snap, target, &_dirty);
+}
+
+// blend the osd over the frame drawn and present it
+static void _flip(void) {
+  struct render_target_t target;
+  _target(&target);
+  osd_render(&target);
+
+  if (_dirty.full) {
+    SDL_Flip(_surface);
+    return;
+  }
+  // only present the regions that changed
+  SDL_Rect rects[RENDER_MAX_RECTS];
+  for (uint32_t i = 0; i < _dirty.count; ++i) {
+    rects[i].x = (Sint16)_dirty.rect[i].x;
+    rects[i].y = (Sint16)_dirty.rect[i].y;
+    rects[i].w = (Uint16)_dirty.rect[i].w;
+    rects[i].h = (Uint16)_dirty.rect[i].h;
+  }
+  if (_dirty.count) {
+    SDL_UpdateRects(_surface, _dirty.count, rects);
+  }
+}
+
+// record the cost of a presented frame
+static void _account(const uint32_t cost) {
+  ++_stats.presented;
+  _stats.cost_us += cost;
+  if (cost > _stats.cost_max_us) {
+    _stats.cost_max_us = cost;
+  }
+  _cost_avg = (_cost_avg * 7 + cost) / 8;
+}
+
+#if USE_RENDER_THREAD
+static int _render_thread(void *data) {
+  (void)data;
+  for (;;) {
+    SDL_mutexP(_mux);
+    // never draw over a frame which has not been flipped yet
+    while ((!_fresh || _drawn || !_surface) && !_quit) {
+      SDL_CondWait(_cond, _mux);
+    }
+    if (_quit) {
+      SDL_mutexV(_mux);
+      break;
+    }
+    // take the newest snapshot
+    const uint32_t tmp = _slot_read;
+    _slot_read = _slot_ready;
+    _slot_ready = tmp;
+    _fresh = false;
+    _busy = true;
+    const bool redraw = _redraw;
+    _redraw = false;
+    struct render_target_t target;
+    _target(&target);
+    SDL_mutexV(_mux);
+
+    const uint64_t start = host_time_us();
+    _draw(&_snap[_slot_read], &target, redraw);
+    const uint32_t cost = (uint32_t)(host_time_us() - start);
+
+    SDL_mutexP(_mux);
+    _busy = false;
+    _drawn = true;
+    _stale_at = neo_render_stale_at();
+    _account(cost);
+    SDL_mutexV(_mux);
+  }
+  return 0;
+}
+
+// flip a frame the render thread has finished, and toggle full screen
+// while it is not drawing
+static void _present(void) {
+  SDL_mutexP(_mux);
+  if (!_busy) {
+    if (_drawn) {
+      _flip();
+      _drawn = false;
+      SDL_CondSignal(_cond);
+    }
+    if (_fs_pending && _surface) {
+      _fs_toggle();
+    }
+    _fs_pending = false;
+  }
+  SDL_mutexV(_mux);
+}
+#endif
+
+void win_fs_toggle(void) {
+#if USE_RENDER_THREAD
+  // applied at the next vblank the render thread is idle for
+  _fs_pending = true;
+#else
+  _fs_toggle();
+#endif
 }
 
 bool win_init(void) {
@@ -45,39 +221,182 @@ bool win_init(void) {
   const int flags =
     (do_fullscreen ? SDL_FULLSCREEN : 0);
 
-  _surface = SDL_SetVideoMode(640, 480, 32, flags);
+  _surface = SDL_SetVideoMode(win_width, win_height, 32, flags);
   if (!_surface) {
     log_printf(LOG_CHAN_VIDEO, "SDL_SetVideoMode failed");
     return false;
   }
   SDL_WM_SetCaption(BUILD_STRING, NULL);
+
+#if USE_RENDER_THREAD
+  _mux = SDL_CreateMutex();
+  _cond = SDL_CreateCond();
+  _thread = SDL_CreateThread(_render_thread, NULL);
+  if (!_mux || !_cond || !_thread) {
+    log_printf(LOG_CHAN_VIDEO, "unable to start render thread");
+    return false;
+  }
+#endif
   return true;
 }
 
-void win_render(void) {
+void win_close(void) {
+#if USE_RENDER_THREAD
+  if (!_thread) {
+    return;
+  }
+  SDL_mutexP(_mux);
+  _quit = true;
+  SDL_CondSignal(_cond);
+  SDL_mutexV(_mux);
+  SDL_WaitThread(_thread, NULL);
+  _thread = NULL;
+  SDL_DestroyCond(_cond);
+  SDL_DestroyMutex(_mux);
+#endif
+}
+
+// a fullscreen toggle is waiting for the render thread
+static bool _fs_waiting(void) {
+#if USE_RENDER_THREAD
+  return _fs_pending;
+#else
+  return false;
+#endif
+}
+
+// the last frame drawn is out of date
+static bool _stale(void) {
+#if USE_RENDER_THREAD
+  SDL_mutexP(_mux);
+  const uint32_t at = _stale_at;
+  SDL_mutexV(_mux);
+#else
+  const uint32_t at = _stale_at;
+#endif
+  return vga_timing_frames() >= at;
+}
+
+// frames to skip between presents while the host is behind real time
+static uint32_t _skip_budget(void) {
+  if (!_interval_avg) {
+    return 1;
+  }
+  // vblanks consumed by rendering a single frame
+  const uint32_t n = (_cost_avg + _interval_avg - 1) / _interval_avg;
+  return SDL_max(1, SDL_min(n, SKIP_MAX));
+}
 
-  ++frame_index;
-  if (frame_index >= frame_skip) {
+static bool _should_present(const bool behind, const bool overlay) {
+  // fixed frame skip from the command line
+  if (frame_skip) {
+    if (++frame_index < frame_skip) {
+      ++_stats.skipped_load;
+      return false;
+    }
     frame_index = 0;
+    return true;
+  }
+  // nothing on screen would change
+  if (!_pending && !overlay && !_stale() && !_fs_waiting()) {
+    ++_stats.skipped_idle;
+    return false;
   }
+  // present only as often as rendering can be afforded
+  if (behind && _skipped < _skip_budget()) {
+    ++_skipped;
+    ++_stats.skipped_load;
+    return false;
+  }
+  return true;
+}
+
+void win_render(const bool behind) {
+
+#if USE_RENDER_THREAD
+  _present();
+#endif
+
+  const uint64_t now = host_time_us();
+  if (_last_vblank) {
+    const uint32_t interval = (uint32_t)(now - _last_vblank);
+    _interval_avg = _interval_avg ? ((_interval_avg * 7 + interval) / 8)
+                                  : interval;
+  }
+  _last_vblank = now;
 
-  if (frame_index != 0) {
+  // vga memory is tracked every frame whether it is presented or not
+  const uint32_t pages = neo_vram_dirty();
+  for (uint32_t i = 0; i < 3; ++i) {
+    _snap_pages[i] |= pages;
+  }
+  _pending |= neo_state_changed();
+  _pending |= (pages != 0);
+
+  // overlays need presenting while shown and once more to remove them
+  const bool osd = osd_is_active();
+  const bool disk = osd_should_draw_disk();
+  const bool overlay = osd || disk || _osd_last || _disk_last;
+  _osd_last = osd;
+  _disk_last = disk;
+
+  if (!_should_present(behind, overlay)) {
     return;
   }
+  _pending = false;
+  _skipped = 0;
 
-  SDL_FillRect(_surface, NULL, 0x050505);
+  neo_snapshot(&_snap[_slot_write], _snap_pages[_slot_write]);
+  _snap_pages[_slot_write] = 0;
+  _snap[_slot_write].disk = disk;
 
-  struct render_target_t target = {
-    (uint32_t*)_surface->pixels,
-    _surface->w,
-    _surface->h,
-    _surface->pitch / sizeof(uint32_t)
-  };
+  // the osd is blended over the frame so needs the screen fully redrawn
+  // while it is open and once more after it closes
+  const bool redraw = osd || _osd_was_active;
+  _osd_was_active = osd;
 
-  neo_render_tick(&target);
-  osd_render(&target);
+#if USE_RENDER_THREAD
+  // publish it to the render thread
+  SDL_mutexP(_mux);
+  _redraw |= redraw;
+  if (_fresh) {
+    // the last one was never drawn
+    ++_stats.dropped;
+  }
+  const uint32_t tmp = _slot_ready;
+  _slot_ready = _slot_write;
+  _slot_write = tmp;
+  _fresh = true;
+  SDL_CondSignal(_cond);
+  SDL_mutexV(_mux);
+#else
+  _redraw |= redraw;
+  struct render_target_t target;
+  _target(&target);
+  const uint64_t start = host_time_us();
+  _draw(&_snap[_slot_write], &target, _redraw);
+  _redraw = false;
+  _stale_at = neo_render_stale_at();
+  _flip();
+  _account((uint32_t)(host_time_us() - start));
+#endif
+}
 
-  SDL_Flip(_surface);
+void win_stats(struct win_stats_t *stats) {
+  assert(stats);
+#if USE_RENDER_THREAD
+  if (_mux) {
+    SDL_mutexP(_mux);
+  }
+#endif
+  *stats = _stats;
+  stats->budget_us = _interval_avg;
+  memset(&_stats, 0, sizeof(_stats));
+#if USE_RENDER_THREAD
+  if (_mux) {
+    SDL_mutexV(_mux);
+  }
+#endif
 }
 
 void win_size(uint32_t *w, uint32_t *h) {
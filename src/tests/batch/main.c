@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#endif
+
+#include "../../common/common.h"
+
+
+// runs fake86 on small COM programs with -exe -batch, the paths of fake86
+// and its BIOS are given as arguments
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+// scratch program written to the working directory
+#define _com "_tests_batch.com"
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+static const char *_fake86;
+static const char *_bios;
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+static bool _write_com(const uint8_t *code, const size_t size) {
+  FILE *fd = fopen(_com, "wb");
+  if (!fd) {
+    return false;
+  }
+  const bool ok = fwrite(code, 1, size, fd) == size;
+  return (fclose(fd) == 0) && ok;
+}
+
+// run `path` in batch mode, its stdout and exit code are returned
+static bool _run(const char *path, char *out, const size_t size, int *code) {
+  char cmd[1024];
+  snprintf(cmd, sizeof(cmd), "\"%s\" -bios \"%s\" -headless -batch -exe %s",
+           _fake86, _bios, path);
+  FILE *fd = popen(cmd, "r");
+  if (!fd) {
+    return false;
+  }
+  const size_t len = fread(out, 1, size - 1, fd);
+  out[len] = '\0';
+  const int status = pclose(fd);
+#ifdef _WIN32
+  *code = status;
+#else
+  if (status == -1 || !WIFEXITED(status)) {
+    return false;
+  }
+  *code = WEXITSTATUS(status);
+#endif
+  return true;
+}
+
+static bool _expect(const char *name, const char *path, const char *want,
+                    const int want_code) {
+  char out[256];
+  int code = -1;
+  if (!_run(path, out, sizeof(out), &code)) {
+    printf("%s: unable to run fake86\n", name);
+    return false;
+  }
+  bool pass = true;
+  if (strcmp(out, want) != 0) {
+    printf("%s: stdout was '%s', expected '%s'\n", name, out, want);
+    pass = false;
+  }
+  if (code != want_code) {
+    printf("%s: exit code was %d, expected %d\n", name, code, want_code);
+    pass = false;
+  }
+  return pass;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+// console output through 09h and the code given to 4Ch
+static bool _test_exit(void) {
+  static const uint8_t code[] = {
+    0xb4, 0x09,        // mov ah, 09h
+    0xba, 0x0c, 0x01,  // mov dx, msg
+    0xcd, 0x21,        // int 21h
+    0xb8, 0x2a, 0x4c,  // mov ax, 4c2ah
+    0xcd, 0x21,        // int 21h
+    'b', 'a', 't', 'c', 'h', '\r', '\n', '$',
+  };
+  return _write_com(code, sizeof(code)) &&
+         _expect("exit", _com, "batch\n", 42);
+}
+
+// a guest that halts leaves its output alone on stdout
+static bool _test_halt(void) {
+  static const uint8_t code[] = {
+    0xb4, 0x02,        // mov ah, 02h
+    0xb2, 0x41,        // mov dl, 'A'
+    0xcd, 0x21,        // int 21h
+    0xfa,              // cli
+    0xf4,              // hlt
+  };
+  return _write_com(code, sizeof(code)) &&
+         _expect("halt", _com, "A", DOS_EXIT_HALTED);
+}
+
+// a program that can't be loaded must not boot anything else
+static bool _test_missing(void) {
+  return _expect("missing", "_tests_batch_missing.com", "",
+                 DOS_EXIT_LOAD_FAILED);
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+int main(int argc, char **args) {
+  if (argc < 3) {
+    printf("usage: %s <fake86> <bios>\n", args[0]);
+    return 1;
+  }
+  _fake86 = args[1];
+  _bios = args[2];
+  bool pass = true;
+  pass &= _test_exit();
+  pass &= _test_halt();
+  pass &= _test_missing();
+  remove(_com);
+  return pass ? 0 : 1;
+}
@@ -0,0 +1,604 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "../../common/common.h"
+#include "../../cpu/cpu.h"
+#include "../../disk/disk.h"
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+// scratch directory made in the working directory
+#define _tmp "_tests_disk"
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+// what disk.c needs from the rest of the emulator
+uint8_t RAM[0x100000];
+struct cpu_regs_t cpu_regs;
+union cpu_flags_t cpu_flags;
+
+void cpu_io_wait(bool wait) { (void)wait; }
+uint8_t read86(uint32_t addr32) { return RAM[addr32 & 0xFFFFF]; }
+uint16_t readw86(uint32_t addr32) {
+  return read86(addr32) | (read86(addr32 + 1) << 8);
+}
+void write86(uint32_t addr32, uint8_t value) { RAM[addr32 & 0xFFFFF] = value; }
+void writew86(uint32_t addr32, uint16_t value) {
+  write86(addr32, (uint8_t)value);
+  write86(addr32 + 1, (uint8_t)(value >> 8));
+}
+void mem_write(uint32_t addr, const uint8_t *src, size_t size) {
+  memcpy(RAM + addr, src, size);
+}
+void mem_read(uint8_t *dst, uint32_t addr, size_t size) {
+  memcpy(dst, RAM + addr, size);
+}
+bool dos_exec_boot(void) { return false; }
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+static void _make_dir(const char *path) {
+#ifdef _WIN32
+  _mkdir(path);
+#else
+  mkdir(path, 0777);
+#endif
+}
+
+static void _remove_dir(const char *path) {
+#ifdef _WIN32
+  _rmdir(path);
+#else
+  rmdir(path);
+#endif
+}
+
+static bool _exists(const char *path) {
+  struct stat st;
+  return stat(path, &st) == 0;
+}
+
+static uint32_t _get16(const uint8_t *p) {
+  return p[0] | (p[1] << 8);
+}
+
+static uint32_t _get32(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void _put_be32(uint8_t *p, const uint32_t v) {
+  p[0] = (uint8_t)(v >> 24);
+  p[1] = (uint8_t)(v >> 16);
+  p[2] = (uint8_t)(v >> 8);
+  p[3] = (uint8_t)v;
+}
+
+static void _put_be64(uint8_t *p, const uint64_t v) {
+  _put_be32(p, (uint32_t)(v >> 32));
+  _put_be32(p + 4, (uint32_t)v);
+}
+
+static uint64_t _file_size(const char *path) {
+  struct stat st;
+  return (stat(path, &st) == 0) ? (uint64_t)st.st_size : 0;
+}
+
+static bool _write_file(const char *path, const uint8_t *data,
+                        const size_t size) {
+  FILE *fd = fopen(path, "wb");
+  if (!fd) {
+    return false;
+  }
+  const bool ok = fwrite(data, 1, size, fd) == size;
+  return (fclose(fd) == 0) && ok;
+}
+
+static bool _file_sector(const char *path, const uint32_t lba, uint8_t *buf) {
+  FILE *fd = fopen(path, "rb");
+  if (!fd) {
+    return false;
+  }
+  const bool ok = fseek(fd, (long)lba * 512, SEEK_SET) == 0 &&
+                  fread(buf, 1, 512, fd) == 512;
+  fclose(fd);
+  return ok;
+}
+
+static void _fill(uint8_t *buf, const uint32_t seed) {
+  for (uint32_t i = 0; i < 512; ++i) {
+    buf[i] = (uint8_t)(seed * 31 + i);
+  }
+}
+
+static bool _sector(struct disk_info_t *d, const uint32_t lba, uint8_t *buf,
+                    const bool write) {
+  if (!d->seek(d->self, (uint64_t)lba * 512)) {
+    return false;
+  }
+  return write ? d->write(d->self, buf, 512) : d->read(d->self, buf, 512);
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- dir
+
+// directory entries written by the guest must not reach outside the root
+static bool _test_dir_names(void) {
+  _make_dir(_tmp);
+  _make_dir(_tmp "/root");
+  remove(_tmp "/.ESC");
+
+  struct disk_info_t d;
+  memset(&d, 0, sizeof(d));
+  if (!_disk_dir_open(0x80, _tmp "/root", true, &d)) {
+    printf("dir: unable to open\n");
+    return false;
+  }
+  // find the root directory through the partition and its boot sector
+  uint8_t buf[512];
+  _sector(&d, 0, buf, false);
+  const uint32_t part = _get32(buf + 446 + 8);
+  _sector(&d, part, buf, false);
+  const uint32_t root = part + _get16(buf + 14) + buf[16] * _get16(buf + 22);
+  _sector(&d, root, buf, false);
+  uint32_t i = 0;
+  while (i < 16 && buf[i * 32]) {
+    ++i;
+  }
+  static const char *names[] = {
+    "A          ",  // a directory for the escape to start from
+    "A/../../ESC",
+    "A/ESC      ",
+    "OK      TXT",
+  };
+  for (uint32_t j = 0; j < 4; ++j, ++i) {
+    uint8_t *e = buf + i * 32;
+    memset(e, 0, 32);
+    memcpy(e, names[j], 11);
+    e[11] = j ? 0x20 : 0x10;
+  }
+  bool pass = _sector(&d, root, buf, true);
+  pass &= d.flush(d.self);
+  d.eject(d.self);
+
+  pass &= _exists(_tmp "/root/A");
+  pass &= _exists(_tmp "/root/OK.TXT");
+  if (_exists(_tmp "/.ESC") || _exists(_tmp "/root/A/ESC")) {
+    printf("dir: a file was created outside of the root\n");
+    pass = false;
+  }
+  remove(_tmp "/.ESC");
+  remove(_tmp "/root/A/ESC");
+  remove(_tmp "/root/OK.TXT");
+  _remove_dir(_tmp "/root/A");
+  _remove_dir(_tmp "/root");
+  if (!pass) {
+    printf("dir: invalid names\n");
+  }
+  return pass;
+}
+
+// a directory opened without `shared` takes no guest writes
+static bool _test_dir_read_only(void) {
+  _make_dir(_tmp "/root");
+  struct disk_info_t d;
+  memset(&d, 0, sizeof(d));
+  if (!_disk_dir_open(0x80, _tmp "/root", false, &d)) {
+    printf("dir: unable to open read only\n");
+    return false;
+  }
+  uint8_t buf[512];
+  _sector(&d, 0, buf, false);
+  const uint32_t part = _get32(buf + 446 + 8);
+  _sector(&d, part, buf, false);
+  const uint32_t root = part + _get16(buf + 14) + buf[16] * _get16(buf + 22);
+  _sector(&d, root, buf, false);
+  memset(buf, 0, 32);
+  memcpy(buf, "NEW     TXT", 11);
+  buf[11] = 0x20;
+  bool pass = d.read_only && !_sector(&d, root, buf, true);
+  pass &= d.flush(d.self);
+  d.eject(d.self);
+  if (_exists(_tmp "/root/NEW.TXT")) {
+    printf("dir: read only directory was written\n");
+    pass = false;
+  }
+  remove(_tmp "/root/NEW.TXT");
+  _remove_dir(_tmp "/root");
+  return pass;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- img
+
+// a raw image opened without `shared` refuses writes whether it is mapped
+// or read through stdio
+static bool _test_img_read_only(void) {
+  static const char *path = _tmp "/test.img";
+  uint8_t buf[512], want[512];
+  // one cylinder of a hard disk
+  const uint32_t sectors = 16 * 63;
+  bool pass = true;
+  FILE *fd = fopen(path, "wb");
+  for (uint32_t i = 0; fd && i < sectors; ++i) {
+    _fill(buf, i);
+    pass &= fwrite(buf, 1, 512, fd) == 512;
+  }
+  if (!fd || fclose(fd) != 0) {
+    printf("img: unable to create\n");
+    return false;
+  }
+  struct disk_info_t d;
+  memset(&d, 0, sizeof(d));
+  if (!pass || !_disk_open_image(0x80, path, false, &d)) {
+    printf("img: unable to open\n");
+    return false;
+  }
+  _fill(buf, 1000);
+  pass &= d.read_only && !_sector(&d, 3, buf, true);
+  pass &= _sector(&d, 3, buf, false);
+  d.eject(d.self);
+  _fill(want, 3);
+  pass &= !memcmp(buf, want, 512);
+  pass &= _file_sector(path, 3, buf) && !memcmp(buf, want, 512);
+  remove(path);
+  if (!pass) {
+    printf("img: read only image was written\n");
+  }
+  return pass;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- vhd
+
+// 64KB dynamic disk of 4KB blocks, its header gives `entries` in the block
+// table though only the ones covering the disk are written
+#define _vhd_size (64 * 1024)
+#define _vhd_block 4096
+
+static bool _make_vhd(const char *path, const uint32_t entries) {
+  const size_t bat = 512;
+  const size_t size = 512 + 1024 + bat + 512;
+  uint8_t *file = (uint8_t*)malloc(size);
+  if (!file) {
+    return false;
+  }
+  memset(file, 0, size);
+  uint8_t *footer = file + size - 512;
+  memcpy(footer, "conectix", 8);
+  _put_be32(footer + 8, 2);
+  _put_be32(footer + 12, 0x00010000);
+  _put_be64(footer + 16, 512);
+  _put_be64(footer + 40, _vhd_size);
+  _put_be64(footer + 48, _vhd_size);
+  // 2 cylinders, 4 heads, 16 sectors
+  footer[57] = 2;
+  footer[58] = 4;
+  footer[59] = 16;
+  _put_be32(footer + 60, 3);
+  uint32_t sum = 0;
+  for (uint32_t i = 0; i < 512; ++i) {
+    sum += footer[i];
+  }
+  _put_be32(footer + 64, ~sum);
+  memcpy(file, footer, 512);
+
+  uint8_t *header = file + 512;
+  memcpy(header, "cxsparse", 8);
+  _put_be64(header + 8, ~0ull);
+  _put_be64(header + 16, 512 + 1024);
+  _put_be32(header + 24, 0x00010000);
+  _put_be32(header + 28, entries);
+  _put_be32(header + 32, _vhd_block);
+  // every block unallocated
+  memset(file + 512 + 1024, 0xff, bat);
+
+  const bool ok = _write_file(path, file, size);
+  free(file);
+  return ok;
+}
+
+// sectors written to a dynamic disk read back after reopening it, and a
+// disk opened without `shared` is left as it was
+static bool _test_vhd(void) {
+  static const char *path = _tmp "/test.vhd";
+  static const uint32_t lba[] = {9, 47, 48, 127};
+  uint8_t buf[512], want[512];
+  struct disk_info_t d;
+  bool pass = _make_vhd(path, _vhd_size / _vhd_block);
+
+  memset(&d, 0, sizeof(d));
+  if (!pass || !_disk_vhd_open(0x80, path, true, &d)) {
+    printf("vhd: unable to open\n");
+    return false;
+  }
+  pass &= (d.size_bytes == _vhd_size && d.cyls == 2 && d.heads == 4 &&
+           d.sects == 16);
+  for (uint32_t i = 0; i < 4; ++i) {
+    _fill(buf, lba[i]);
+    pass &= _sector(&d, lba[i], buf, true);
+  }
+  pass &= d.flush(d.self);
+  d.eject(d.self);
+
+  memset(&d, 0, sizeof(d));
+  if (!_disk_vhd_open(0x80, path, false, &d)) {
+    printf("vhd: unable to reopen\n");
+    return false;
+  }
+  for (uint32_t i = 0; i < 4; ++i) {
+    _fill(want, lba[i]);
+    pass &= _sector(&d, lba[i], buf, false) && !memcmp(buf, want, 512);
+  }
+  // unwritten sectors, in a used block and in a free one
+  memset(want, 0, 512);
+  pass &= _sector(&d, 10, buf, false) && !memcmp(buf, want, 512);
+  pass &= _sector(&d, 64, buf, false) && !memcmp(buf, want, 512);
+  const uint64_t size = _file_size(path);
+  pass &= d.read_only && !_sector(&d, 80, buf, true);
+  d.eject(d.self);
+  pass &= (_file_size(path) == size);
+  if (!pass) {
+    printf("vhd: round trip failed\n");
+  }
+
+  // block tables too small for the disk, past the end of the file or too
+  // large to hold are refused
+  static const uint32_t bad[] = {_vhd_size / _vhd_block - 1, 1u << 20,
+                                 0x40000001};
+  for (uint32_t i = 0; i < 3; ++i) {
+    memset(&d, 0, sizeof(d));
+    if (!_make_vhd(path, bad[i]) || _disk_vhd_open(0x80, path, false, &d)) {
+      printf("vhd: block table of %u entries accepted\n", bad[i]);
+      pass = false;
+    }
+  }
+  remove(path);
+  return pass;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- cow
+
+// one cylinder of 16 heads and 63 sectors
+#define _cow_sectors (16 * 63)
+
+// does sector `lba` of `d`, or of the file at `path` when `d` is NULL, hold
+// the pattern for `seed`
+static bool _holds(struct disk_info_t *d, const char *path,
+                   const uint32_t lba, const uint32_t seed) {
+  uint8_t buf[512], want[512];
+  _fill(want, seed);
+  const bool ok = d ? _sector(d, lba, buf, false) :
+                      _file_sector(path, lba, buf);
+  return ok && !memcmp(buf, want, 512);
+}
+
+// overlay writes are read back after reopening and only reach the base
+// image when committed, to the base it was last opened on
+static bool _test_cow(void) {
+  static const char *base = _tmp "/base.img";
+  static const char *moved = _tmp "/moved.img";
+  static const char *path = _tmp "/test.cow";
+  uint8_t *image = (uint8_t*)malloc(_cow_sectors * 512);
+  if (!image) {
+    return false;
+  }
+  for (uint32_t i = 0; i < _cow_sectors; ++i) {
+    _fill(image + i * 512, i);
+  }
+  bool pass = _write_file(base, image, _cow_sectors * 512) &&
+              _write_file(moved, image, _cow_sectors * 512);
+  free(image);
+  remove(path);
+
+  struct disk_info_t d;
+  memset(&d, 0, sizeof(d));
+  if (!pass || !_disk_cow_open(0x80, path, base, &d)) {
+    printf("cow: unable to create\n");
+    return false;
+  }
+  uint8_t buf[512];
+  _fill(buf, 1005);
+  pass &= _sector(&d, 5, buf, true);
+  _fill(buf, 1100);
+  pass &= _sector(&d, 100, buf, true);
+  pass &= _holds(&d, NULL, 5, 1005) && _holds(&d, NULL, 6, 6);
+  pass &= d.flush(d.self);
+  d.eject(d.self);
+  pass &= _holds(NULL, base, 5, 5) && _holds(NULL, base, 100, 100);
+
+  // the base is found through the overlay
+  memset(&d, 0, sizeof(d));
+  if (!_disk_cow_open(0x80, path, NULL, &d)) {
+    printf("cow: unable to reopen\n");
+    return false;
+  }
+  pass &= _holds(&d, NULL, 5, 1005) && _holds(&d, NULL, 100, 1100);
+  pass &= _holds(&d, NULL, 6, 6) && _holds(&d, NULL, 101, 101);
+  pass &= _disk_cow_commit(&d);
+  pass &= _holds(&d, NULL, 5, 1005) && _holds(&d, NULL, 6, 6);
+  d.eject(d.self);
+  pass &= _holds(NULL, base, 5, 1005) && _holds(NULL, base, 100, 1100);
+  pass &= _holds(NULL, base, 6, 6);
+
+  // a base given in place of the recorded one is where a commit goes
+  memset(&d, 0, sizeof(d));
+  if (!_disk_cow_open(0x80, path, moved, &d)) {
+    printf("cow: unable to reopen on another base\n");
+    return false;
+  }
+  _fill(buf, 1007);
+  pass &= _sector(&d, 7, buf, true);
+  d.eject(d.self);
+  memset(&d, 0, sizeof(d));
+  if (!_disk_cow_open(0x80, path, NULL, &d)) {
+    printf("cow: unable to reopen\n");
+    return false;
+  }
+  pass &= _disk_cow_commit(&d);
+  d.eject(d.self);
+  pass &= _holds(NULL, moved, 7, 1007) && _holds(NULL, base, 7, 7);
+
+  remove(path);
+  remove(base);
+  remove(moved);
+  if (!pass) {
+    printf("cow: round trip failed\n");
+  }
+  return pass;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- lz
+
+// noise the codec can't shrink
+static void _noise(uint8_t *buf, const uint32_t size, uint32_t seed) {
+  for (uint32_t i = 0; i < size; ++i) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    buf[i] = (uint8_t)seed;
+  }
+}
+
+// runs long enough to need length continuations, between short literals
+static void _runs(uint8_t *buf, const uint32_t size) {
+  for (uint32_t i = 0; i < size; ++i) {
+    buf[i] = (i % 10000 < 9000) ? (uint8_t)(i / 10000) : (uint8_t)(i * 7);
+  }
+}
+
+static bool _lz_round_trip(const uint8_t *src, const uint32_t size,
+                           uint8_t *packed, const uint32_t cap,
+                           uint8_t *out, uint32_t *plen) {
+  *plen = lz_compress(src, size, packed, cap);
+  return *plen && lz_decompress(packed, *plen, out, size) &&
+         !memcmp(src, out, size);
+}
+
+static bool _test_lz(void) {
+  static uint8_t src[PACK_BLOCK], out[PACK_BLOCK];
+  // worst case growth is a token and length bytes per run of literals
+  static uint8_t packed[PACK_BLOCK + PACK_BLOCK / 255 + 16];
+  uint32_t plen = 0;
+  bool pass = true;
+
+  // incompressible data doesn't fit in less than it started as, but still
+  // survives a round trip given the room
+  _noise(src, PACK_BLOCK, 0x1234567);
+  pass &= lz_compress(src, PACK_BLOCK, packed, PACK_BLOCK - 1) == 0;
+  pass &= _lz_round_trip(src, PACK_BLOCK, packed, sizeof(packed), out, &plen);
+
+  _runs(src, PACK_BLOCK);
+  pass &= _lz_round_trip(src, PACK_BLOCK, packed, PACK_BLOCK - 1, out, &plen);
+  pass &= plen < PACK_BLOCK / 10;
+
+  // cut short, or asked for the wrong size
+  for (uint32_t cut = 1; cut < 64 && cut < plen; ++cut) {
+    pass &= !lz_decompress(packed, plen - cut, out, PACK_BLOCK);
+  }
+  pass &= !lz_decompress(packed, plen, out, PACK_BLOCK - 1);
+
+  // a match reaching back before the start of the output
+  static const uint8_t far[] = { 0x10, 'a', 0x05, 0x00 };
+  pass &= !lz_decompress(far, sizeof(far), out, 5);
+  // a match past the end of the output
+  static const uint8_t over[] = { 0x1f, 'a', 0x01, 0x00, 0x00 };
+  pass &= !lz_decompress(over, sizeof(over), out, 8);
+  if (!pass) {
+    printf("lz: round trip failed\n");
+  }
+  return pass;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- pack
+
+// blocks of zeros, noise and runs then a short last block
+#define _pack_size (3 * PACK_BLOCK + 16 * 512)
+
+static bool _test_pack(void) {
+  static const char *raw = _tmp "/pack.img";
+  static const char *path = _tmp "/test.pack";
+  static const char *back = _tmp "/unpack.img";
+  static uint8_t image[_pack_size], buf[_pack_size];
+  memset(image, 0, PACK_BLOCK);
+  _noise(image + PACK_BLOCK, PACK_BLOCK, 0x89abcdef);
+  _runs(image + 2 * PACK_BLOCK, _pack_size - 2 * PACK_BLOCK);
+  if (!_write_file(raw, image, _pack_size) || !pack_image(raw, path)) {
+    printf("pack: unable to pack\n");
+    return false;
+  }
+  bool pass = true;
+  // zero blocks take no space and the noise is stored as it is
+  const uint64_t size = _file_size(path);
+  pass &= size > PACK_BLOCK && size < 2 * PACK_BLOCK;
+  pass &= unpack_image(path, back) && _file_size(back) == _pack_size;
+  FILE *fd = fopen(back, "rb");
+  pass &= fd && fread(buf, 1, _pack_size, fd) == _pack_size &&
+          !memcmp(buf, image, _pack_size);
+  if (fd) {
+    fclose(fd);
+  }
+
+  // read through the backend across block boundaries
+  struct disk_info_t d;
+  memset(&d, 0, sizeof(d));
+  if (!_disk_pack_open(0x80, path, &d)) {
+    printf("pack: unable to open\n");
+    return false;
+  }
+  pass &= d.size_bytes == _pack_size && d.read_only;
+  pass &= d.seek(d.self, PACK_BLOCK - 512) &&
+          d.read(d.self, buf, PACK_BLOCK + 1024) &&
+          !memcmp(buf, image + PACK_BLOCK - 512, PACK_BLOCK + 1024);
+  pass &= d.seek(d.self, _pack_size - 512) && !d.read(d.self, buf, 1024);
+  pass &= !_sector(&d, 0, buf, true);
+  d.eject(d.self);
+
+  // a truncated file is refused rather than read as zeros
+  uint8_t *packed = (uint8_t*)malloc((size_t)size);
+  fd = fopen(path, "rb");
+  pass &= packed && fd && fread(packed, 1, (size_t)size, fd) == size;
+  if (fd) {
+    fclose(fd);
+  }
+  if (packed) {
+    pass &= _write_file(path, packed, (size_t)size - 1);
+    pass &= !unpack_image(path, back);
+    // and a header whose block count doesn't match its size
+    ((struct pack_header_t*)packed)->blocks += 1;
+    pass &= _write_file(path, packed, (size_t)size);
+    pass &= !unpack_image(path, back) && !_disk_pack_open(0x80, path, &d);
+  }
+  free(packed);
+
+  remove(raw);
+  remove(path);
+  remove(back);
+  if (!pass) {
+    printf("pack: round trip failed\n");
+  }
+  return pass;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+int main(int argc, char **args) {
+  (void)argc;
+  (void)args;
+  log_mute(true);
+  _make_dir(_tmp);
+  bool pass = true;
+  pass &= _test_dir_names();
+  pass &= _test_dir_read_only();
+  pass &= _test_img_read_only();
+  pass &= _test_vhd();
+  pass &= _test_cow();
+  pass &= _test_lz();
+  pass &= _test_pack();
+  _remove_dir(_tmp);
+  return pass ? 0 : 1;
+}
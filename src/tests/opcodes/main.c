@@ -908,6 +908,8 @@ void setup_cpu_io(void) {
   io.port_write_8 = _port_write_8;
   io.port_write_16 = _port_write_16;
   io.int_call = _int_call;
+  io.mem_fill = NULL;
+  io.mem_move = NULL;
   cpu_set_io(&io);
 }
 
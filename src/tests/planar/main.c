@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../../common/common.h"
+#include "../../cpu/cpu.h"
+#include "../../video/video.h"
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+#define _root_seed 12345
+#define _bench_frames 1000
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+// four separate planes for the reference and the packed layout used by
+// video_neo.c
+static uint8_t _vram[0x40000];
+static uint32_t _packed[0x10000];
+static uint32_t _pal[16];
+static uint32_t _ref[640 * 480];
+static uint32_t _out[640 * 480];
+
+static uint32_t _seed = _root_seed;
+
+static uint32_t _rand(void) {
+  _seed ^= _seed << 13;
+  _seed ^= _seed >> 17;
+  _seed ^= _seed << 5;
+  return _seed;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+// what video_neo.c needs from the rest of the emulator
+uint8_t RAM[0x100000];
+uint8_t portram[0x10000];
+struct cpu_regs_t cpu_regs;
+
+static void (*_port_write[0x10000])(uint16_t port, uint8_t value);
+
+void set_port_write_redirector(uint16_t startport, uint16_t endport,
+                               void *callback) {
+  for (uint32_t i = startport; i <= endport; ++i) {
+    _port_write[i] = callback;
+  }
+}
+
+void set_port_read_redirector(uint16_t startport, uint16_t endport,
+                              void *callback) {
+  (void)startport;
+  (void)endport;
+  (void)callback;
+}
+
+uint64_t cpu_slice_ticks(void) {
+  return 0;
+}
+
+static void _port_out(const uint16_t port, const uint8_t value) {
+  _port_write[port](port, value);
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+// the original bit at a time conversion
+static void _reference(uint32_t *dst, const uint32_t width,
+                       const uint32_t height) {
+  const uint8_t *plane0 = _vram + 0x10000 * 0;
+  const uint8_t *plane1 = _vram + 0x10000 * 1;
+  const uint8_t *plane2 = _vram + 0x10000 * 2;
+  const uint8_t *plane3 = _vram + 0x10000 * 3;
+  for (uint32_t y = 0; y < height; ++y) {
+    for (uint32_t x = 0; x < (width / 8); ++x) {
+      const uint8_t b0 = plane0[x];
+      const uint8_t b1 = plane1[x];
+      const uint8_t b2 = plane2[x];
+      const uint8_t b3 = plane3[x];
+      for (int i = 0; i < 8; ++i) {
+        const uint8_t mask = 0x80 >> i;
+        const uint32_t index = ((b0 & mask) ? 1 : 0) |
+                               ((b1 & mask) ? 2 : 0) |
+                               ((b2 & mask) ? 4 : 0) |
+                               ((b3 & mask) ? 8 : 0);
+        *dst++ = _pal[index];
+      }
+    }
+    plane0 += (width / 8);
+    plane1 += (width / 8);
+    plane2 += (width / 8);
+    plane3 += (width / 8);
+  }
+}
+
+static void _convert(uint32_t *dst, const uint32_t width,
+                     const uint32_t height) {
+  const uint32_t span = width / 8;
+  for (uint32_t y = 0; y < height; ++y) {
+    planar_to_rgb(dst, _packed, y * span, span, _pal);
+    dst += width;
+  }
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+static bool _check(const uint32_t width, const uint32_t height) {
+  _reference(_ref, width, height);
+  _convert(_out, width, height);
+  const size_t size = width * height * sizeof(uint32_t);
+  if (memcmp(_ref, _out, size)) {
+    printf("%ux%u: mismatch\n", width, height);
+    return false;
+  }
+  return true;
+}
+
+// REP STOSB and STOSW into chain-4 memory
+static bool _check_fill(void) {
+  neo_init();
+  // chain-4, all planes enabled and a plain write mode 0
+  _port_out(0x3c4, 0x04);
+  _port_out(0x3c5, 0x0e);
+  _port_out(0x3c4, 0x02);
+  _port_out(0x3c5, 0x0f);
+  _port_out(0x3ce, 0x08);
+  _port_out(0x3cf, 0xff);
+  bool pass = true;
+  for (uint32_t size = 1; size <= 2; ++size) {
+    neo_mem_fill(0xA0000, 0x0000, 256, 1);
+    neo_mem_fill(0xA0010, 0xa55a, 64, size);
+    for (uint32_t i = 0; i < 256; ++i) {
+      const bool in = (i >= 0x10 && i < 0x10 + 64 * size);
+      const uint8_t want = !in ? 0x00 : ((size == 2 && (i & 1)) ? 0xa5 : 0x5a);
+      if (neo_mem_read_A0000(0xA0000 + i) != want) {
+        printf("chain-4 %s: mismatch at %u\n", size == 1 ? "stosb" : "stosw",
+               i);
+        pass = false;
+        break;
+      }
+    }
+  }
+  return pass;
+}
+
+static void _bench(const uint32_t width, const uint32_t height) {
+  clock_t t0 = clock();
+  for (int i = 0; i < _bench_frames; ++i) {
+    _reference(_ref, width, height);
+  }
+  clock_t t1 = clock();
+  for (int i = 0; i < _bench_frames; ++i) {
+    _convert(_out, width, height);
+  }
+  clock_t t2 = clock();
+  const double ms_ref = 1000.0 * (t1 - t0) / CLOCKS_PER_SEC / _bench_frames;
+  const double ms_new = 1000.0 * (t2 - t1) / CLOCKS_PER_SEC / _bench_frames;
+  printf("%ux%u: reference %.3fms, planar %.3fms per frame (%.1fx)\n",
+         width, height, ms_ref, ms_new,
+         ms_new > 0.0 ? ms_ref / ms_new : 0.0);
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+int main(int argc, char **args) {
+  (void)argc;
+  (void)args;
+  for (uint32_t i = 0; i < sizeof(_vram); ++i) {
+    _vram[i] = (uint8_t)_rand();
+  }
+  for (uint32_t i = 0; i < 0x10000; ++i) {
+    _packed[i] = (_vram[i + 0x10000 * 0] <<  0) |
+                 (_vram[i + 0x10000 * 1] <<  8) |
+                 (_vram[i + 0x10000 * 2] << 16) |
+                 (_vram[i + 0x10000 * 3] << 24);
+  }
+  for (uint32_t i = 0; i < 16; ++i) {
+    _pal[i] = _rand() & 0xffffff;
+  }
+  bool pass = true;
+  pass &= _check(320, 200);
+  pass &= _check(640, 200);
+  pass &= _check(640, 350);
+  pass &= _check(640, 480);
+  pass &= _check_fill();
+  if (!pass) {
+    return 1;
+  }
+  _bench(320, 200);
+  _bench(640, 350);
+  _bench(640, 480);
+  return 0;
+}
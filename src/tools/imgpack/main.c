@@ -0,0 +1,36 @@
+// convert disk images to and from the packed format
+//
+//   imgpack pack   disk.img disk.pack
+//   imgpack unpack disk.pack disk.img
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../../common/common.h"
+#include "../../disk/disk.h"
+
+
+static void _usage(void) {
+  printf("usage:\n");
+  printf("   imgpack pack   <in.img>  <out.pack>\n");
+  printf("   imgpack unpack <in.pack> <out.img>\n");
+}
+
+int main(int argc, char **args) {
+  if (argc != 4) {
+    _usage();
+    return 1;
+  }
+  bool ok;
+  if (strcmp(args[1], "pack") == 0) {
+    ok = pack_image(args[2], args[3]);
+  }
+  else if (strcmp(args[1], "unpack") == 0) {
+    ok = unpack_image(args[2], args[3]);
+  }
+  else {
+    _usage();
+    return 1;
+  }
+  return ok ? 0 : 1;
+}
@@ -20,6 +20,14 @@
 */
 
 #include "../common/common.h"
+#include "../frontend/frontend.h"
+#include "video.h"
+
+#if SIMD_SSE2
+#include <emmintrin.h>
+#elif SIMD_NEON
+#include <arm_neon.h>
+#endif
 
 
 // 512 characters from codepage 437
@@ -568,23 +576,148 @@ void font_draw_glyph_8x8(
   }
 }
 
-void font_draw_glyph_8x16(
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+// text mode glyph cache
+
+// font requested for text mode rendering
+static enum font_t _font_want = font_cga_8x8;
+// font the cache was built from
+static enum font_t _font_have;
+static bool _font_stale = true;
+
+// glyph rows expanded to the character cell height
+//   0-255  normal
+// 256-511  bold (same as normal for rom fonts)
+static uint8_t _glyph_rows[512][16];
+static uint32_t _glyph_h = 16;
+
+// mask byte to eight 32bit pixel lanes (0 or ~0), left most pixel first
+static uint32_t _lane_lut[256][8];
+static bool _lane_lut_ready;
+
+static void _lane_lut_build(void) {
+  _lane_lut_ready = true;
+  for (uint32_t i = 0; i < 256; ++i) {
+    for (uint32_t x = 0; x < 8; ++x) {
+      _lane_lut[i][x] = (i & (0x80 >> x)) ? ~0u : 0u;
+    }
+  }
+}
+
+// find a font table of a given height in the video bios rom.
+// tables are identified by a blank glyph 0, a solid glyph 0xDB and the
+// smiley face outline of glyph 1.
+static const uint8_t *_font_find_rom(const uint32_t h) {
+  const uint8_t *rom = RAM + 0xC0000;
+  const uint32_t rom_size = 0x8000;
+  const uint32_t table_size = 256 * h;
+  for (uint32_t i = 0; i + table_size <= rom_size; ++i) {
+    const uint8_t *t = rom + i;
+    if (t[h + 2] != 0x7e || t[h + 3] != 0x81) {
+      continue;
+    }
+    bool match = true;
+    for (uint32_t y = 0; y < h && match; ++y) {
+      match = (t[y] == 0x00) && (t[0xdb * h + y] == 0xff);
+    }
+    if (match) {
+      return t;
+    }
+  }
+  return NULL;
+}
+
+static void _font_build(void) {
+  if (!_lane_lut_ready) {
+    _lane_lut_build();
+  }
+  const enum font_t want = _font_want;
+  const uint32_t h = (want == font_rom_8x14) ? 14 : 16;
+  const uint8_t *rom = (want == font_cga_8x8) ? NULL : _font_find_rom(h);
+
+  memset(_glyph_rows, 0, sizeof(_glyph_rows));
+  if (rom) {
+    for (uint32_t ch = 0; ch < 256; ++ch) {
+      memcpy(_glyph_rows[ch], rom + ch * h, h);
+      memcpy(_glyph_rows[ch + 256], rom + ch * h, h);
+    }
+    _glyph_h = h;
+  }
+  else {
+    if (want != font_cga_8x8) {
+      log_printf(LOG_CHAN_VIDEO, "unable to find %ux%u font in video rom",
+                 8, h);
+    }
+    // double up the 8x8 rows
+    for (uint32_t ch = 0; ch < 512; ++ch) {
+      for (uint32_t y = 0; y < 16; ++y) {
+        _glyph_rows[ch][y] = cga_font_8x8[ch * 8 + y / 2];
+      }
+    }
+    _glyph_h = 16;
+  }
+  _font_have = rom ? want : font_cga_8x8;
+  _font_stale = false;
+}
+
+void font_select(enum font_t font) {
+  if (font != _font_want || font != _font_have) {
+    _font_want = font;
+    _font_stale = true;
+    // everything on screen was drawn with the old font
+    neo_render_invalidate();
+  }
+}
+
+uint32_t font_height(void) {
+  if (_font_stale) {
+    _font_build();
+  }
+  return _glyph_h;
+}
+
+void font_draw_glyph(
   uint32_t *dst, const uint32_t pitch, uint16_t ch,
   const uint32_t rgb_a, const uint32_t rgb_b)
 {
-  //note: there is a font in the bios at 0xffa6e
-
-  const uint8_t *src = &cga_font_8x8[(ch & 0x1ff) * 8];
+  if (_font_stale) {
+    _font_build();
+  }
+  const uint8_t *src = _glyph_rows[ch & 0x1ff];
+  const uint32_t h = _glyph_h;
 
-  for (int y=0; y<16; ++y) {
-    uint8_t mask = *src;
-    for (int x=0; x<8; ++x) {
-      dst[x] = (mask & 0x80) ? rgb_a : rgb_b;
-      mask <<= 1;
+#if SIMD_SSE2
+  const __m128i fg = _mm_set1_epi32((int)rgb_a);
+  const __m128i bg = _mm_set1_epi32((int)rgb_b);
+  for (uint32_t y = 0; y < h; ++y) {
+    const __m128i *lane = (const __m128i*)_lane_lut[src[y]];
+    const __m128i m0 = _mm_loadu_si128(lane + 0);
+    const __m128i m1 = _mm_loadu_si128(lane + 1);
+    __m128i *out = (__m128i*)dst;
+    _mm_storeu_si128(out + 0,
+      _mm_or_si128(_mm_and_si128(m0, fg), _mm_andnot_si128(m0, bg)));
+    _mm_storeu_si128(out + 1,
+      _mm_or_si128(_mm_and_si128(m1, fg), _mm_andnot_si128(m1, bg)));
+    dst += pitch;
+  }
+#elif SIMD_NEON
+  const uint32x4_t fg = vdupq_n_u32(rgb_a);
+  const uint32x4_t bg = vdupq_n_u32(rgb_b);
+  for (uint32_t y = 0; y < h; ++y) {
+    const uint32_t *lane = _lane_lut[src[y]];
+    vst1q_u32(dst + 0, vbslq_u32(vld1q_u32(lane + 0), fg, bg));
+    vst1q_u32(dst + 4, vbslq_u32(vld1q_u32(lane + 4), fg, bg));
+    dst += pitch;
+  }
+#else
+  for (uint32_t y = 0; y < h; ++y) {
+    const uint32_t *lane = _lane_lut[src[y]];
+    for (uint32_t x = 0; x < 8; ++x) {
+      dst[x] = (lane[x] & rgb_a) | (~lane[x] & rgb_b);
     }
-    src += (y & 1);
     dst += pitch;
   }
+#endif
 }
 
 void font_draw_glyph_8x16_gliss(
@@ -0,0 +1,83 @@
+/*
+  Fake86: A portable, open-source 8086 PC emulator.
+  Copyright (C)2010-2013 Mike Chambers
+               2019      Aidan Dodds
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+  USA.
+*/
+
+// planar to packed pixel conversion for the EGA/VGA 16 colour modes
+
+#include "../common/common.h"
+#include "video.h"
+
+
+// one memory plane
+#define PLANE_SIZE 0x10000
+
+// plane byte to colour index bits
+//
+// _spread[p][b] holds eight byte lanes, one per pixel with the left most
+// pixel at the lowest address. each lane is either 0 or (1 << p) depending
+// on the bit for that pixel in plane byte b. OR'ing the four plane lookups
+// gives eight colour indices at once.
+static uint64_t _spread[4][256];
+static bool _spread_ready;
+
+static void _spread_build(void) {
+  for (uint32_t p = 0; p < 4; ++p) {
+    for (uint32_t b = 0; b < 256; ++b) {
+      uint8_t lanes[8];
+      for (uint32_t x = 0; x < 8; ++x) {
+        lanes[x] = (b & (0x80 >> x)) ? (1 << p) : 0;
+      }
+      memcpy(&_spread[p][b], lanes, sizeof(lanes));
+    }
+  }
+  _spread_ready = true;
+}
+
+// combine eight pixels from the four planes
+static inline uint64_t _indices(const uint32_t *vram, const uint32_t addr) {
+  const uint32_t v = vram[addr];
+  return _spread[0][(v >>  0) & 0xff] |
+         _spread[1][(v >>  8) & 0xff] |
+         _spread[2][(v >> 16) & 0xff] |
+         _spread[3][(v >> 24) & 0xff];
+}
+
+void planar_to_rgb(uint32_t *dst, const uint32_t *vram,
+                   uint32_t addr, const uint32_t bytes,
+                   const uint32_t *pal) {
+  if (!_spread_ready) {
+    _spread_build();
+  }
+  // there is no palette gather in SSE2/NEON so lookups are unrolled
+  for (uint32_t i = 0; i < bytes; ++i) {
+    const uint64_t v = _indices(vram, (addr + i) & (PLANE_SIZE - 1));
+    uint8_t idx[8];
+    memcpy(idx, &v, sizeof(idx));
+    dst[0] = pal[idx[0]];
+    dst[1] = pal[idx[1]];
+    dst[2] = pal[idx[2]];
+    dst[3] = pal[idx[3]];
+    dst[4] = pal[idx[4]];
+    dst[5] = pal[idx[5]];
+    dst[6] = pal[idx[6]];
+    dst[7] = pal[idx[7]];
+    dst += 8;
+  }
+}
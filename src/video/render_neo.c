@@ -28,8 +28,81 @@
 #include "../frontend/frontend.h"
 
 
-// offscreen render target
-static uint32_t _temp[320 * 240];
+// frame at the native resolution of the mode, scaled onto the target
+static uint32_t _frame[640 * 480];
+
+// video state for the frame being drawn
+static const struct video_snapshot_t *_snap;
+
+static uint32_t _crt_cursor_addr(void) {
+  return (_snap->crt[0xE] << 8) | _snap->crt[0xF];
+}
+
+static uint8_t _crt_cursor_start(void) {
+  return _snap->crt[0xA];
+}
+
+static uint8_t _crt_cursor_end(void) {
+  return _snap->crt[0xB];
+}
+
+// display start address in crtc units, including the byte panning bits
+static uint32_t _crt_start(void) {
+  const uint8_t *crt = _snap->crt;
+  return ((crt[0xC] << 8) | crt[0xD]) + ((crt[0x8] >> 5) & 3);
+}
+
+// line offset register, zero if the bios did not program it
+static uint32_t _crt_offset(void) {
+  return _snap->crt[0x13];
+}
+
+// vertical display end in scanlines
+static uint32_t _crt_vde(void) {
+  const uint8_t *crt = _snap->crt;
+  return crt[0x12] |
+         ((crt[0x07] & 0x02) << 7) |
+         ((crt[0x07] & 0x40) << 3);
+}
+
+// scanlines in each row of characters or pixels
+static uint32_t _crt_row_height(void) {
+  const uint8_t *crt = _snap->crt;
+  return ((crt[0x09] & 0x1f) + 1) * ((crt[0x09] & 0x80) ? 2 : 1);
+}
+
+// displayed rows from the vertical display end
+static uint32_t _crt_lines(void) {
+  return (_crt_vde() + 1) / _crt_row_height();
+}
+
+// first row displayed from address 0 after a line compare split, or ~0u
+static uint32_t _crt_split_row(void) {
+  const uint8_t *crt = _snap->crt;
+  const uint32_t lc = crt[0x18] |
+                      ((crt[0x07] & 0x10) << 4) |
+                      ((crt[0x09] & 0x40) << 3);
+  // the bios parks it past the display end when not in use
+  if (lc >= _crt_vde()) {
+    return ~0u;
+  }
+  return lc / _crt_row_height() + 1;
+}
+
+// memory address of the start of a displayed row
+static uint32_t _crt_row_addr(const uint32_t row, const uint32_t start,
+                              const uint32_t split, const uint32_t stride) {
+  return (row < split) ? (start + row * stride) : ((row - split) * stride);
+}
+
+// horizontal pixel panning for a displayed row
+static uint32_t _attr_pan(const uint32_t row, const uint32_t split) {
+  // attribute mode control bit 5 stops panning below the split
+  if (row >= split && (_snap->attr[0x10] & 0x20)) {
+    return 0;
+  }
+  return _snap->attr[0x13] & 7;
+}
 
 
 // render a grey/black dither pattern
@@ -44,31 +117,94 @@ static void _neo_render_mode_unknown(const struct render_target_t *target) {
   }
 }
 
-static void _neo_draw_cursor(const struct render_target_t *target,
-                             const uint8_t chw, const uint8_t chh,
-                             const uint8_t w, const uint8_t h,
-                             const uint32_t yoffset) {
+// text mode dimensions handled by the render cache
+#define TEXT_MAX_COLS 80
+#define TEXT_MAX_ROWS 25
+
+// text mode render cache
+//
+// a shadow copy of everything that was used to draw the last text frame so
+// that only cells which have changed need to be redrawn.
+struct text_cache_t {
+  // character and attribute pairs drawn last frame
+  uint16_t cell[TEXT_MAX_COLS * TEXT_MAX_ROWS];
+  // cells which need to be redrawn this frame
+  uint8_t dirty[TEXT_MAX_COLS * TEXT_MAX_ROWS];
+  // palettes the cells were drawn with
+  uint32_t fg[16], bg[16];
+  // cursor state drawn last frame
+  uint32_t cursor_cell;
+  uint8_t cursor_start, cursor_end;
+  bool cursor_on;
+  // cursor blink phase
+  bool blink;
+};
+
+static struct text_cache_t _text_cache;
+
+// text mode cursor blink phase, on for 32 frames then off for 32 so that
+// captured frames do not depend on the host clock
+static bool _blink_phase(const uint32_t frame) {
+  return (frame & 0x20) == 0;
+}
+
+// set when the whole target must be redrawn
+static bool _invalid = true;
+// state the last frame was drawn with
+static int _last_mode = -1;
+static uint32_t _last_frame;
+static struct render_target_t _last_target;
+static struct scale_plan_t _last_plan;
+static bool _last_disk;
+
+void neo_render_invalidate(void) {
+  _invalid = true;
+}
+
+uint32_t neo_render_stale_at(void) {
+  if (_invalid) {
+    return 0;
+  }
+  // only the text mode cursor changes without the video state changing
+  switch (_last_mode) {
+  case 0x02:
+  case 0x03:
+    // the first frame in the next blink phase
+    return (_last_frame | 0x1f) + 1;
+  default:
+    return UINT32_MAX;
+  }
+}
 
-  // blink
-  if ((SDL_GetTicks() % 1000) > 500) {
+static void _dirty_add(struct render_dirty_t *dirty,
+                       uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+  if (dirty->full) {
     return;
   }
-  // convert address to location
-  const uint32_t cursor = neo_crt_cursor_addr();
-  const uint32_t x = cursor % w;
-  const uint32_t y = cursor / w;
-  // bail out if offscreen
-  if (x >= w || y >= h) {
+  if (dirty->count >= RENDER_MAX_RECTS) {
+    // too many to track so just present everything
+    dirty->full = true;
     return;
   }
+  struct render_rect_t *r = dirty->rect + dirty->count++;
+  r->x = x;
+  r->y = y;
+  r->w = w;
+  r->h = h;
+}
+
+static void _neo_draw_cursor(const struct render_target_t *target,
+                             const uint8_t chw, const uint8_t chh,
+                             const uint32_t x, const uint32_t y,
+                             const uint32_t yoffset) {
   // draw target
   const uint32_t pitch = target->pitch;
   uint32_t *dst = target->dst;
   dst += yoffset * pitch;
   dst += chw * x + chh * y * pitch;
   // scanline locations
-  const uint32_t start = neo_crt_cursor_start();
-  const uint32_t end   = neo_crt_cursor_end();
+  const uint32_t start = _crt_cursor_start();
+  const uint32_t end   = _crt_cursor_end();
   // draw it
   for (uint32_t y = 0; y < chh; ++y) {
     if (y >= start && y <= end) {
@@ -80,108 +216,143 @@ static void _neo_draw_cursor(const struct render_target_t *target,
   }
 }
 
-// 80x25 greyscale text mode
-static void _neo_render_mode_02(const struct render_target_t *target) {
+// 80x25 text mode via the render cache
+static void _neo_render_text(const struct render_target_t *target,
+                             struct render_dirty_t *dirty,
+                             const uint32_t *fg, const uint32_t *bg,
+                             const bool cursor) {
+  struct text_cache_t *cache = &_text_cache;
   // text mode buffer address
-  uint32_t src = 0xB8000;
+  const uint8_t *src = _snap->text;
+  // display start and row stride in cells, a page flip or scroll only moves
+  // where cells are fetched from so the cache still diffs the result
+  const uint32_t start = _crt_start();
+  const uint32_t stride = _crt_offset() ? (_crt_offset() * 2) : TEXT_MAX_COLS;
+  const uint32_t split = _crt_split_row();
   // cga/PCjr = 8x8  char px
   // EGA      = 8x14 char px
   // MCGA     = 8x16 char px
   // VGA      = 9x16 char px
-  const int chw = 8, chh = 16;
+  const uint32_t chw = 8, chh = font_height();
   // step through VGA text-mode buffer
-  const int rows = 25, cols = 80;
+  const uint32_t rows = TEXT_MAX_ROWS, cols = TEXT_MAX_COLS;
   // screen buffer position
   const uint32_t pitch = target->pitch;
-  uint32_t *dsty = target->dst;
   const uint32_t yoffset = (target->h - (chh * rows)) / 2;
-  dsty += pitch * yoffset;
-  // blit loop
-  for (int y = 0; y < rows; ++y) {
-    uint32_t *dstx = dsty;
-    for (int x = 0; x < cols; ++x) {
-      // grab character and attribute
-      const uint8_t ch = RAM[src + 0];
-      const uint8_t at = RAM[src + 1];
-      // decode colour from attribute
-      const uint32_t rgba = palette_cga_2_rgb[at & 0xf];
-      const uint32_t rgbb = palette_cga_2_rgb[at >> 4];
-      // draw the glyph
-      font_draw_glyph_8x16(dstx, pitch, ch + 0x100, rgba, rgbb);
-      // step over to next glyph
-      dstx += chw;
-      // step over character and attribute
-      src += 2;
+
+  // a palette change touches every cell
+  bool redraw_all = _invalid;
+  if (memcmp(cache->fg, fg, sizeof(cache->fg)) ||
+      memcmp(cache->bg, bg, sizeof(cache->bg))) {
+    memcpy(cache->fg, fg, sizeof(cache->fg));
+    memcpy(cache->bg, bg, sizeof(cache->bg));
+    redraw_all = true;
+  }
+
+  // diff against the shadow buffer
+  for (uint32_t y = 0, i = 0; y < rows; ++y) {
+    const uint32_t addr = _crt_row_addr(y, start, split, stride);
+    for (uint32_t x = 0; x < cols; ++x, ++i) {
+      const uint32_t offs = ((addr + x) * 2) & (SNAPSHOT_TEXT_SIZE - 1);
+      const uint16_t cell = src[offs + 0] | (src[offs + 1] << 8);
+      cache->dirty[i] = redraw_all || (cell != cache->cell[i]);
+      cache->cell[i] = cell;
     }
-    // step over glyph line
-    dsty += pitch * chh;
   }
-  // this is text mode so draw the cursor if needed
-  _neo_draw_cursor(target, chw, chh, cols, rows, yoffset);
-}
 
-// 80x25 16-colour text mode
-static void _neo_render_mode_03(const struct render_target_t *target) {
-  const uint32_t base = 0xB8000;
-  // text mode buffer address
-  uint32_t src = 0xB8000;
-  // cga/PCjr = 8x8  char px
-  // EGA      = 8x14 char px
-  // MCGA     = 8x16 char px
-  // VGA      = 9x16 char px
-  const int chw = 8, chh = 16;
-  // step through VGA text-mode buffer
-  const int rows = 25, cols = 80;
-  // screen buffer position
-  const uint32_t pitch = target->pitch;
-  uint32_t *dsty = target->dst;
-  const uint32_t yoffset = (target->h - (chh * rows)) / 2;
-  dsty += pitch * yoffset;
+  // find the new cursor state, its address is relative to the display start
+  const uint32_t cursor_rel = (_crt_cursor_addr() - start) & 0xffff;
+  const uint32_t cursor_x = cursor_rel % stride;
+  const uint32_t cursor_y = cursor_rel / stride;
+  const uint32_t cursor_cell = cursor_y * cols + cursor_x;
+  const uint8_t cursor_start = _crt_cursor_start();
+  const uint8_t cursor_end = _crt_cursor_end();
+  const bool blink = _blink_phase(_snap->frame);
+  const bool cursor_on =
+    cursor && (cursor_x < cols) && (cursor_y < rows) && (cursor_y < split) &&
+    blink;
+  cache->blink = blink;
+  // redraw the old and new cursor cells if it changed
+  if (cursor_on != cache->cursor_on || cursor_cell != cache->cursor_cell ||
+      cursor_start != cache->cursor_start || cursor_end != cache->cursor_end) {
+    if (cache->cursor_on) {
+      cache->dirty[cache->cursor_cell] = 1;
+    }
+    if (cursor_on) {
+      cache->dirty[cursor_cell] = 1;
+    }
+    cache->cursor_cell = cursor_cell;
+    cache->cursor_start = cursor_start;
+    cache->cursor_end = cursor_end;
+    cache->cursor_on = cursor_on;
+  }
+
   // blit loop
-  for (int y=0; y<rows; ++y) {
-    uint32_t *dstx = dsty;
-    for (int x=0; x<cols; ++x) {
-      // grab character and attribute
-      const uint8_t ch = RAM[src + 0];
-      const uint8_t at = RAM[src + 1];
-      // decode colour from attribute
-      const uint32_t rgba = palette_cga_3_rgb[at & 0xf];
-      const uint32_t rgbb = palette_cga_3_rgb[at >> 4];
-      // draw the glyph
-      font_draw_glyph_8x16(dstx, pitch, ch + 0x100, rgba, rgbb);
-      // step over to next glyph
-      dstx += chw;
-      // step over character and attribute
-      src += 2;
+  uint32_t *dsty = target->dst + pitch * yoffset;
+  for (uint32_t y = 0; y < rows; ++y) {
+    const uint8_t *dirty_row = cache->dirty + y * cols;
+    const uint16_t *cell_row = cache->cell + y * cols;
+    for (uint32_t x = 0; x < cols;) {
+      if (!dirty_row[x]) {
+        ++x;
+        continue;
+      }
+      // draw a span of dirty cells
+      const uint32_t x0 = x;
+      for (; x < cols && dirty_row[x]; ++x) {
+        // grab character and attribute
+        const uint8_t ch = cell_row[x] & 0xff;
+        const uint8_t at = cell_row[x] >> 8;
+        // draw the glyph
+        font_draw_glyph(dsty + x * chw, pitch, ch + 0x100,
+                        fg[at & 0xf], bg[at >> 4]);
+      }
+      _dirty_add(dirty, x0 * chw, yoffset + y * chh, (x - x0) * chw, chh);
     }
     // step over glyph line
     dsty += pitch * chh;
   }
+
   // this is text mode so draw the cursor if needed
-  _neo_draw_cursor(target, chw, chh, cols, rows, yoffset);
+  if (cursor_on && cache->dirty[cursor_cell]) {
+    _neo_draw_cursor(target, chw, chh, cursor_x, cursor_y, yoffset);
+  }
+}
+
+// 80x25 greyscale text mode
+static void _neo_render_mode_02(const struct render_target_t *target,
+                                struct render_dirty_t *dirty) {
+  _neo_render_text(target, dirty, palette_cga_2_rgb, palette_cga_2_rgb, true);
+}
+
+// 80x25 16-colour text mode
+static void _neo_render_mode_03(const struct render_target_t *target,
+                                struct render_dirty_t *dirty) {
+  _neo_render_text(target, dirty, palette_cga_3_rgb, palette_cga_3_rgb, true);
 }
 
 // 320x200 4-colour graphics mode interleaved
 static void _neo_render_mode_04(void) {
-  // buffer address
-  uint32_t src = 0xB8000;
-  uint32_t span = 1024 * 8;
+  // display start in bytes and the stride of each interleaved bank
+  const uint32_t start = _crt_start() * 2;
+  const uint32_t stride = _crt_offset() ? (_crt_offset() * 4) : (320 / 4);
   // screen buffer position
   const uint32_t pitch = 320;
-  uint32_t *dsty = _temp;
+  uint32_t *dsty = _frame;
   // blit loop
   for (int y=0; y<200; ++y) {
     uint32_t *dstx = dsty;
-    uint32_t srcx = src + ((y & 1) ? span : 0);
+    // odd lines come from the second 8k bank
+    const uint8_t *bank = _snap->text + ((y & 1) ? 0x2000 : 0);
+    uint32_t srcx = start + (y >> 1) * stride;
     for (int x=0; x<320; x += 4, ++srcx) {
-      const uint8_t ch = RAM[srcx];
+      const uint8_t ch = bank[srcx & 0x1fff];
       dstx[x + 3] = palette_cga_4_rgb[0x3 & (ch >> 0)];
       dstx[x + 2] = palette_cga_4_rgb[0x3 & (ch >> 2)];
       dstx[x + 1] = palette_cga_4_rgb[0x3 & (ch >> 4)];
       dstx[x + 0] = palette_cga_4_rgb[0x3 & (ch >> 6)];
     }
     dsty += pitch;
-    src += (y & 1) ? (320 / 4) : 0;
   }
 }
 
@@ -192,295 +363,136 @@ static void _neo_render_mode_05(void) {
     0x000000, 0x444444, 0x888888, 0xcccccc
   };
 
-  // buffer address
-  uint32_t src = 0xB8000;
-  uint32_t span = 1024 * 8;
+  // display start in bytes and the stride of each interleaved bank
+  const uint32_t start = _crt_start() * 2;
+  const uint32_t stride = _crt_offset() ? (_crt_offset() * 4) : (320 / 4);
   // screen buffer position
   const uint32_t pitch = 320;
-  uint32_t *dsty = _temp;
+  uint32_t *dsty = _frame;
   // blit loop
   for (int y=0; y<200; ++y) {
     uint32_t *dstx = dsty;
-    uint32_t srcx = src + ((y & 1) ? span : 0);
+    // odd lines come from the second 8k bank
+    const uint8_t *bank = _snap->text + ((y & 1) ? 0x2000 : 0);
+    uint32_t srcx = start + (y >> 1) * stride;
     for (int x=0; x<320; x += 4, ++srcx) {
-      const uint8_t ch = RAM[srcx];
+      const uint8_t ch = bank[srcx & 0x1fff];
       dstx[x + 3] = ramp[0x3 & (ch >> 0)];
       dstx[x + 2] = ramp[0x3 & (ch >> 2)];
       dstx[x + 1] = ramp[0x3 & (ch >> 4)];
       dstx[x + 0] = ramp[0x3 & (ch >> 6)];
     }
     dsty += pitch;
-    src += (y & 1) ? (320 / 4) : 0;
   }
 }
 
 // 80x25 greyscale text mode
 // XXX: untested
-static void _neo_render_mode_07(const struct render_target_t *target) {
-  // text mode buffer address
-  uint32_t src = 0xB8000;
-  // cga/PCjr = 9x14  char px
-  const int chw = 8, chh = 16;
-  // step through VGA text-mode buffer
-  const int rows = 25, cols = 80;
-  // screen buffer position
-  const uint32_t pitch = target->pitch;
-  uint32_t *dsty = target->dst;
-  dsty += pitch * ((target->h - (chh * rows)) / 2);
-  // blit loop
-  for (int y=0; y<rows; ++y) {
-    uint32_t *dstx = dsty;
-    for (int x=0; x<cols; ++x) {
-      // grab character and attribute
-      const uint8_t ch = RAM[src + 0];
-      const uint8_t at = RAM[src + 1];
-      // draw the glyph
-      font_draw_glyph_8x16(dstx, pitch, ch + 0x100, 0xaaaaaa, 0x0);
-      // step over to next glyph
-      dstx += chw;
-      // step over character and attribute
-      src += 2;
-    }
-    // step over glyph line
-    dsty += pitch * chh;
-  }
+static void _neo_render_mode_07(const struct render_target_t *target,
+                                struct render_dirty_t *dirty) {
+  // attributes are ignored
+  static const uint32_t fg[16] = {
+    0xaaaaaa, 0xaaaaaa, 0xaaaaaa, 0xaaaaaa, 0xaaaaaa, 0xaaaaaa, 0xaaaaaa,
+    0xaaaaaa, 0xaaaaaa, 0xaaaaaa, 0xaaaaaa, 0xaaaaaa, 0xaaaaaa, 0xaaaaaa,
+    0xaaaaaa, 0xaaaaaa
+  };
+  static const uint32_t bg[16] = { 0 };
+  _neo_render_text(target, dirty, fg, bg, false);
 }
 
-static void _neo_render_mode_0e(const struct render_target_t *target) {
-  //
-  static const uint32_t width = 640;
-  static const uint32_t height = 200;
-  // vga dac palette
-  const uint32_t *dac = neo_ega_dac();
-  // video ram at 0xA0000
-  const uint8_t *plane0 = vga_ram() + 0x10000 * 0;
-  const uint8_t *plane1 = vga_ram() + 0x10000 * 1;
-  const uint8_t *plane2 = vga_ram() + 0x10000 * 2;
-  const uint8_t *plane3 = vga_ram() + 0x10000 * 3;
-  // target memory
-  uint32_t *dsty = target->dst;
-  const uint32_t pitch = target->pitch;
-  // center
-  dsty += ((target->h - (height * 2)) / 2) * pitch;
+// 16-colour planar graphics modes
+static void _neo_render_planar(uint32_t *dst, const uint32_t pitch,
+                               const uint32_t width, const uint32_t height,
+                               const uint32_t *dac) {
+  const uint32_t *vram = _snap->vram;
+  const uint32_t span = width / 8;
+  // display start and line offset in plane bytes
+  const uint32_t start = _crt_start();
+  const uint32_t stride = _crt_offset() ? (_crt_offset() * 2) : span;
+  const uint32_t split = _crt_split_row();
+  // panned lines are converted one byte wider and shifted into place
+  static uint32_t line[640 + 8];
   // blit loop
   for (uint32_t y = 0; y < height; ++y) {
-    uint32_t *dstx = dsty;
-    for (uint32_t x = 0; x < (width / 8); ++x) {
-      // get the next colour bytes from each plane
-      const uint8_t b0 = plane0[x];
-      const uint8_t b1 = plane1[x];
-      const uint8_t b2 = plane2[x];
-      const uint8_t b3 = plane3[x];
-      // write 8 pixels at a time
-      for (int i=0; i<8; ++i) {
-        const uint8_t mask = 0x80 >> i;
-        // combine bits for colour index
-        const uint8_t index = ((b0 & mask) ? 1 : 0) |
-                              ((b1 & mask) ? 2 : 0) |
-                              ((b2 & mask) ? 4 : 0) |
-                              ((b3 & mask) ? 8 : 0);
-        const uint32_t rgb = dac[index];
-        // XXX: this palette index is not right
-        *dstx           = rgb;
-        *(dstx + pitch) = rgb;
-        // next dest
-        ++dstx;
-      }
+    const uint32_t addr = _crt_row_addr(y, start, split, stride);
+    const uint32_t pan = _attr_pan(y, split);
+    if (pan) {
+      planar_to_rgb(line, vram, addr, span + 1, dac);
+      memcpy(dst, line + pan, width * sizeof(uint32_t));
     }
-    // step over the destination
-    dsty += pitch * 2;
-    // step the planes
-    plane0 += (width / 8);
-    plane1 += (width / 8);
-    plane2 += (width / 8);
-    plane3 += (width / 8);
+    else {
+      planar_to_rgb(dst, vram, addr, span, dac);
+    }
+    dst += pitch;
   }
 }
 
+// 640x200 16-colour graphics mode
+static void _neo_render_mode_0e(void) {
+  // XXX: this palette index is not right
+  const uint32_t *dac = _snap->ega_dac;
+  _neo_render_planar(_frame, 640, 640, 200, dac);
+}
+
+// 320x200 16-colour graphics mode
 static void _neo_render_mode_0d(void) {
-  const uint32_t *dac = neo_ega_dac();
-  // clear temp buffer
-  memset(_temp, 0, 320 * 240 * 4);
-  // video ram at 0xA0000
-  const uint8_t *plane0 = vga_ram() + 0x10000 * 0;
-  const uint8_t *plane1 = vga_ram() + 0x10000 * 1;
-  const uint8_t *plane2 = vga_ram() + 0x10000 * 2;
-  const uint8_t *plane3 = vga_ram() + 0x10000 * 3;
-  // writing to temporary buffer
-  uint32_t *dsty = _temp;
-  // blit loop
-  for (int y = 0; y < 200; ++y) {
-    uint32_t *dstx = dsty;
-    for (int x = 0; x < (320 / 8); ++x) {
-      // get the next colour bytes from each plane
-      const uint8_t b0 = plane0[x];
-      const uint8_t b1 = plane1[x];
-      const uint8_t b2 = plane2[x];
-      const uint8_t b3 = plane3[x];
-      // write 8 pixels at a time
-      for (int i=0; i<8; ++i) {
-        const uint8_t mask = 0x80 >> i;
-        // combine bits for colour index
-        const uint32_t index = ((b0 & mask) ? 1 : 0) |
-                               ((b1 & mask) ? 2 : 0) |
-                               ((b2 & mask) ? 4 : 0) |
-                               ((b3 & mask) ? 8 : 0);
-
-        // XXX: this palette index is not right!
-        *dstx = dac[index];
-        // next dest
-        ++dstx;
-      }
-    }
-    // step over the destination
-    dsty += 320;
-    // step the planes
-    plane0 += (320 / 8);
-    plane1 += (320 / 8);
-    plane2 += (320 / 8);
-    plane3 += (320 / 8);
-  }
+  // XXX: this palette index is not right!
+  const uint32_t *dac = _snap->ega_dac;
+  _neo_render_planar(_frame, 320, 320, 200, dac);
 }
 
-static void _neo_render_mode_10(const struct render_target_t *target) {
-  //
-  static const uint32_t width = 640;
-  static const uint32_t height = 350;
-  // vga dac palette
-  const uint32_t *dac = neo_vga_dac();
-  // video ram at 0xA0000
-  const uint8_t *plane0 = vga_ram() + 0x10000 * 0;
-  const uint8_t *plane1 = vga_ram() + 0x10000 * 1;
-  const uint8_t *plane2 = vga_ram() + 0x10000 * 2;
-  const uint8_t *plane3 = vga_ram() + 0x10000 * 3;
-  // destination
-  uint32_t *dsty = target->dst;
-  const uint32_t pitch = target->pitch;
-  dsty += pitch * ((target->h - height) / 2);
-  // blit loop
-  for (uint32_t y = 0; y < height; ++y) {
-    uint32_t *dstx = dsty;
-    for (uint32_t x = 0; x < (width / 8); ++x) {
-      // get the next colour bytes from each plane
-      const uint8_t b0 = plane0[x];
-      const uint8_t b1 = plane1[x];
-      const uint8_t b2 = plane2[x];
-      const uint8_t b3 = plane3[x];
-      // write 8 pixels at a time
-      for (int i=0; i<8; ++i) {
-        const uint8_t mask = 0x80 >> i;
-        // combine bits for colour index
-        const uint32_t index = ((b0 & mask) ? 1 : 0) |
-                               ((b1 & mask) ? 2 : 0) |
-                               ((b2 & mask) ? 4 : 0) |
-                               ((b3 & mask) ? 8 : 0);
-        *dstx = dac[index];
-        // next dest
-        ++dstx;
-      }
-    }
-    // step over the destination
-    dsty += pitch;
-    // step the planes
-    plane0 += (width / 8);
-    plane1 += (width / 8);
-    plane2 += (width / 8);
-    plane3 += (width / 8);
-  }
+// 640x350 16-colour graphics mode
+static void _neo_render_mode_10(void) {
+  const uint32_t *dac = _snap->vga_dac;
+  _neo_render_planar(_frame, 640, 640, 350, dac);
 }
 
-static void _neo_render_mode_13(void) {
-  const uint32_t *dac = neo_vga_dac();
-  // clear temp buffer
-  memset(_temp, 0, 320 * 240 * 4);
-  // source now is our video ram at 0xA0000
-  const uint8_t *srcy = vga_ram();
-  // writing to temporary buffer
-  uint32_t *dst = _temp;
-  // blit loop
-  for (int y = 0; y < 200; ++y) {
-    const uint8_t *srcx = srcy;
-    for (int x = 0; x < 320; ++x) {
-      dst[x] = dac[srcx[x]];
-    }
-    dst += 320;
-    srcy += 320;
-  }
+// 320x200 256-colour graphics mode, chain-4 or unchained (mode x)
+//
+// pixel x of a line is plane (x & 3) at offset (x / 4) in both cases, chain-4
+// writes are stored that way by video_neo.c.
+static uint32_t _mode_13_height(void) {
+  // mode x tweaks the vertical timing for up to 240 lines
+  const uint32_t height = _crt_lines();
+  return (height < 200 || height > 240) ? 200 : height;
 }
 
-static void _neo_render_mode_12(const struct render_target_t *target) {
-  //
-  static const uint32_t width = 640;
-  static const uint32_t height = 480;
-  // vga dac palette
-  const uint32_t *dac = neo_vga_dac();
-  // video ram at 0xA0000
-  const uint8_t *plane0 = vga_ram() + 0x10000 * 0;
-  const uint8_t *plane1 = vga_ram() + 0x10000 * 1;
-  const uint8_t *plane2 = vga_ram() + 0x10000 * 2;
-  const uint8_t *plane3 = vga_ram() + 0x10000 * 3;
-  // destination
-  uint32_t *dsty = target->dst;
-  const uint32_t pitch = target->pitch;
-  dsty += pitch * ((target->h - height) / 2);
+static void _neo_render_mode_13(void) {
+  const uint32_t *dac = _snap->vga_dac;
+  // display start for page flipping and line offset in plane bytes
+  const uint32_t start = _crt_start();
+  const uint32_t stride = _crt_offset() ? (_crt_offset() * 2) : 80;
+  const uint32_t split = _crt_split_row();
+  const uint32_t height = _mode_13_height();
+  // panned lines are converted one address wider and shifted into place
+  uint32_t line[320 + 4];
+  uint32_t *dst = _frame;
   // blit loop
   for (uint32_t y = 0; y < height; ++y) {
-    uint32_t *dstx = dsty;
-    for (uint32_t x = 0; x < (width / 8); ++x) {
-      // get the next colour bytes from each plane
-      const uint8_t b0 = plane0[x];
-      const uint8_t b1 = plane1[x];
-      const uint8_t b2 = plane2[x];
-      const uint8_t b3 = plane3[x];
-      // write 8 pixels at a time
-      for (int i=0; i<8; ++i) {
-        const uint8_t mask = 0x80 >> i;
-        // combine bits for colour index
-        const uint32_t index = ((b0 & mask) ? 1 : 0) |
-                               ((b1 & mask) ? 2 : 0) |
-                               ((b2 & mask) ? 4 : 0) |
-                               ((b3 & mask) ? 8 : 0);
-        *dstx = dac[index];
-        // next dest
-        ++dstx;
-      }
+    const uint32_t base = _crt_row_addr(y, start, split, stride);
+    // 256 colour pixels are two dots wide so the pan steps in pairs
+    const uint32_t pan = _attr_pan(y, split) >> 1;
+    uint32_t *out = pan ? line : dst;
+    for (uint32_t x = 0; x < (pan ? 81 : 80); ++x) {
+      // four consecutive pixels from the four planes
+      const uint32_t v = _snap->vram[(base + x) & 0xffff];
+      out[0] = dac[(v >>  0) & 0xff];
+      out[1] = dac[(v >>  8) & 0xff];
+      out[2] = dac[(v >> 16) & 0xff];
+      out[3] = dac[(v >> 24) & 0xff];
+      out += 4;
     }
-    // step over the destination
-    dsty += pitch;
-    // step the planes
-    plane0 += (width / 8);
-    plane1 += (width / 8);
-    plane2 += (width / 8);
-    plane3 += (width / 8);
+    if (pan) {
+      memcpy(dst, line + pan, 320 * sizeof(uint32_t));
+    }
+    dst += 320;
   }
 }
 
-// blit offscreen render target to screen
-static void blit_2x(uint32_t w, uint32_t h, const struct render_target_t *target) {
-
-  // TODO: check bounds
-
-  const uint32_t pitch = target->pitch;
-  uint32_t *dst = target->dst;
-  // offset to centre
-  if (target->h > (int32_t)(2 * h)) {
-    dst += pitch * ((target->h - h * 2) / 2);
-  }
-  // blit loop
-  const uint32_t *src = _temp;
-  for (uint32_t y = 0; y < h; ++y) {
-    uint32_t *dstx = dst;
-    for (uint32_t x = 0; x < w; ++x) {
-      const uint32_t rgb = src[x];
-      dstx[      + 0] = rgb;
-      dstx[      + 1] = rgb;
-      dstx[pitch + 0] = rgb;
-      dstx[pitch + 1] = rgb;
-      dstx += 2;
-    }
-    dst += pitch * 2;
-    src += w;
-  }
+// 640x480 16-colour graphics mode
+static void _neo_render_mode_12(void) {
+  const uint32_t *dac = _snap->vga_dac;
+  _neo_render_planar(_frame, 640, 640, 480, dac);
 }
 
 static void _draw_disk(const struct render_target_t *target) {
@@ -498,26 +510,122 @@ static void _draw_disk(const struct render_target_t *target) {
   }
 }
 
-void neo_render_tick(const struct render_target_t *target) {
+static void _clear_target(const struct render_target_t *target) {
+  uint32_t *dst = target->dst;
+  for (uint32_t y = 0; y < target->h; ++y) {
+    for (uint32_t x = 0; x < target->w; ++x) {
+      dst[x] = 0x050505;
+    }
+    dst += target->pitch;
+  }
+}
 
-  switch (neo_get_video_mode()) {
-  case 0x02: _neo_render_mode_02(target); break;
-  case 0x03: _neo_render_mode_03(target); break;
-  case 0x04: _neo_render_mode_04(); blit_2x(320, 200, target); break;
-  case 0x05: _neo_render_mode_05(); blit_2x(320, 200, target); break;
-  case 0x07: _neo_render_mode_07(target); break;
-  case 0x0d: _neo_render_mode_0d(); blit_2x(320, 200, target); break;
-  case 0x0e: _neo_render_mode_0e(target); break;
-  case 0x10: _neo_render_mode_10(target); break;
-  case 0x12: _neo_render_mode_12(target); break;
-  case 0x13: _neo_render_mode_13(); blit_2x(320, 200, target); break;
+// native frame size of a mode, false if it can't be drawn
+static bool _frame_size(const int mode, uint32_t *w, uint32_t *h) {
+  switch (mode) {
+  case 0x02:
+  case 0x03:
+  case 0x07: *w = TEXT_MAX_COLS * 8; *h = TEXT_MAX_ROWS * font_height(); break;
+  case 0x04:
+  case 0x05:
+  case 0x0d: *w = 320; *h = 200; break;
+  case 0x0e: *w = 640; *h = 200; break;
+  case 0x10: *w = 640; *h = 350; break;
+  case 0x12: *w = 640; *h = 480; break;
+  case 0x13: *w = 320; *h = _mode_13_height(); break;
   default:
+    return false;
+  }
+  return true;
+}
+
+void neo_render_tick(const struct video_snapshot_t *snap,
+                     const struct render_target_t *target,
+                     struct render_dirty_t *dirty) {
+
+  _snap = snap;
+  const int mode = snap->mode;
+
+  // the disk icon is blended over the frame so redraw everything while it
+  // is visible and once more to remove it
+  const bool disk = snap->disk;
+
+  // size of the frame and where it lands on the target
+  struct render_target_t frame = { _frame, 0, 0, 0 };
+  struct scale_plan_t plan = { 0 };
+  const bool known = _frame_size(mode, &frame.w, &frame.h);
+  frame.pitch = frame.w;
+  if (known) {
+    scale_plan(&plan, frame.w, frame.h, target);
+  }
+
+  // anything that invalidates what is already on the target
+  if (mode != _last_mode || disk || _last_disk ||
+      target->dst != _last_target.dst || target->w != _last_target.w ||
+      target->h != _last_target.h || target->pitch != _last_target.pitch ||
+      memcmp(&plan, &_last_plan, sizeof(plan))) {
+    _invalid = true;
+  }
+  _last_mode = mode;
+  _last_frame = snap->frame;
+  _last_disk = disk;
+  _last_target = *target;
+  _last_plan = plan;
+
+  dirty->full = _invalid;
+  dirty->count = 0;
+  if (_invalid) {
+    _clear_target(target);
+  }
+
+  if (!known) {
+    dirty->full = true;
     _neo_render_mode_unknown(target);
-    break;
+  }
+  else {
+    // draw into the frame, text modes only redraw the cells which changed
+    struct render_dirty_t drawn;
+    drawn.full = _invalid;
+    drawn.count = 0;
+    switch (mode) {
+    case 0x02: _neo_render_mode_02(&frame, &drawn); break;
+    case 0x03: _neo_render_mode_03(&frame, &drawn); break;
+    case 0x07: _neo_render_mode_07(&frame, &drawn); break;
+    default:
+      // graphics modes redraw the whole frame
+      drawn.full = true;
+      switch (mode) {
+      case 0x04: _neo_render_mode_04(); break;
+      case 0x05: _neo_render_mode_05(); break;
+      case 0x0d: _neo_render_mode_0d(); break;
+      case 0x0e: _neo_render_mode_0e(); break;
+      case 0x10: _neo_render_mode_10(); break;
+      case 0x12: _neo_render_mode_12(); break;
+      case 0x13: _neo_render_mode_13(); break;
+      }
+    }
+    // scale what was drawn onto the target
+    struct render_rect_t out;
+    if (drawn.full) {
+      const struct render_rect_t all = { 0, 0, frame.w, frame.h };
+      scale_blit(&plan, _frame, frame.pitch, &all, target, &out);
+      dirty->full = true;
+    }
+    else {
+      for (uint32_t i = 0; i < drawn.count; ++i) {
+        if (scale_blit(&plan, _frame, frame.pitch, drawn.rect + i,
+                       target, &out)) {
+          _dirty_add(dirty, out.x, out.y, out.w, out.h);
+        }
+      }
+    }
   }
 
   // indicate disk activity
-  if (osd_should_draw_disk()) {
+  if (disk) {
     _draw_disk(target);
   }
+
+  _invalid = false;
+  _snap = NULL;
 }
@@ -0,0 +1,268 @@
+/*
+  Fake86: A portable, open-source 8086 PC emulator.
+  Copyright (C)2010-2013 Mike Chambers
+               2019      Aidan Dodds
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+  USA.
+*/
+
+// integer scaling of rendered frames onto the render target
+//
+// every mode is first treated as a 640 pixel wide display, 320 pixel modes
+// have their pixels doubled and modes of 240 lines or less are line doubled
+// as a VGA would. that display is then scaled by a whole factor and centred.
+// columns are replicated with SIMD stores and rows by nearest line
+// replication, which also covers the 5:6 stretch of 200 line modes when the
+// aspect correction is enabled.
+
+#include "../common/common.h"
+#include "../frontend/frontend.h"
+#include "video.h"
+
+#if SIMD_SSE2
+#include <emmintrin.h>
+#elif SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+
+// width of the display every mode is first fitted to
+#define DISPLAY_W 640
+
+// user selected options
+static uint32_t _factor;
+static bool _aspect;
+static bool _scanlines;
+
+void scale_set_factor(uint32_t factor) {
+  _factor = (factor > SCALE_MAX) ? SCALE_MAX : factor;
+}
+
+void scale_set_aspect(bool enable) {
+  _aspect = enable;
+}
+
+void scale_set_scanlines(bool enable) {
+  _scanlines = enable;
+}
+
+void scale_plan(struct scale_plan_t *plan,
+                const uint32_t w, const uint32_t h,
+                const struct render_target_t *target) {
+  assert(plan && target && w && h);
+  // fit to the display
+  const uint32_t xr = (w <= DISPLAY_W / 2) ? 2 : 1;
+  const uint32_t yr = (h <= 240) ? 2 : 1;
+  const uint32_t dw = w * xr;
+  const uint32_t dh = _aspect ? (dw * 3 / 4) : (h * yr);
+  // largest factor that fits unless one was asked for
+  uint32_t n = _factor ? _factor : SCALE_MAX;
+  while (n > 1 && (dw * n > target->w || dh * n > target->h)) {
+    --n;
+  }
+  plan->src_w = w;
+  plan->src_h = h;
+  plan->kx = xr * n;
+  plan->out_w = dw * n;
+  plan->out_h = dh * n;
+  // centre, a frame larger than the target is cropped evenly
+  plan->x = ((int32_t)target->w - (int32_t)plan->out_w) / 2;
+  plan->y = ((int32_t)target->h - (int32_t)plan->out_h) / 2;
+}
+
+// first output row showing source row `y` or later
+static uint32_t _row_first(const struct scale_plan_t *plan, const uint32_t y) {
+  return (y * plan->out_h + plan->src_h - 1) / plan->src_h;
+}
+
+// source row shown on output row `j`
+static uint32_t _row_src(const struct scale_plan_t *plan, const uint32_t j) {
+  return j * plan->src_h / plan->out_h;
+}
+
+static inline uint32_t _dim(const uint32_t rgb) {
+  return (rgb >> 1) & 0x7f7f7f;
+}
+
+// replicate each of `n` pixels `k` times
+static void _expand_n(uint32_t *dst, const uint32_t *src, const uint32_t n,
+                      const uint32_t k, const bool dim) {
+  uint32_t i = 0;
+#if SIMD_SSE2
+  const __m128i half = _mm_set1_epi32(0x7f7f7f);
+  for (; i + 4 <= n && k <= 4; i += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+    if (dim) {
+      v = _mm_and_si128(_mm_srli_epi32(v, 1), half);
+    }
+    __m128i *out = (__m128i*)(dst + i * k);
+    switch (k) {
+    case 1:
+      _mm_storeu_si128(out, v);
+      break;
+    case 2:
+      _mm_storeu_si128(out + 0, _mm_unpacklo_epi32(v, v));
+      _mm_storeu_si128(out + 1, _mm_unpackhi_epi32(v, v));
+      break;
+    case 3:
+      // lanes 0001, 1122, 2333
+      _mm_storeu_si128(out + 0, _mm_shuffle_epi32(v, 0x40));
+      _mm_storeu_si128(out + 1, _mm_shuffle_epi32(v, 0xa5));
+      _mm_storeu_si128(out + 2, _mm_shuffle_epi32(v, 0xfe));
+      break;
+    case 4:
+      _mm_storeu_si128(out + 0, _mm_shuffle_epi32(v, 0x00));
+      _mm_storeu_si128(out + 1, _mm_shuffle_epi32(v, 0x55));
+      _mm_storeu_si128(out + 2, _mm_shuffle_epi32(v, 0xaa));
+      _mm_storeu_si128(out + 3, _mm_shuffle_epi32(v, 0xff));
+      break;
+    }
+  }
+  // wider factors store each pixel broadcast across whole vectors, any
+  // overshoot lands on the next pixel which is written after it
+  for (; i + 1 < n && k > 4; ++i) {
+    const uint32_t rgb = dim ? _dim(src[i]) : src[i];
+    const __m128i v = _mm_set1_epi32((int)rgb);
+    uint32_t *out = dst + i * k;
+    for (uint32_t j = 0; j < k; j += 4) {
+      _mm_storeu_si128((__m128i*)(out + j), v);
+    }
+  }
+#elif SIMD_NEON
+  for (; i + 4 <= n && k <= 4; i += 4) {
+    uint32x4_t v = vld1q_u32(src + i);
+    if (dim) {
+      v = vandq_u32(vshrq_n_u32(v, 1), vdupq_n_u32(0x7f7f7f));
+    }
+    uint32_t *out = dst + i * k;
+    const uint32x2_t lo = vget_low_u32(v), hi = vget_high_u32(v);
+    switch (k) {
+    case 1:
+      vst1q_u32(out, v);
+      break;
+    case 2: {
+      const uint32x4x2_t z = vzipq_u32(v, v);
+      vst1q_u32(out + 0, z.val[0]);
+      vst1q_u32(out + 4, z.val[1]);
+      break;
+    }
+    case 3:
+      vst1q_u32(out + 0, vcombine_u32(vdup_lane_u32(lo, 0), lo));
+      vst1q_u32(out + 4, vcombine_u32(vdup_lane_u32(lo, 1),
+                                      vdup_lane_u32(hi, 0)));
+      vst1q_u32(out + 8, vcombine_u32(hi, vdup_lane_u32(hi, 1)));
+      break;
+    case 4:
+      vst1q_u32(out +  0, vdupq_lane_u32(lo, 0));
+      vst1q_u32(out +  4, vdupq_lane_u32(lo, 1));
+      vst1q_u32(out +  8, vdupq_lane_u32(hi, 0));
+      vst1q_u32(out + 12, vdupq_lane_u32(hi, 1));
+      break;
+    }
+  }
+  for (; i + 1 < n && k > 4; ++i) {
+    const uint32x4_t v = vdupq_n_u32(dim ? _dim(src[i]) : src[i]);
+    uint32_t *out = dst + i * k;
+    for (uint32_t j = 0; j < k; j += 4) {
+      vst1q_u32(out + j, v);
+    }
+  }
+#endif
+  // remainder
+  for (; i < n; ++i) {
+    const uint32_t rgb = dim ? _dim(src[i]) : src[i];
+    uint32_t *out = dst + i * k;
+    for (uint32_t j = 0; j < k; ++j) {
+      out[j] = rgb;
+    }
+  }
+}
+
+// write scaled columns [x0, x1) of a row, `dst` is column x0
+static void _expand(uint32_t *dst, const uint32_t *src,
+                    uint32_t x0, const uint32_t x1,
+                    const uint32_t k, const bool dim) {
+  // partial leading pixel of a cropped row
+  for (; (x0 % k) && x0 < x1; ++x0) {
+    *dst++ = dim ? _dim(src[x0 / k]) : src[x0 / k];
+  }
+  const uint32_t n = (x1 - x0) / k;
+  _expand_n(dst, src + x0 / k, n, k, dim);
+  dst += n * k;
+  x0 += n * k;
+  // partial trailing pixel
+  for (; x0 < x1; ++x0) {
+    *dst++ = dim ? _dim(src[x0 / k]) : src[x0 / k];
+  }
+}
+
+bool scale_blit(const struct scale_plan_t *plan,
+                const uint32_t *src, const uint32_t src_pitch,
+                const struct render_rect_t *in,
+                const struct render_target_t *target,
+                struct render_rect_t *out) {
+  const uint32_t k = plan->kx;
+  // source rect in scaled frame coordinates
+  int32_t x0 = (int32_t)(in->x * k);
+  int32_t x1 = (int32_t)((in->x + in->w) * k);
+  int32_t y0 = (int32_t)_row_first(plan, in->y);
+  int32_t y1 = (int32_t)_row_first(plan, in->y + in->h);
+  // clip to the target
+  if (x0 < -plan->x) {
+    x0 = -plan->x;
+  }
+  if (y0 < -plan->y) {
+    y0 = -plan->y;
+  }
+  if (x1 > (int32_t)target->w - plan->x) {
+    x1 = (int32_t)target->w - plan->x;
+  }
+  if (y1 > (int32_t)target->h - plan->y) {
+    y1 = (int32_t)target->h - plan->y;
+  }
+  if (x0 >= x1 || y0 >= y1) {
+    return false;
+  }
+  const uint32_t pitch = target->pitch;
+  const size_t bytes = (x1 - x0) * sizeof(uint32_t);
+  uint32_t *dst = target->dst + (plan->y + y0) * pitch + (plan->x + x0);
+  // last undimmed row written, repeats of a source row are copied from it
+  const uint32_t *last = NULL;
+  uint32_t last_src = ~0u;
+  for (int32_t j = y0; j < y1; ++j) {
+    const uint32_t sy = _row_src(plan, j);
+    // darken the final row of each source row drawn more than once
+    const bool dim = _scanlines && j > 0 &&
+                     _row_src(plan, j - 1) == sy &&
+                     _row_src(plan, j + 1) != sy;
+    if (sy == last_src && !dim) {
+      memcpy(dst, last, bytes);
+    }
+    else {
+      _expand(dst, src + sy * src_pitch, x0, x1, k, dim);
+      if (!dim) {
+        last = dst;
+        last_src = sy;
+      }
+    }
+    dst += pitch;
+  }
+  out->x = plan->x + x0;
+  out->y = plan->y + y0;
+  out->w = x1 - x0;
+  out->h = y1 - y0;
+  return true;
+}
@@ -33,6 +33,8 @@ struct vga_timing_t {
 static struct vga_timing_t _vga_timing;
 
 static bool _should_flip;
+// vblanks since power on
+static uint32_t _frames;
 
 void vga_timing_init(void) {
 
@@ -68,11 +70,20 @@ void vga_timing_advance(const uint64_t cycles) {
   // wrap back into range
   while (_vga_timing.px_accum > _vga_timing.px_per_frame) {
     _should_flip = true;
+    ++_frames;
     // wrap back into range
     _vga_timing.px_accum -= _vga_timing.px_per_frame;
   }
 }
 
+uint32_t vga_timing_frames(void) {
+  return _frames;
+}
+
+double vga_timing_refresh(void) {
+  return _vga_timing.hz * speed_scale;
+}
+
 uint8_t vga_timing_get_3da(void) {
   // find our cycles part way through the slice
   double acc = _vga_timing.px_accum;
@@ -30,24 +30,101 @@ uint8_t neo_crt_register(uint32_t index);
 uint8_t neo_crt_cursor_start(void);
 uint8_t neo_crt_cursor_end(void);
 
-const uint8_t *vga_ram(void);
+// vga memory, the four plane bytes of each address packed with plane 0 in
+// the low byte
+const uint32_t *vga_ram(void);
+
+// size of the cga/text memory window at 0xB8000 captured in a snapshot, all
+// eight 80x25 text pages
+#define SNAPSHOT_TEXT_SIZE 0x8000
+// granularity of vga memory change tracking
+#define SNAPSHOT_PAGE_SIZE 0x1000
+
+// video state captured at vblank for the renderer
+struct video_snapshot_t {
+  int mode;
+  // vga_timing_frames() at the time it was taken
+  uint32_t frame;
+  // draw the disk activity icon over the frame, never set for captures so
+  // they do not depend on the host clock
+  bool disk;
+  uint8_t crt[32];
+  // attribute controller registers
+  uint8_t attr[32];
+  uint32_t vga_dac[256];
+  uint32_t ega_dac[16];
+  // cga/text memory
+  uint8_t text[SNAPSHOT_TEXT_SIZE];
+  // vga memory, laid out as vga_ram()
+  uint32_t vram[0x10000];
+};
+
+// return and clear the set of vga memory pages written since the last call,
+// bit n covers plane offsets n * SNAPSHOT_PAGE_SIZE in all four planes
+uint32_t neo_vram_dirty(void);
+
+// return true if any displayed state other than vga memory has changed since
+// the last call
+bool neo_state_changed(void);
+
+// copy the current video state into a snapshot, only the vga memory pages
+// set in `pages` are copied
+void neo_snapshot(struct video_snapshot_t *snap, const uint32_t pages);
+
+// hash of the displayed video state without rasterising it, the vga memory
+// pages set in `pages` are rehashed, all of them on the first call
+uint64_t neo_state_hash(uint32_t pages);
+
+// largest text screen neo_text_screen will return
+#define TEXT_SCREEN_MAX_COLS 80
+#define TEXT_SCREEN_MAX_ROWS 60
+// bytes needed to hold a text screen as utf-8
+#define TEXT_SCREEN_SIZE \
+  (TEXT_SCREEN_MAX_ROWS * (TEXT_SCREEN_MAX_COLS * 3 + 1) + 1)
+
+// write the displayed text screen as utf-8, one line per row with trailing
+// blanks removed. the display start, row offset and the rows and columns of
+// the mode are honoured. returns false in graphics modes.
+bool neo_text_screen(char *out, uint32_t *cols, uint32_t *rows);
 
 // return video DAC data
 const uint32_t *neo_vga_dac(void);
 const uint32_t *neo_ega_dac(void);
 
+// text mode font source
+enum font_t {
+  font_cga_8x8,   // built in font, rows doubled
+  font_rom_8x14,  // EGA font from the video bios
+  font_rom_8x16,  // VGA font from the video bios
+};
+
+void font_select(enum font_t font);
+// height in pixels of glyphs drawn by font_draw_glyph
+uint32_t font_height(void);
+
 // font glyph blitters
 void font_draw_glyph_8x8(
   uint32_t *dst, const uint32_t pitch, uint16_t ch,
   const uint32_t rgb_a, const uint32_t rgb_b);
 
-void font_draw_glyph_8x16(
+// draw a glyph from the selected text mode font
+void font_draw_glyph(
   uint32_t *dst, const uint32_t pitch, uint16_t ch,
   const uint32_t rgb_a, const uint32_t rgb_b);
 
 void font_draw_glyph_8x16_gliss(
   uint32_t *dst, const uint32_t pitch, uint16_t ch, uint32_t rgb);
 
+// planar.c
+// convert `bytes` addresses of EGA/VGA memory (laid out as vga_ram) starting
+// at plane offset `addr` into 8 * `bytes` pixels through a 16 entry palette
+void planar_to_rgb(uint32_t *dst, const uint32_t *vram,
+                   uint32_t addr, const uint32_t bytes,
+                   const uint32_t *pal);
+
+// cp437.c
+extern const uint16_t cp437_unicode[256];
+
 // palette.c
 extern const uint32_t palette_cga_2_rgb[];
 extern const uint32_t palette_cga_3_rgb[];
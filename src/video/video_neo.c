@@ -21,6 +21,7 @@
 
 #include "../common/common.h"
 #include "../cpu/cpu.h"
+#include "video.h"
 
 // References:
 //   http://www.osdever.net/FreeVGA/vga/vgareg.htm
@@ -69,7 +70,15 @@ static uint8_t _active_page = 0;
 static bool _no_blanking = false;
 
 // 4x 64k memory planes
-static uint8_t _vga_ram[0x40000];
+//
+// the four plane bytes for each address are stored together, plane 0 in the
+// low byte. the latches load in one go and chain-4 addressing becomes a plain
+// byte offset into this array.
+static uint32_t _vga_ram[0x10000];
+// pages of _vga_ram written since the last snapshot
+uint32_t neo_vga_dirty = ~0u;
+// byte view of _vga_ram while chain-4 writes need no processing
+uint8_t *neo_chain4_ram;
 
 // ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
 
@@ -316,6 +325,26 @@ static uint32_t _vga_bit_mask(void) {
   return _vga_reg_data[0x8];
 }
 
+// state derived from the sequencer and graphics controller registers
+//
+// this is recomputed when those registers are written rather than for every
+// byte written to video memory.
+struct vga_gc_t {
+  uint32_t plane_enable;  // map mask register
+  uint32_t plane_mask;    // map mask register as lanes
+  bool     chain4;        // low address bits select the plane
+  uint32_t sr_mask;       // lanes taken from the cpu rather than set/reset
+  uint32_t sr_value;      // set/reset lanes
+  uint32_t bit_mask;      // bit mask register broadcast to all lanes
+  uint8_t  bit_mask_8;
+  uint8_t  rot_count;
+};
+
+// matches all registers being zero
+static struct vga_gc_t _gc = { 0, 0, false, ~0u, ~0u, 0, 0, 0 };
+
+static void _vga_gc_update(void);
+
 // ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
 // VGA DAC - 3C6H - 3C9H
 
@@ -480,6 +509,7 @@ static void ega_port_write(uint16_t portnum, uint8_t value) {
   case 0x3c5:
 //    printf("_vga_seq_data[0x%02x] = 0x%02x\n", _vga_seq_addr, value);
     _vga_seq_data[_vga_seq_addr] = value;
+    _vga_gc_update();
     break;
 
   case 0x3c6:
@@ -509,6 +539,7 @@ static void ega_port_write(uint16_t portnum, uint8_t value) {
     break;
   case 0x3cf:
     _vga_reg_data[_vga_reg_addr] = value;
+    _vga_gc_update();
     break;
 
   default:
@@ -617,6 +648,7 @@ static void _clear_text_buffer(void) {
 
 static void _clear_vga_buffer(void) {
   memset(_vga_ram, 0, sizeof(_vga_ram));
+  neo_vga_dirty = ~0u;
 }
 
 static void neo_set_video_mode(uint8_t al) {
@@ -750,12 +782,16 @@ static uint8_t _neo_vga_read_1(uint32_t addr) {
 // EGA/VGA
 uint8_t neo_mem_read_A0000(uint32_t addr) {
   addr -= 0xA0000;
-  const uint32_t planesize = 0x10000;
+  if (_gc.chain4) {
+    // the low address bits pick the plane
+    _vga_latch = _vga_ram[addr >> 2];
+    if (_vga_read_mode() == 0) {
+      return (_vga_latch >> ((addr & 3) * 8)) & 0xff;
+    }
+    return _neo_vga_read_1(addr);
+  }
   // fill the latches
-  _vga_latch  = ((uint32_t)_vga_ram[addr + planesize * 0]) << 0;
-  _vga_latch |= ((uint32_t)_vga_ram[addr + planesize * 1]) << 8;
-  _vga_latch |= ((uint32_t)_vga_ram[addr + planesize * 2]) << 16;
-  _vga_latch |= ((uint32_t)_vga_ram[addr + planesize * 3]) << 24;
+  _vga_latch = _vga_ram[addr];
   // dispatch via read mode
   switch (_vga_read_mode()) {
   case 0: return _neo_vga_read_0(addr);
@@ -765,33 +801,26 @@ uint8_t neo_mem_read_A0000(uint32_t addr) {
   }
 }
 
-static void _neo_vga_write_planes(uint32_t addr, const uint32_t lanes) {
-
-  const uint32_t planesize = 0x10000;
-
-  if (_vga_plane_write_enable() & 0x01) {
-    _vga_ram[addr + planesize * 0] = (lanes >> 0) & 0xff;
-  }
-  if (_vga_plane_write_enable() & 0x02) {
-    _vga_ram[addr + planesize * 1] = (lanes >> 8) & 0xff;
-  }
-  if (_vga_plane_write_enable() & 0x04) {
-    _vga_ram[addr + planesize * 2] = (lanes >> 16) & 0xff;
-  }
-  if (_vga_plane_write_enable() & 0x08) {
-    _vga_ram[addr + planesize * 3] = (lanes >> 24) & 0xff;
-  }
+static inline void _neo_vga_write_planes(uint32_t addr, const uint32_t lanes) {
+  const uint32_t mask = _gc.plane_mask;
+  neo_vga_dirty |= 1u << (addr / SNAPSHOT_PAGE_SIZE);
+  _vga_ram[addr] = (_vga_ram[addr] & ~mask) | (lanes & mask);
 }
 
 static inline uint32_t _broadcast(const uint8_t val) {
   return (val << 24) | (val << 16) | (val << 8) | val;
 }
 
-static void _neo_vga_write_alu(uint32_t addr, uint32_t input) {
+// the write paths below take the logic op, if a rotate is needed and if the
+// bit mask is 0xff as constants so that each combination gets a specialised
+// function via the VGA_WRITE_* macros.
 
+static inline uint32_t _neo_vga_write_alu(const uint32_t input,
+                                          const uint32_t op,
+                                          const bool full) {
   // alu operations
   uint32_t tmp1;
-  switch (_vga_logic_op()) {
+  switch (op) {
   case 0: tmp1 = input;              break;
   case 1: tmp1 = input & _vga_latch; break;
   case 2: tmp1 = input | _vga_latch; break;
@@ -799,35 +828,28 @@ static void _neo_vga_write_alu(uint32_t addr, uint32_t input) {
   default:
     UNREACHABLE();
   }
-
-  // mux between tmp0 or alu results
-  // todo: precompute this
-  const uint32_t bm_mux = _broadcast(_vga_bit_mask());
-  uint32_t tmp2 = (tmp1 & bm_mux) | (_vga_latch & ~bm_mux);
-
-  // write data to planes
-  _neo_vga_write_planes(addr, tmp2);
+  // a full bit mask takes every bit from the alu
+  if (full) {
+    return tmp1;
+  }
+  // mux between latch or alu results
+  const uint32_t bm_mux = _gc.bit_mask;
+  return (tmp1 & bm_mux) | (_vga_latch & ~bm_mux);
 }
 
 // 00 = Write Mode 0
-static void _neo_vga_write_0(uint32_t addr, uint8_t value) {
-
-  value = _ror8(value, _vga_rot_count());
-  
+static inline uint32_t _neo_vga_lanes_0(uint8_t value, const uint32_t op,
+                                        const bool rot, const bool full) {
+  if (rot) {
+    value = _ror8(value, _gc.rot_count);
+  }
   // 4 lanes of input bytes
-  uint32_t path = (value << 24) | (value << 16) | (value << 8) | value;
-  // 4 lanes on input bits from s/r value
-  uint32_t srvl = _vga_sr_value() ? 0 : ~0u;
-
-  // mask to mux between bytes or s/r value
-  // todo: precompute this
-  const uint8_t sr_reg = _vga_sr_enable();
-  uint32_t sr_mask = ~_make_mask(sr_reg);
-
+  const uint32_t path = _broadcast(value);
   // mux between byte inputs or s/r value
-  uint32_t tmp0 = (path & sr_mask) | (srvl & ~sr_mask);
+  const uint32_t sr_mask = _gc.sr_mask;
+  const uint32_t tmp0 = (path & sr_mask) | (_gc.sr_value & ~sr_mask);
 
-  _neo_vga_write_alu(addr, tmp0);
+  return _neo_vga_write_alu(tmp0, op, full);
 }
 
 // 01 = Write Mode 1
@@ -836,22 +858,25 @@ static void _neo_vga_write_1(uint32_t addr, uint8_t value) {
 }
 
 // 10 = Write Mode 2
-static void _neo_vga_write_2(uint32_t addr, uint8_t value) {
+static inline uint32_t _neo_vga_lanes_2(uint8_t value, const uint32_t op,
+                                        const bool full) {
   //see: https://www.phatcode.net/res/224/files/html/ch27/27-01.html
 
   //XXX: called by INDY
 
   const uint32_t mask = _make_mask(value);
-  _neo_vga_write_alu(addr, mask);
+  return _neo_vga_write_alu(mask, op, full);
 }
 
 // 11 = Write Mode 3
-static void _neo_vga_write_3(uint32_t addr, uint8_t value) {
+static inline uint32_t _neo_vga_lanes_3(uint8_t value, const bool rot) {
 
   // https://wiki.osdev.org/VGA_Hardware - write mode 3
 
   // rotate input bits
-  value = _ror8(value, _vga_rot_count());
+  if (rot) {
+    value = _ror8(value, _gc.rot_count);
+  }
 
   //TODO: verify this please
   //XXX: not just AND, use function select register bits 3-4 for func
@@ -859,11 +884,11 @@ static void _neo_vga_write_3(uint32_t addr, uint8_t value) {
 
   // The resulting value is ANDed with the Bit Mask Register, resulting in the
   // bit mask to be applied
-  uint8_t tmp0 = _vga_bit_mask() & value;
+  uint8_t tmp0 = _gc.bit_mask_8 & value;
 
   // Each plane takes one bit from the Set/Reset Value register, and turns it
   // into either 0x00 (if set) or 0xff (if clear) 
-  uint32_t srvl = _vga_sr_value() ? 0 : ~0u;
+  uint32_t srvl = _gc.sr_value;
 
   // The computed bit mask is checked, for each set bit the corresponding bit
   // from the set/reset logic is forwarded. If the bit is clear the bit is taken
@@ -872,28 +897,434 @@ static void _neo_vga_write_3(uint32_t addr, uint8_t value) {
   uint32_t tmp1 = (srvl & switcher) | (_vga_latch & ~switcher );
 
   // The result is sent towards memory
-  _neo_vga_write_planes(addr, tmp1);
+  return tmp1;
 }
 
-// EGA/VGA
-void neo_mem_write_A0000(uint32_t addr, uint8_t value) {
+typedef void (*vga_write_t)(uint32_t addr, uint8_t value);
 
-  addr -= 0xA0000;
+#define VGA_WRITE_0(OP, ROT, FULL)                                          \
+  static void _neo_vga_write_0_##OP##ROT##FULL(uint32_t addr, uint8_t v) {  \
+    _neo_vga_write_planes(addr, _neo_vga_lanes_0(v, OP, ROT, FULL));        \
+  }
+#define VGA_WRITE_2(OP, FULL)                                               \
+  static void _neo_vga_write_2_##OP##FULL(uint32_t addr, uint8_t v) {       \
+    _neo_vga_write_planes(addr, _neo_vga_lanes_2(v, OP, FULL));             \
+  }
+#define VGA_WRITE_3(ROT)                                                    \
+  static void _neo_vga_write_3_##ROT(uint32_t addr, uint8_t v) {            \
+    _neo_vga_write_planes(addr, _neo_vga_lanes_3(v, ROT));                  \
+  }
+
+VGA_WRITE_0(0, 0, 0) VGA_WRITE_0(0, 0, 1) VGA_WRITE_0(0, 1, 0) VGA_WRITE_0(0, 1, 1)
+VGA_WRITE_0(1, 0, 0) VGA_WRITE_0(1, 0, 1) VGA_WRITE_0(1, 1, 0) VGA_WRITE_0(1, 1, 1)
+VGA_WRITE_0(2, 0, 0) VGA_WRITE_0(2, 0, 1) VGA_WRITE_0(2, 1, 0) VGA_WRITE_0(2, 1, 1)
+VGA_WRITE_0(3, 0, 0) VGA_WRITE_0(3, 0, 1) VGA_WRITE_0(3, 1, 0) VGA_WRITE_0(3, 1, 1)
+
+VGA_WRITE_2(0, 0) VGA_WRITE_2(0, 1)
+VGA_WRITE_2(1, 0) VGA_WRITE_2(1, 1)
+VGA_WRITE_2(2, 0) VGA_WRITE_2(2, 1)
+VGA_WRITE_2(3, 0) VGA_WRITE_2(3, 1)
+
+VGA_WRITE_3(0) VGA_WRITE_3(1)
+
+// [logic op][rotate][full bit mask]
+static const vga_write_t _vga_write_0_fn[4][2][2] = {
+  {{_neo_vga_write_0_000, _neo_vga_write_0_001},
+   {_neo_vga_write_0_010, _neo_vga_write_0_011}},
+  {{_neo_vga_write_0_100, _neo_vga_write_0_101},
+   {_neo_vga_write_0_110, _neo_vga_write_0_111}},
+  {{_neo_vga_write_0_200, _neo_vga_write_0_201},
+   {_neo_vga_write_0_210, _neo_vga_write_0_211}},
+  {{_neo_vga_write_0_300, _neo_vga_write_0_301},
+   {_neo_vga_write_0_310, _neo_vga_write_0_311}},
+};
+
+// [logic op][full bit mask]
+static const vga_write_t _vga_write_2_fn[4][2] = {
+  {_neo_vga_write_2_00, _neo_vga_write_2_01},
+  {_neo_vga_write_2_10, _neo_vga_write_2_11},
+  {_neo_vga_write_2_20, _neo_vga_write_2_21},
+  {_neo_vga_write_2_30, _neo_vga_write_2_31},
+};
+
+// [rotate]
+static const vga_write_t _vga_write_3_fn[2] = {
+  _neo_vga_write_3_0, _neo_vga_write_3_1,
+};
 
+// current write path, matches all registers being zero
+static vga_write_t _vga_write = _neo_vga_write_0_000;
+
+static void _vga_gc_update(void) {
+  _gc.plane_enable = _vga_plane_write_enable();
+  _gc.plane_mask   = _make_mask(_gc.plane_enable);
+  _gc.chain4       = (_vga_seq_data[0x4] & 0x08) != 0;
+  _gc.sr_mask      = ~_make_mask(_vga_sr_enable());
+  _gc.sr_value     = _vga_sr_value() ? 0 : ~0u;
+  _gc.bit_mask_8   = _vga_bit_mask();
+  _gc.bit_mask     = _broadcast(_gc.bit_mask_8);
+  _gc.rot_count    = _vga_rot_count();
+  // pick the specialised write path
+  const uint32_t op = _vga_logic_op();
+  const uint32_t rot = _gc.rot_count ? 1 : 0;
+  const uint32_t full = (_gc.bit_mask_8 == 0xff) ? 1 : 0;
   switch (_vga_write_mode()) {
-  case 0: _neo_vga_write_0(addr, value); break;
-  case 1: _neo_vga_write_1(addr, value); break;
-  case 2: _neo_vga_write_2(addr, value); break;
-  case 3: _neo_vga_write_3(addr, value); break;
+  case 0: _vga_write = _vga_write_0_fn[op][rot][full]; break;
+  case 1: _vga_write = _neo_vga_write_1;               break;
+  case 2: _vga_write = _vga_write_2_fn[op][full];      break;
+  case 3: _vga_write = _vga_write_3_fn[rot];           break;
   default:
     UNREACHABLE();
   }
+  // chain-4 writes which would just store the byte can skip all of this
+  const bool plain = (_vga_write == _neo_vga_write_0_001) &&
+                     (_vga_sr_enable() == 0) &&
+                     (_gc.plane_enable == 0x0f);
+  neo_chain4_ram = (_gc.chain4 && plain) ? (uint8_t*)_vga_ram : NULL;
+}
+
+// the planes a write would produce for `value` with the current latch
+static uint32_t _vga_lanes(const uint8_t value) {
+  const uint32_t op = _vga_logic_op();
+  const bool rot = _gc.rot_count != 0;
+  const bool full = _gc.bit_mask_8 == 0xff;
+  switch (_vga_write_mode()) {
+  case 0: return _neo_vga_lanes_0(value, op, rot, full);
+  case 1: return _vga_latch;
+  case 2: return _neo_vga_lanes_2(value, op, full);
+  case 3: return _neo_vga_lanes_3(value, rot);
+  default:
+    UNREACHABLE();
+  }
+}
+
+// chain-4 write, the low address bits select a single plane
+static void _neo_vga_write_chain4(uint32_t addr, uint8_t value) {
+  const uint32_t offs = addr >> 2;
+  const uint32_t mask = _gc.plane_mask & (0xffu << ((addr & 3) * 8));
+  const uint32_t lanes = _vga_lanes(value);
+  neo_vga_dirty |= 1u << (offs / SNAPSHOT_PAGE_SIZE);
+  _vga_ram[offs] = (_vga_ram[offs] & ~mask) | (lanes & mask);
+}
+
+// EGA/VGA
+void neo_mem_write_A0000(uint32_t addr, uint8_t value) {
+  addr -= 0xA0000;
+  if (_gc.chain4) {
+    _neo_vga_write_chain4(addr, value);
+    return;
+  }
+  _vga_write(addr, value);
 }
 
-const uint8_t *vga_ram(void) {
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+// word and block access
+//
+// callers must keep the whole access inside A0000-AFFFF.
+
+// mark all pages touched by an inclusive range of plane offsets
+static void _vga_mark_dirty(const uint32_t first, const uint32_t last) {
+  for (uint32_t i = first / SNAPSHOT_PAGE_SIZE;
+       i <= last / SNAPSHOT_PAGE_SIZE; ++i) {
+    neo_vga_dirty |= 1u << i;
+  }
+}
+
+uint16_t neo_mem_readw_A0000(uint32_t addr) {
+  const uint16_t lo = neo_mem_read_A0000(addr + 0);
+  const uint16_t hi = neo_mem_read_A0000(addr + 1);
+  return lo | (hi << 8);
+}
+
+void neo_mem_writew_A0000(uint32_t addr, uint16_t value) {
+  addr -= 0xA0000;
+  if (neo_chain4_ram) {
+    memcpy(neo_chain4_ram + addr, &value, sizeof(value));
+    _vga_mark_dirty(addr >> 2, (addr + 1) >> 2);
+    return;
+  }
+  if (_gc.chain4) {
+    _neo_vga_write_chain4(addr + 0, (uint8_t)(value >> 0));
+    _neo_vga_write_chain4(addr + 1, (uint8_t)(value >> 8));
+    return;
+  }
+  _vga_write(addr + 0, (uint8_t)(value >> 0));
+  _vga_write(addr + 1, (uint8_t)(value >> 8));
+}
+
+void neo_mem_write_block(uint32_t addr, const uint8_t *src, size_t size) {
+  if (size == 0) {
+    return;
+  }
+  addr -= 0xA0000;
+  if (neo_chain4_ram) {
+    memcpy(neo_chain4_ram + addr, src, size);
+    _vga_mark_dirty(addr >> 2, (addr + size - 1) >> 2);
+    return;
+  }
+  if (_gc.chain4) {
+    for (size_t i = 0; i < size; ++i) {
+      _neo_vga_write_chain4(addr + i, src[i]);
+    }
+    return;
+  }
+  // a straight copy of each byte into every enabled plane
+  if (_vga_write == _neo_vga_write_0_001 && _vga_sr_enable() == 0) {
+    const uint32_t mask = _gc.plane_mask;
+    _vga_mark_dirty(addr, addr + size - 1);
+    for (size_t i = 0; i < size; ++i) {
+      uint32_t *dst = _vga_ram + addr + i;
+      *dst = (*dst & ~mask) | (_broadcast(src[i]) & mask);
+    }
+    return;
+  }
+  // writes do not touch the latch so there is no need to go via write86
+  for (size_t i = 0; i < size; ++i) {
+    _vga_write(addr + i, src[i]);
+  }
+}
+
+void neo_mem_read_block(uint8_t *dst, uint32_t addr, size_t size) {
+  if (size == 0) {
+    return;
+  }
+  if (_vga_read_mode() != 0) {
+    for (size_t i = 0; i < size; ++i) {
+      dst[i] = neo_mem_read_A0000(addr + i);
+    }
+    return;
+  }
+  const uint32_t offs = addr - 0xA0000;
+  if (_gc.chain4) {
+    memcpy(dst, (const uint8_t*)_vga_ram + offs, size);
+  }
+  else {
+    // read mode 0 returns bytes from one plane
+    const uint32_t shift = _vga_read_map_select() * 8;
+    for (size_t i = 0; i < size; ++i) {
+      dst[i] = (uint8_t)(_vga_ram[offs + i] >> shift);
+    }
+  }
+  // leave the latch as the last byte read
+  neo_mem_read_A0000(addr + size - 1);
+}
+
+void neo_mem_fill(uint32_t addr, uint16_t value, uint32_t count,
+                  uint32_t size) {
+  if (count == 0) {
+    return;
+  }
+  const uint32_t offs = addr - 0xA0000;
+  const uint32_t bytes = count * size;
+  if (_gc.chain4) {
+    for (uint32_t i = 0; i < bytes; ++i) {
+      const uint8_t v = (uint8_t)(value >> ((size == 2 && (i & 1)) ? 8 : 0));
+      if (neo_chain4_ram) {
+        neo_chain4_ram[offs + i] = v;
+      }
+      else {
+        _neo_vga_write_chain4(offs + i, v);
+      }
+    }
+    _vga_mark_dirty(offs >> 2, (offs + bytes - 1) >> 2);
+    return;
+  }
+  // with no reads in between the latch is fixed so each byte of `value`
+  // produces the same plane data every time it is written
+  const uint32_t mask = _gc.plane_mask;
+  const uint32_t lo = _vga_lanes((uint8_t)(value >> 0)) & mask;
+  const uint32_t hi = _vga_lanes((uint8_t)(value >> 8)) & mask;
+  _vga_mark_dirty(offs, offs + bytes - 1);
+  uint32_t *dst = _vga_ram + offs;
+  for (uint32_t i = 0; i < bytes; ++i) {
+    const uint32_t lanes = (size == 2 && (i & 1)) ? hi : lo;
+    dst[i] = (dst[i] & ~mask) | lanes;
+  }
+}
+
+void neo_mem_move(uint32_t dst, uint32_t src, uint32_t count,
+                  uint32_t size) {
+  if (count == 0) {
+    return;
+  }
+  // write mode 1 byte moves just copy the latches through
+  if (!_gc.chain4 && size == 1 && _vga_write_mode() == 1) {
+    const uint32_t mask = _gc.plane_mask;
+    const uint32_t d = dst - 0xA0000;
+    const uint32_t s = src - 0xA0000;
+    _vga_mark_dirty(d, d + count - 1);
+    // forwards one at a time so overlaps behave like movsb
+    for (uint32_t i = 0; i < count; ++i) {
+      _vga_ram[d + i] = (_vga_ram[d + i] & ~mask) | (_vga_ram[s + i] & mask);
+    }
+    // leave the latch as the last byte read
+    _vga_latch = _vga_ram[s + count - 1];
+    return;
+  }
+  // each element reads fully before it writes, the same as movsb/movsw
+  for (uint32_t i = 0; i < count; ++i) {
+    const uint32_t s = src + i * size;
+    const uint32_t d = dst + i * size;
+    if (size == 1) {
+      neo_mem_write_A0000(d, neo_mem_read_A0000(s));
+    }
+    else {
+      neo_mem_writew_A0000(d, neo_mem_readw_A0000(s));
+    }
+  }
+}
+
+const uint32_t *vga_ram(void) {
   return _vga_ram;
 }
 
+uint32_t neo_vram_dirty(void) {
+  const uint32_t pages = neo_vga_dirty;
+  neo_vga_dirty = 0;
+  return pages;
+}
+
+// displayed state besides vga memory as of the last neo_state_changed()
+static struct {
+  uint8_t mode;
+  uint8_t crt[32];
+  uint8_t attr[32];
+  uint32_t vga_dac[256];
+  uint32_t ega_dac[16];
+  uint8_t text[SNAPSHOT_TEXT_SIZE];
+} _shadow;
+
+// update a shadow copy returning true if it differed
+static bool _shadow_update(void *shadow, const void *src, size_t size) {
+  if (memcmp(shadow, src, size) == 0) {
+    return false;
+  }
+  memcpy(shadow, src, size);
+  return true;
+}
+
+bool neo_state_changed(void) {
+  bool changed = false;
+  changed |= _shadow_update(&_shadow.mode, &_video_mode, sizeof(_shadow.mode));
+  changed |= _shadow_update(_shadow.crt, crt_register, sizeof(_shadow.crt));
+  changed |= _shadow_update(_shadow.attr, _ega_reg, sizeof(_shadow.attr));
+  changed |= _shadow_update(_shadow.vga_dac, _dac_entry,
+                            sizeof(_shadow.vga_dac));
+  changed |= _shadow_update(_shadow.ega_dac, _ega_dac,
+                            sizeof(_shadow.ega_dac));
+  changed |= _shadow_update(_shadow.text, RAM + 0xB8000,
+                            sizeof(_shadow.text));
+  return changed;
+}
+
+void neo_snapshot(struct video_snapshot_t *snap, const uint32_t pages) {
+  const uint32_t planesize = 0x10000;
+  snap->mode = _video_mode;
+  snap->frame = vga_timing_frames();
+  snap->disk = false;
+  memcpy(snap->crt, crt_register, sizeof(snap->crt));
+  memcpy(snap->attr, _ega_reg, sizeof(snap->attr));
+  memcpy(snap->vga_dac, _dac_entry, sizeof(snap->vga_dac));
+  memcpy(snap->ega_dac, _ega_dac, sizeof(snap->ega_dac));
+  memcpy(snap->text, RAM + 0xB8000, sizeof(snap->text));
+  // copy only the vga memory which has changed
+  for (uint32_t i = 0; i < planesize / SNAPSHOT_PAGE_SIZE; ++i) {
+    if ((pages & (1u << i)) == 0) {
+      continue;
+    }
+    const uint32_t offs = i * SNAPSHOT_PAGE_SIZE;
+    memcpy(snap->vram + offs, _vga_ram + offs,
+           SNAPSHOT_PAGE_SIZE * sizeof(uint32_t));
+  }
+}
+
+// hash of each vga memory page as of the last neo_state_hash()
+static uint64_t _page_hash[0x10000 / SNAPSHOT_PAGE_SIZE];
+static bool _page_hash_ready;
+
+uint64_t neo_state_hash(uint32_t pages) {
+  if (!_page_hash_ready) {
+    pages = ~0u;
+    _page_hash_ready = true;
+  }
+  // rehash only the vga memory which has changed
+  for (uint32_t i = 0; i < 0x10000 / SNAPSHOT_PAGE_SIZE; ++i) {
+    if (pages & (1u << i)) {
+      _page_hash[i] = hash64(_vga_ram + i * SNAPSHOT_PAGE_SIZE,
+                             SNAPSHOT_PAGE_SIZE * sizeof(uint32_t), i);
+    }
+  }
+  uint64_t h = hash64(_page_hash, sizeof(_page_hash), _video_mode);
+  h = hash64_combine(h, hash64(crt_register, sizeof(crt_register), 0));
+  h = hash64_combine(h, hash64(_ega_reg, sizeof(_ega_reg), 0));
+  h = hash64_combine(h, hash64(_dac_entry, sizeof(_dac_entry), 0));
+  h = hash64_combine(h, hash64(_ega_dac, sizeof(_ega_dac), 0));
+  return hash64_combine(h, hash64(RAM + 0xB8000, SNAPSHOT_TEXT_SIZE, 0));
+}
+
+// append the utf-8 encoding of a code point
+static char *_utf8(char *out, const uint32_t cp) {
+  if (cp < 0x80) {
+    *out++ = (char)cp;
+  }
+  else if (cp < 0x800) {
+    *out++ = (char)(0xc0 | (cp >> 6));
+    *out++ = (char)(0x80 | (cp & 0x3f));
+  }
+  else {
+    *out++ = (char)(0xe0 | (cp >> 12));
+    *out++ = (char)(0x80 | ((cp >> 6) & 0x3f));
+    *out++ = (char)(0x80 | (cp & 0x3f));
+  }
+  return out;
+}
+
+bool neo_text_screen(char *out, uint32_t *cols_out, uint32_t *rows_out) {
+  assert(out);
+  switch (_video_mode) {
+  case 0x00: case 0x01: case 0x02: case 0x03: case 0x07:
+    break;
+  default:
+    return false;
+  }
+  const uint8_t *crt = crt_register;
+  // rows from the vertical display end if it has been programmed
+  const uint32_t vde = crt[0x12] |
+                       ((crt[0x07] & 0x02) << 7) |
+                       ((crt[0x07] & 0x40) << 3);
+  const uint32_t row_height = (crt[0x09] & 0x1f) + 1;
+  uint32_t rows = _rows;
+  if (vde && row_height >= 8) {
+    rows = SDL_min((vde + 1) / row_height, TEXT_SCREEN_MAX_ROWS);
+  }
+  const uint32_t cols = SDL_min(_cols, TEXT_SCREEN_MAX_COLS);
+  const uint32_t start = (crt[0xC] << 8) | crt[0xD];
+  const uint32_t stride = crt[0x13] ? (crt[0x13] * 2) : cols;
+  const uint8_t *src = RAM + 0xB8000;
+  for (uint32_t y = 0; y < rows; ++y) {
+    const uint32_t addr = start + y * stride;
+    char *end = out;
+    for (uint32_t x = 0; x < cols; ++x) {
+      const uint8_t ch = src[((addr + x) * 2) & (SNAPSHOT_TEXT_SIZE - 1)];
+      out = _utf8(out, cp437_unicode[ch]);
+      // trailing blanks are dropped
+      if (ch != ' ' && ch != 0) {
+        end = out;
+      }
+    }
+    out = end;
+    *out++ = '\n';
+  }
+  *out = '\0';
+  if (cols_out) {
+    *cols_out = cols;
+  }
+  if (rows_out) {
+    *rows_out = rows;
+  }
+  return true;
+}
+
 void neo_state_save(FILE *fd) {
   fwrite(&_video_mode, 1, sizeof(_video_mode), fd);
   fwrite(&_system, 1, sizeof(_system), fd);
@@ -951,6 +1382,7 @@ void neo_state_load(FILE *fd) {
   fread(&_active_page, 1, sizeof(_active_page), fd);
   fread(&_no_blanking, 1, sizeof(_no_blanking), fd);
   fread(_vga_ram, 1, sizeof(_vga_ram), fd);
+  neo_vga_dirty = ~0u;
 
   fread(&crt_reg_addr, 1, sizeof(crt_reg_addr), fd);
   fread(crt_register, 1, sizeof(crt_register), fd);
@@ -964,6 +1396,7 @@ void neo_state_load(FILE *fd) {
 
   fread(&_vga_reg_addr, 1, sizeof(_vga_reg_addr), fd);
   fread(_vga_reg_data, 1, sizeof(_vga_reg_data), fd);
+  _vga_gc_update();
 
   fread(_dac_entry, 1, sizeof(_dac_entry), fd);
   fread(&_dac_state     , 1, sizeof(_dac_state), fd);